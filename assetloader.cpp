@@ -0,0 +1,285 @@
+////////////////////////////////////////////////////////////////////////
+// Asynchronous asset loading:  jobs on the worker pool decode and
+// build, and the render thread uploads under a per-frame budget.  The
+// registry of shared assets lives here too.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "assetloader.h"
+#include "assetpack.h"
+#include "filecache.h"
+#include "shapes.h"
+#include "texture.h"
+#include "workers.h"
+
+static double Now()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Hashes everything that goes to the graphics card.
+static uint64_t ContentHash(const Shape* s)
+{
+    MeshArrays a = s->Data();
+    uint64_t counts[5] = { a.nPnt, a.nNrm, a.nTex, a.nTan, a.nTri };
+    uint64_t hash = Hash64(counts, sizeof(counts));
+    hash = Hash64(a.Pnt, a.nPnt*sizeof(glm::vec4), hash);
+    hash = Hash64(a.Nrm, a.nNrm*sizeof(glm::vec3), hash);
+    hash = Hash64(a.Tex, a.nTex*sizeof(glm::vec2), hash);
+    hash = Hash64(a.Tan, a.nTan*sizeof(glm::vec3), hash);
+    return Hash64(a.Tri, a.nTri*sizeof(glm::ivec3), hash);
+}
+
+// Bytes on the graphics card (with the mipmap chain) and in memory.
+// A shape read from the mesh cache holds its arrays in the mapped file,
+// which costs no memory.
+static size_t GpuBytes(const Texture* t) { return t->gpuBytes; }
+static size_t ArrayBytes(const MeshArrays& a)
+{
+    return a.nPnt*sizeof(glm::vec4) + a.nNrm*sizeof(glm::vec3) + a.nTex*sizeof(glm::vec2)
+        + a.nTan*sizeof(glm::vec3) + a.nTri*sizeof(glm::ivec3);
+}
+static size_t GpuBytes(const Shape* s) { return ArrayBytes(s->Data()); }
+static size_t CpuBytes(const Shape* s) { return s->mapping ? 0 : ArrayBytes(s->Data()); }
+
+AssetLoader::AssetLoader() : pending(0), start(0.0)
+{
+}
+
+// Returns the resource for key, with a new reference, creating it if
+// need be.
+AssetLoader::Resource* AssetLoader::Find(const uint64_t key, const std::string& name, bool& found)
+{
+    std::map<uint64_t, Resource*>::iterator i = byKey.find(key);
+    found = i != byKey.end();
+    if (found) {
+        i->second->refs++;
+        return i->second; }
+
+    Resource* r = new Resource();
+    r->name = name;
+    r->key = key;
+    r->refs = 1;
+    r->ready = false;
+    r->texture = NULL;
+    r->shape = NULL;
+    byKey[key] = r;
+    return r;
+}
+
+Texture* AssetLoader::LoadTexture(const std::string& path)
+{
+    // Every texture is loaded flipped (in a format that depends only on the file).
+    std::string name = PackName(path);
+    bool found;
+    Resource* r = Find(Hash64(name, Hash64("texture flipped")), name, found);
+    if (found) return r->texture;
+
+    r->texture = new Texture();
+    byAsset[r->texture] = r;
+    if (pending++ == 0) start = Now();
+    Workers().Submit([this, r, path]() {
+            Texture* decoded = new Texture();
+            if (!decoded->Decode(path)) {
+                delete decoded;
+                decoded = NULL; }
+            else
+                decoded->Stage();   // Into the pixel ring, while we're off the render thread
+            Finished f = { r, decoded, NULL, 0 };
+            std::lock_guard<std::mutex> guard(lock);
+            finished.push_back(f); });
+    return r->texture;
+}
+
+void AssetLoader::LoadShape(const std::string& name, const std::function<Shape*()>& make,
+                            const std::function<void(Shape*)>& done)
+{
+    bool found;
+    Resource* r = Find(Hash64(name, Hash64("shape")), name, found);
+    if (found && r->ready) {
+        if (done && r->shape) done(r->shape);
+        return; }
+    if (done) r->waiting.push_back(done);
+    if (found) return;
+
+    if (pending++ == 0) start = Now();
+    Workers().Submit([this, r, make]() {
+            Shape* shape = NULL;
+            deferVAO = true;
+            try { shape = make(); }
+            catch (std::exception&) { printf("Shape failed to load\n"); }
+            deferVAO = false;
+            Finished f = { r, NULL, shape, shape ? ContentHash(shape) : 0 };
+            std::lock_guard<std::mutex> guard(lock);
+            finished.push_back(f);
+            arrived.notify_all(); });
+}
+
+Shape* AssetLoader::MakeShape(const std::string& name, const std::function<Shape*()>& make)
+{
+    uint64_t key = Hash64(name, Hash64("shape"));
+    bool found;
+    Resource* r = Find(key, name, found);
+    if (!found) {
+        deferVAO = true;
+        Shape* shape = make();
+        deferVAO = false;
+        Finish(Finished{ r, NULL, shape, ContentHash(shape) }); }
+
+    // One requested by LoadShape may still be on its way:  wait for
+    // its job, and finish just that one (the rest wait for Update).
+    // (A new one is finished already, and r may be gone if it was merged.)
+    r = byKey[key];
+    if (!r->ready) {
+        Finished f;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            std::deque<Finished>::iterator i;
+            arrived.wait(guard, [&]() {
+                    for (i=finished.begin();  i!=finished.end();  i++)
+                        if (i->resource == r) return true;
+                    return false; });
+            f = *i;
+            finished.erase(i);
+        }
+        Retire(f); }
+    return byKey[key]->shape;
+}
+
+// Uploads one finished asset (unless it's a duplicate, or no longer
+// wanted) and hands it over.
+void AssetLoader::Finish(const Finished& f)
+{
+    Resource* r = f.resource;
+
+    if (r->texture) {
+        Texture* t = r->texture;
+        if (f.decoded) {
+            t->Take(f.decoded);
+            delete f.decoded;
+            if (r->refs > 0) t->Upload(); }
+        r->ready = true;
+        if (r->refs == 0) Free(r);
+        return; }
+
+    // A shape with the same contents as one already loaded is dropped
+    // in favor of that one, which takes over this one's key and users.
+    Shape* s = f.shape;
+    std::map<uint64_t, Resource*>::iterator same = s ? byContent.find(f.content) : byContent.end();
+    if (same != byContent.end()) {
+        Resource* into = same->second;
+        printf("%s has the same contents as %s;  sharing it\n", r->name.c_str(), into->name.c_str());
+        delete s;
+        into->refs += r->refs;
+        byKey[r->key] = into;
+        for (size_t i=0;  i<r->waiting.size();  i++)
+            r->waiting[i](into->shape);
+        delete r;
+        return; }
+
+    r->shape = s;
+    r->ready = true;
+    if (s) {
+        byAsset[s] = r;
+        byContent[f.content] = r;
+        if (r->refs > 0) s->MakeVAO(); }
+    std::vector<std::function<void(Shape*)> > waiting;
+    waiting.swap(r->waiting);
+    for (size_t i=0;  s && i<waiting.size();  i++)
+        waiting[i](s);
+    if (r->refs == 0) Free(r);
+}
+
+void AssetLoader::Release(const Texture* texture)
+{
+    std::map<const void*, Resource*>::iterator i = byAsset.find(texture);
+    if (i != byAsset.end() && --i->second->refs == 0 && i->second->ready)
+        Free(i->second);
+}
+
+void AssetLoader::Release(const Shape* shape)
+{
+    std::map<const void*, Resource*>::iterator i = byAsset.find(shape);
+    if (i != byAsset.end() && --i->second->refs == 0 && i->second->ready)
+        Free(i->second);
+}
+
+// Forgets a resource that no one uses, and frees its asset.
+void AssetLoader::Free(Resource* r)
+{
+    for (std::map<uint64_t, Resource*>::iterator i=byKey.begin();  i!=byKey.end(); )
+        if (i->second == r) byKey.erase(i++);
+        else ++i;
+    for (std::map<uint64_t, Resource*>::iterator i=byContent.begin();  i!=byContent.end(); )
+        if (i->second == r) byContent.erase(i++);
+        else ++i;
+    if (r->texture) {
+        byAsset.erase(r->texture);
+        delete r->texture; }
+    if (r->shape) {
+        byAsset.erase(r->shape);
+        DeleteVao(r->shape->vaoID);
+        delete r->shape; }
+    delete r;
+}
+
+void AssetLoader::Update(const double budget)
+{
+    double begin = Now();
+    while (pending > 0) {
+        Finished f;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (finished.empty()) break;
+            f = finished.front();
+            finished.pop_front();
+        }
+        Retire(f);
+        if ((Now() - begin)*1000.0 >= budget) break; }
+}
+
+// Finishes a requested asset, reporting when the last one is in.
+void AssetLoader::Retire(const Finished& f)
+{
+    Finish(f);
+    if (--pending == 0) {
+        printf("Assets loaded %.2f seconds after being requested\n", Now() - start);
+        Report(); }
+}
+
+void AssetLoader::Report()
+{
+    std::vector<std::pair<size_t, Resource*> > list;
+    for (std::map<const void*, Resource*>::iterator i=byAsset.begin();  i!=byAsset.end();  i++) {
+        Resource* r = i->second;
+        size_t bytes = r->texture ? GpuBytes(r->texture) : GpuBytes(r->shape) + CpuBytes(r->shape);
+        list.push_back(std::make_pair(bytes, r)); }
+    std::sort(list.rbegin(), list.rend());
+
+    size_t gpu = 0, cpu = 0;
+    printf("%10s %10s %5s  %s\n", "GPU KB", "CPU KB", "refs", "asset");
+    for (size_t i=0;  i<list.size();  i++) {
+        Resource* r = list[i].second;
+        size_t g = r->texture ? GpuBytes(r->texture) : GpuBytes(r->shape);
+        size_t c = r->texture ? 0 : CpuBytes(r->shape);
+        printf("%10lld %10lld %5d  %s%s\n", (long long)(g>>10), (long long)(c>>10), r->refs,
+               r->name.c_str(), r->ready ? "" : " (loading)");
+        gpu += g;
+        cpu += c; }
+    printf("%10lld %10lld        total\n", (long long)(gpu>>10), (long long)(cpu>>10));
+}
+
+AssetLoader& Loader()
+{
+    static AssetLoader loader;
+    return loader;
+}
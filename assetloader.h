@@ -0,0 +1,111 @@
+////////////////////////////////////////////////////////////////////////
+// Asynchronous asset loading.  Decoding images and building meshes
+// (parsing PLY files, tessellating) run as jobs on the worker pool, so
+// the first frame need not wait for them.  Finished assets wait in a
+// queue, and Update sends them to the graphics card from the render
+// thread, a few each frame, within a time budget.
+//
+// Until its asset arrives, a texture is empty (textureId 0), and
+// Object::Draw treats it as absent, so the object is drawn with just
+// its own colors.  A shape is handed to its done function once it is
+// on the graphics card, which is where it's put into the scene.
+//
+// The loader is also the registry of what's loaded.  Assets are
+// shared:  a texture is keyed by its file (and how it's loaded), and
+// a shape by a name that the caller builds from whatever determines
+// its contents ("teapot 12", "ply room.ply").  Asking again for the
+// same key returns the same asset, and shapes that turn out to have
+// identical contents (hashed as they're built) are merged.  Each
+// request counts as a reference, given back with Release;  the last
+// one frees the asset, on the graphics card too.  Report lists the
+// assets with their resident sizes.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _ASSETLOADER_
+#define _ASSETLOADER_
+
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+class Shape;
+class Texture;
+
+class AssetLoader
+{
+ public:
+    AssetLoader();
+
+    // Returns the (shared) texture for path at once;  if it's new, it
+    // is empty until it has been loaded.
+    Texture* LoadTexture(const std::string& path);
+
+    // Gets the (shared) shape called name.  If it's new, make is
+    // called on a worker thread (with deferVAO set).  Either way, done
+    // is called on the render thread once the shape is uploaded.
+    void LoadShape(const std::string& name, const std::function<Shape*()>& make,
+                   const std::function<void(Shape*)>& done=std::function<void(Shape*)>());
+
+    // The same, but builds a new shape right away, on this thread (or
+    // waits for the one LoadShape has in flight, and uploads it alone).
+    Shape* MakeShape(const std::string& name, const std::function<Shape*()>& make);
+
+    // Drops a reference taken by one of the above.
+    void Release(const Texture* texture);
+    void Release(const Shape* shape);
+
+    // Uploads finished assets until budget (in milliseconds) has been
+    // spent.  At least one is uploaded per call, if there are any.
+    // Call once per frame, from the render thread.
+    void Update(const double budget);
+
+    int Pending() const { return pending; }
+
+    // Prints every asset, its reference count and resident sizes.
+    void Report();
+
+ private:
+    struct Resource
+    {
+        std::string name;
+        uint64_t key;
+        int refs;
+        bool ready;             // Uploaded
+        Texture* texture;       // One of these
+        Shape* shape;
+        std::vector<std::function<void(Shape*)> > waiting; // Shape's done functions
+    };
+
+    struct Finished
+    {
+        Resource* resource;
+        Texture* decoded;       // The texture's decoded image (or NULL on failure)
+        Shape* shape;           // or the shape built (or NULL on failure)
+        uint64_t content;       //   and the hash of its arrays
+    };
+
+    std::mutex lock;            // Guards finished;  everything else is render thread only
+    std::deque<Finished> finished;
+    std::condition_variable arrived; // A shape's job has added to finished (see MakeShape)
+    int pending;                // Requested and not yet uploaded
+    double start;               // When the first of the pending assets was requested
+
+    std::map<uint64_t, Resource*> byKey;
+    std::map<uint64_t, Resource*> byContent;   // Shapes only
+    std::map<const void*, Resource*> byAsset;
+
+    Resource* Find(const uint64_t key, const std::string& name, bool& found);
+    void Finish(const Finished& f);
+    void Retire(const Finished& f);
+    void Free(Resource* r);
+};
+
+// The single loader shared by the whole program, created on first use.
+AssetLoader& Loader();
+
+#endif
@@ -0,0 +1,80 @@
+////////////////////////////////////////////////////////////////////////
+// Asset pack lookup.  The table of contents is searched in place (it
+// is sorted), so opening a pack costs one mapping and no parsing.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "assetpack.h"
+#include "filecache.h"
+#include "mapfile.h"
+
+static MappedFile* packFile = NULL;
+static const char* packData = NULL;
+static const PackEntry* packEntries = NULL;
+static const char* packNames = NULL;
+static uint32_t packCount = 0;
+
+std::string PackName(const std::string& path)
+{
+    std::string name = path;
+    std::replace(name.begin(), name.end(), '\\', '/');
+    while (name.compare(0, 2, "./") == 0) name.erase(0, 2);
+    return name;
+}
+
+bool OpenAssetPack(const std::string& path)
+{
+    MappedFile* file = new MappedFile(path);
+    size_t length;
+    const char* payload = MappedCache(*file, "PACK", packVersion, length);
+    PackHeader h;
+    bool ok = payload && length >= sizeof(h);
+    if (ok) {
+        memcpy(&h, payload, sizeof(h));
+        ok = (length - sizeof(h))/sizeof(PackEntry) >= h.entries
+            && h.names >= sizeof(h) + h.entries*sizeof(PackEntry) && h.names <= length; }
+    for (uint32_t i=0;  ok && i<h.entries;  i++) {
+        const PackEntry* e = (const PackEntry*)(payload + sizeof(h)) + i;
+        ok = e->offset <= length && e->size <= length - e->offset && e->name < length - h.names; }
+    if (!ok) {
+        delete file;
+        return false; }
+
+    delete packFile;
+    packFile = file;
+    packData = payload;
+    packEntries = (const PackEntry*)(payload + sizeof(h));
+    packNames = payload + h.names;
+    packCount = h.entries;
+    printf("Asset pack %s: %d entries\n", path.c_str(), (int)packCount);
+    return true;
+}
+
+const char* PackedAsset(const std::string& path, const PackKind kind, size_t& size)
+{
+    if (!packCount) return NULL;
+    std::string name = PackName(path);
+
+    // Binary search on (name, kind)
+    uint32_t lo = 0, hi = packCount;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi)/2;
+        const PackEntry& e = packEntries[mid];
+        int c = strcmp(packNames + e.name, name.c_str());
+        if (c < 0 || (c == 0 && e.kind < (uint32_t)kind)) lo = mid+1;
+        else hi = mid; }
+    if (lo == packCount) return NULL;
+    const PackEntry& e = packEntries[lo];
+    if (e.kind != (uint32_t)kind || name != packNames + e.name) return NULL;
+
+    // A source file that's present and differs from the packed one wins.
+    if (e.stamp) {
+        uint64_t stamp = HashFileStamp(name);
+        if (stamp && stamp != e.stamp) return NULL; }
+
+    size = e.size;
+    return packData + e.offset;
+}
@@ -0,0 +1,70 @@
+////////////////////////////////////////////////////////////////////////
+// Asset packs.  Startup otherwise opens and reads dozens of loose
+// files:  shader sources, images to be decoded, cached meshes.  An
+// asset pack bundles them into one file with a sorted table of
+// contents ("make pack" builds assets.pack with packtool.cpp).  At
+// run time the pack is mapped once, and each asset is a view into the
+// mapping:  shaders compile straight from it, images are stored
+// already decoded so they go straight to the graphics card, and
+// cached meshes are read in place.
+//
+// Loose files still work.  Anything missing from the pack, or changed
+// on disk since it was packed, is read from its file as before.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _ASSETPACK_
+#define _ASSETPACK_
+
+#include <string>
+#include <stdint.h>
+
+enum PackKind
+{
+    PackRaw = 0,                // The file's bytes
+    PackImage = 1               // A PackedImage:  the file decoded as Texture would
+};
+
+// Pack layout (the payload of a filecache file with magic "PACK"):  a
+// PackHeader, the PackEntry table sorted by name then kind, the
+// entries' names (each zero terminated), then the entries' data, each
+// starting on a 16 byte boundary.
+struct PackHeader
+{
+    uint32_t entries;
+    uint32_t names;             // Offset of the names
+    uint64_t reserved;
+};
+
+struct PackEntry
+{
+    uint64_t offset;            // Of the data, from the start of the payload
+    uint64_t size;
+    uint64_t stamp;             // HashFileStamp of the source when packed, or 0
+    uint32_t name;              // Offset of the name, from the start of the names
+    uint32_t kind;
+};
+
+// An image entry is this header followed by width*height texels of 4
+// bytes each (see imageformat.h), bottom row first.
+struct PackedImage
+{
+    uint32_t width, height;
+    uint32_t format;            // An ImageFormat
+    uint32_t reserved;
+};
+
+const uint32_t packVersion = 2;
+
+// Maps the pack at path for the rest of the run.  Returns false (and
+// everything is then read from loose files) if there is none.
+bool OpenAssetPack(const std::string& path);
+
+// Returns the named asset in the open pack, or NULL if it isn't there
+// or its source file has changed since.
+const char* PackedAsset(const std::string& name, const PackKind kind, size_t& size);
+
+// The name an asset is stored under:  the relative path with forward
+// slashes and no leading "./".
+std::string PackName(const std::string& path);
+
+#endif
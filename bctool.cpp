@@ -0,0 +1,184 @@
+////////////////////////////////////////////////////////////////////////
+// Block-compresses images (see texcompress.h) into cache/, with their
+// full mip chains, and reports what each one cost.
+//
+// Usage:  bctool [-bc1|-bc3|-bc4|-bc5|-bc6h] [-box] files...
+// Without a format, each image gets the one that suits it:  BC6H for
+// .hdr files, BC5 for normal maps (any file with "normal" in its
+// name), BC4 for gray images, BC3 for those with any transparency, and
+// BC1 for the rest.  The lower levels are filtered as Texture's own
+// chains are (see mipchain.h), with the Kaiser filter unless -box is
+// given.  For each image it prints the format, the sizes before and
+// after, the encoding speed, and the PSNR of the top level (of the
+// tone mapped colors, for BC6H).
+//
+// Build and run with "make compress".
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "texcompress.h"
+#include "imageformat.h"
+#include "mipchain.h"
+#include "assetpack.h"
+#include "filecache.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_FAILURE_USERMSG
+#include "stb_image.h"
+
+static double Now()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static size_t Align16(const size_t n) { return (n + 15) & ~(size_t)15; }
+
+static BCFormat Choose(const std::string& path, const unsigned char* rgba, const size_t count)
+{
+    std::string name = path;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name.find("normal") != std::string::npos) return BC5;
+    bool gray = true, opaque = true;
+    for (size_t i=0;  i<count;  i++) {
+        const unsigned char* p = rgba + 4*i;
+        gray = gray && p[0] == p[1] && p[1] == p[2];
+        opaque = opaque && p[3] == 255; }
+    return !opaque ? BC3 : gray ? BC4 : BC1;
+}
+
+// Peak signal to noise ratio of the decoded top level, over the
+// channels the format keeps.
+static double PSNR(const BCFormat format, const void* original, const void* decoded, const size_t count)
+{
+    int channels = format == BC3 ? 4 : format == BC4 ? 1 : format == BC5 ? 2 : 3;
+    double sum = 0.0;
+    for (size_t i=0;  i<count;  i++)
+        for (int c=0;  c<channels;  c++) {
+            double a, b;
+            if (format == BC6H) {
+                float x = ((const float*)original)[3*i+c], y = ((const float*)decoded)[3*i+c];
+                a = 255.0*x/(1.0+x);
+                b = 255.0*y/(1.0+y); }
+            else {
+                a = ((const unsigned char*)original)[4*i+c];
+                b = ((const unsigned char*)decoded)[4*i+c]; }
+            sum += (a-b)*(a-b); }
+    double mse = sum/((double)count*channels);
+    return mse > 0.0 ? 10.0*log10(255.0*255.0/mse) : 99.0;
+}
+
+// Compresses one image, returning false on failure.
+static bool Compress(const std::string& path, BCFormat format, const MipFilter filter)
+{
+    int width, height, n;
+    bool hdr = stbi_is_hdr(path.c_str()) != 0;
+    if (format == BCNone && hdr) format = BC6H;
+    void* image = format == BC6H ? (void*)stbi_loadf(path.c_str(), &width, &height, &n, 3)
+                                 : (void*)stbi_load(path.c_str(), &width, &height, &n, 4);
+    if (!image) {
+        printf("Skipping %s: %s\n", path.c_str(), stbi_failure_reason());
+        return false; }
+    size_t count = (size_t)width*height;
+    if (format == BCNone) format = Choose(path, (unsigned char*)image, count);
+
+    // Every level, down to 1x1
+    BCHeader h;
+    memset(&h, 0, sizeof(h));
+    h.format = format;
+    h.width = width;
+    h.height = height;
+    h.stamp = HashFileStamp(PackName(path));
+    std::vector<std::vector<unsigned char> > levels;
+    double encode = 0.0;
+    size_t pixels = 0;
+    size_t offset = sizeof(h);
+    auto add = [&](const void* texels, const int w, const int ht) {
+        if (levels.size() == 16) return;
+        double start = Now();
+        levels.push_back(CompressImage(format, texels, w, ht));
+        encode += Now() - start;
+        pixels += (size_t)w*ht;
+        h.offset[levels.size()-1] = offset;
+        h.size[levels.size()-1] = levels.back().size();
+        offset = Align16(offset + levels.back().size()); };
+
+    add(image, width, height);
+    MipKind kind = MipKindFor(path);
+    std::vector<unsigned char> texels;
+    auto level = [&](int, int w, int ht, const float* rgba) {
+        size_t n = (size_t)w*ht;
+        if (format == BC6H) {
+            texels.resize(n*3*sizeof(float));
+            float* rgb = (float*)&texels[0];
+            for (size_t i=0;  i<n;  i++)
+                for (int c=0;  c<3;  c++) rgb[3*i+c] = rgba[4*i+c]; }
+        else {
+            texels.resize(n*4);
+            EncodeTexels(rgba, n, kind, ImageRGBA8, &texels[0]); }
+        add(&texels[0], w, ht); };
+    if (format == BC6H) BuildMips((const float*)image, width, height, filter, level);
+    else BuildMips((const unsigned char*)image, ImageRGBA8, width, height, kind, filter, level);
+    h.levels = levels.size();
+
+    std::vector<char> payload(offset, 0);
+    memcpy(&payload[0], &h, sizeof(h));
+    for (size_t l=0;  l<levels.size();  l++)
+        memcpy(&payload[h.offset[l]], &levels[l][0], levels[l].size());
+    std::string out = CompressedPath(path);
+    if (!WriteCache(out, "BCTX", bcVersion, &payload[0], payload.size())) {
+        printf("Can't write %s\n", out.c_str());
+        stbi_image_free(image);
+        return false; }
+
+    // Quality of the top level
+    double psnr;
+    if (format == BC6H) {
+        std::vector<float> decoded(count*3);
+        DecompressImage(format, &levels[0][0], width, height, &decoded[0]);
+        psnr = PSNR(format, image, &decoded[0], count); }
+    else {
+        std::vector<unsigned char> decoded(count*4);
+        DecompressImage(format, &levels[0][0], width, height, &decoded[0]);
+        psnr = PSNR(format, image, &decoded[0], count); }
+
+    size_t before = pixels*4;   // As RGBA8 or R11F_G11F_B10F, with mipmaps
+    printf("  %-40s %-4s %5dx%-5d %8lld KB -> %6lld KB  %7.1f ms %7.1f MPix/s  %5.1f dB\n",
+           PackName(path).c_str(), BCName(format), width, height, (long long)(before>>10),
+           (long long)((offset - sizeof(h))>>10), encode*1000.0, pixels/encode/1e6, psnr);
+    stbi_image_free(image);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BCFormat format = BCNone;
+    MipFilter filter = MipKaiser;
+    int a = 1;
+    for (;  a < argc && argv[a][0] == '-';  a++) {
+        std::string f = argv[a];
+        if (f == "-bc1") format = BC1;
+        else if (f == "-bc3") format = BC3;
+        else if (f == "-bc4") format = BC4;
+        else if (f == "-bc5") format = BC5;
+        else if (f == "-bc6h") format = BC6H;
+        else if (f == "-box") filter = MipBox;
+        else a = argc; }
+    if (a >= argc) {
+        printf("Usage: bctool [-bc1|-bc3|-bc4|-bc5|-bc6h] [-box] files...\n");
+        return -1; }
+
+    stbi_set_flip_vertically_on_load(true);
+    int failed = 0;
+    for (;  a<argc;  a++)
+        if (!Compress(argv[a], format, filter)) failed++;
+    return failed ? -1 : 0;
+}
@@ -19,6 +19,7 @@ const int     teapotId	= 9;
 const int     spheresId	= 10;
 const int     floorId	= 11;
 const int     otherId   = 12;
+const int     scatterId = 13;
 
 uniform vec3 Light, Ambient, eyePos, lightPos;
 uniform sampler2D shadowMap;
@@ -30,15 +31,45 @@ uniform sampler2D AOMap;
 uniform int screenWidth, screenHeight;
 uniform int objectId;
 uniform mat4 ShadowMatrix;
+uniform mat4 WorldView;
 
-uniform sampler2D IBL;
-uniform sampler2D IRRIBL;
-uniform int iblWidth, iblHeight;
+// Integrated volumetric fog (see fog.cpp): rgb in-scattered light,
+// a transmittance, from the eye to each exponentially spaced slice.
+uniform sampler3D fogVolume;
+uniform float fogNear, fogFar;
+
+uniform samplerCube IBL;        // The environment's cube map (see cubemap.h)
+uniform int iblSize;            // Texels across its faces
+
+// The environment's irradiance as L2 spherical harmonics (see
+// shirradiance.h), basis constants folded in;  all zero until projected.
+uniform vec3 shIrradiance[9];
+
+// Split-sum specular IBL (see iblbake.h):  the environment prefiltered
+// by roughness, and the BRDF's scale and bias of Ks by N.V and
+// roughness.  iblLevels is 0 until they're baked.
+uniform samplerCube prefilteredIBL;
+uniform sampler2D brdfLUT;
+uniform int iblLevels;
 
 uniform HammersleyBlock {
  float hammN;
  float hammersley[200]; };
 
+vec3 ApplyFog(vec3 C, vec3 worldPos, vec2 uv) {
+	float depth = max(-(WorldView * vec4(worldPos, 1.0)).z, fogNear);
+	float w = log(depth/fogNear) / log(fogFar/fogNear);
+	vec4 fog = texture(fogVolume, vec3(uv, clamp(w, 0.0, 1.0)));
+	return C*fog.a + fog.rgb;
+}
+
+// Reinhard tone mapping with exposure e, then gamma.  (The sky and the
+// environment maps are HDR radiance.)
+vec3 ToneMap(vec3 C, float e) {
+	C = (e * C) / (e * C + vec3(1,1,1));
+	return vec3(pow(C.x, 1/2.2), pow(C.y, 1/2.2), pow(C.z, 1/2.2));
+}
+
 float det3(vec3 a, vec3 b, vec3 c) {
 	return a.x*(b.y*c.z-b.z*c.y) + a.y*(b.z*c.x-b.x*c.z) + a.z*(b.x*c.y-b.y*c.x);
 }
@@ -61,6 +92,13 @@ vec3 Cholesky(float m11, float m12, float m13, float m22, float m23, float m33,
 	return vec3(c1, c2, c3);
 }
 
+vec3 SHIrradiance(vec3 n) {
+	return shIrradiance[0]
+		+ shIrradiance[1]*n.y + shIrradiance[2]*n.z + shIrradiance[3]*n.x
+		+ shIrradiance[4]*n.x*n.y + shIrradiance[5]*n.y*n.z + shIrradiance[6]*(3.0*n.z*n.z - 1.0)
+		+ shIrradiance[7]*n.x*n.z + shIrradiance[8]*(n.x*n.x - n.y*n.y);
+}
+
 vec3 g(vec3 Wk, vec3 V, vec3 Ks) {
     vec3 H = normalize(Wk + V);
     float WkH = max(dot(Wk, H), 0.0);
@@ -106,7 +144,7 @@ void main() {
 		vec3 Ks = texture(G3, uv).rgb;
 		float a = texture(G3, uv).w;
 		if (a == -1.0f) {
-			gl_FragColor.xyz = Kd;
+			gl_FragColor.xyz = ToneMap(ApplyFog(Kd, worldPos, uv), 0.8);
 			return;
 		}
 
@@ -129,50 +167,58 @@ void main() {
 
         // Shader code for Project 3
         // IBL diffuse
-        uv = vec2(0.5 - atan(N.y, N.x) / (2 * PI), -acos(N.z) / PI);
-        vec3 C = texture(IRRIBL, uv).xyz;
+        vec3 C = max(SHIrradiance(N), vec3(0.0));
         vec3 diffuse = (Kd / PI) * C;
 
         // Store specular for averaging
         vec3 spec = vec3(0, 0, 0);
 
         vec3 R = 2.0 * VN * N - V;
-        vec3 A = normalize(vec3(-R.y, R.x, 0.0));
-        vec3 B = normalize(cross(R, A));
         float e = 0.8;
-        for (int i = 0; i < hammN; i++) {
-            // random values assigned in scene.cpp
-            float E1 = hammersley[2 * i];
-            float E2 = hammersley[2 * i + 1];
-
-            // Phong
-            float theta = acos(pow(E2, 1 / (a + 1)));
-            E2 = theta / PI;
-
-            // Direction Vector
-            vec3 L = vec3(cos(2 * PI * (0.5 - E1)) * sin(PI * E2), sin(2 * PI * (0.5 - E1)) * sin(PI * E2), cos(PI * E2));
-
-            // Rotate L towards Reflection direction
-            vec3 Wk = normalize(L.x * A + L.y * B + L.z * R);
+        if (iblLevels > 0) {
+            // Two fetches:  the lobe's average of the environment, at the
+            // level for this exponent's roughness, and the BRDF's integral
+            float r = sqrt(sqrt(2.0 / (a + 2.0)));
+            vec2 ab = texture(brdfLUT, vec2(VN, r)).xy;
+            spec = textureLod(prefilteredIBL, R, r * (iblLevels - 1)).xyz * (Ks * ab.x + ab.y);
+        }
+        else {
+            // The full sum, until the prefiltered environment is baked
+            vec3 A = normalize(vec3(-R.y, R.x, 0.0));
+            vec3 B = normalize(cross(R, A));
+            for (int i = 0; i < hammN; i++) {
+                // random values assigned in scene.cpp
+                float E1 = hammersley[2 * i];
+                float E2 = hammersley[2 * i + 1];
+
+                // Phong
+                float theta = acos(pow(E2, 1 / (a + 1)));
+                E2 = theta / PI;
+
+                // Direction Vector
+                vec3 L = vec3(cos(2 * PI * (0.5 - E1)) * sin(PI * E2), sin(2 * PI * (0.5 - E1)) * sin(PI * E2), cos(PI * E2));
+
+                // Rotate L towards Reflection direction
+                vec3 Wk = normalize(L.x * A + L.y * B + L.z * R);
             
-            vec3 H2 = normalize(Wk + V);
-            float NH2 = max(dot(N, H2), 0.0);
-            float DH2 = ((a + 2) / (2 * PI) * pow(NH2, a));
-
-            // Level of Detail
-            float level = 0.5 * log2((iblWidth * iblHeight) / hammN) - 0.5 * log2(DH2);
-            //level = 0;
-            uv = vec2(0.5 - (atan(Wk.y, Wk.x) / (2*PI)), -acos(Wk.z) / PI);
-            // color
-            C = textureLod(IBL, uv, level).xyz;
-            spec += g(Wk, V, Ks) * C * cos(theta);
+                vec3 H2 = normalize(Wk + V);
+                float NH2 = max(dot(N, H2), 0.0);
+                float DH2 = ((a + 2) / (2 * PI) * pow(NH2, a));
+
+                // Level of Detail
+                float level = 0.5 * log2((6 * iblSize * iblSize) / hammN) - 0.5 * log2(DH2);
+                //level = 0;
+                // color
+                C = textureLod(IBL, Wk, level).xyz;
+                spec += g(Wk, V, Ks) * C * cos(theta);
+            }
+            spec /= hammN;
         }
-        spec /= hammN;
         
         C = diffuse + spec;
+        C = ApplyFog(C, worldPos, gl_FragCoord.xy / vec2(screenWidth, screenHeight));
         
-        C = (e * C) / (e * C + vec3(1,1,1));
-        C = vec3(pow(C.x, 1/2.2), pow(C.y, 1/2.2), pow(C.z, 1/2.2));
+        C = ToneMap(C, e);
 
         uv = gl_FragCoord.xy / vec2(screenWidth, screenHeight);
         float ambientScalar = texture(AOMap, uv).x;
@@ -0,0 +1,249 @@
+////////////////////////////////////////////////////////////////////////
+// CPU-resident texture copies, and their bilinear/trilinear sampling.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPU_SSE2
+#endif
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "cpuimage.h"
+#include "mipchain.h"
+#include "texcompress.h"
+#include "imageformat.h"
+#include "workers.h"
+
+// Batches this large are spread over the worker pool.
+static const size_t parallelCount = 4096;
+
+void CpuImage::Reserve(const int levelCount)
+{
+    levels = levelCount;
+    size_t texels = 0;
+    for (int l=0;  l<levels;  l++) {
+        offset[l] = texels;
+        texels += (size_t)std::max(1, width >> l)*std::max(1, height >> l); }
+    if (format == CpuRGBA8) bytes.resize(4*texels);
+    else floats.resize(4*texels);
+}
+
+CpuImage::CpuImage(const MipChain* chain, const CpuFormat _format, const bool mips)
+    : format(chain->format == ImageR11G11B10F ? CpuRGBA32F : _format),
+      width(chain->width), height(chain->height), levels(0)
+{
+    Reserve(mips ? chain->levels : 1);
+    for (int l=0;  l<levels;  l++) {
+        size_t n = (size_t)std::max(1, width >> l)*std::max(1, height >> l);
+        if (format == CpuRGBA8) {
+            memcpy(&bytes[4*offset[l]], chain->level[l], 4*n);
+            continue; }
+
+        float* out = &floats[4*offset[l]];
+        if (chain->format == ImageR11G11B10F) {
+            // RGB triples, spread out to RGBA from the end back (in place)
+            DecodeR11G11B10F((const uint32_t*)chain->level[l], out, n);
+            for (size_t i=n;  i-- > 0; ) {
+                float r = out[3*i], g = out[3*i+1], b = out[3*i+2];
+                out[4*i] = r;  out[4*i+1] = g;  out[4*i+2] = b;  out[4*i+3] = 1.0f; } }
+        else
+            for (size_t i=0;  i<4*n;  i++) out[i] = chain->level[l][i]/255.0f; }
+}
+
+CpuImage::CpuImage(const CompressedTexture* compressed, const CpuFormat _format, const bool mips)
+    : format(compressed->format == BC6H ? CpuRGBA32F : _format),
+      width(compressed->width), height(compressed->height), levels(0)
+{
+    Reserve(mips ? compressed->levels : 1);
+    std::vector<unsigned char> rgba;
+    std::vector<float> rgb;
+    for (int l=0;  l<levels;  l++) {
+        int w = std::max(1, width >> l), h = std::max(1, height >> l);
+        size_t n = (size_t)w*h;
+        if (compressed->format == BC6H) {
+            rgb.resize(3*n);
+            DecompressImage(BC6H, compressed->level[l], w, h, &rgb[0]);
+            float* out = &floats[4*offset[l]];
+            for (size_t i=0;  i<n;  i++) {
+                out[4*i] = rgb[3*i];  out[4*i+1] = rgb[3*i+1];  out[4*i+2] = rgb[3*i+2];
+                out[4*i+3] = 1.0f; }
+            continue; }
+
+        if (format == CpuRGBA8) {
+            DecompressImage(compressed->format, compressed->level[l], w, h, &bytes[4*offset[l]]);
+            continue; }
+        rgba.resize(4*n);
+        DecompressImage(compressed->format, compressed->level[l], w, h, &rgba[0]);
+        float* out = &floats[4*offset[l]];
+        for (size_t i=0;  i<4*n;  i++) out[i] = rgba[i]/255.0f; }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Sampling
+
+// Bilinear samples of four coordinates, each at its own level, as
+// four RGBA floats.  The texel coordinates are worked out for all four
+// at once, then the 2x2 texels of each are fetched and blended.
+void CpuImage::Bilinear4(const float* u, const float* v, const int* level, float* out) const
+{
+    int x0[4], x1[4], y0[4], y1[4];
+    float fx[4], fy[4];
+#ifdef CPU_SSE2
+    const __m128 one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+    auto floor4 = [&](const __m128 a) {
+        __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+        return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), one)); };
+    __m128i wi = _mm_setr_epi32(std::max(1, width >> level[0]), std::max(1, width >> level[1]),
+                                std::max(1, width >> level[2]), std::max(1, width >> level[3]));
+    __m128i hi = _mm_setr_epi32(std::max(1, height >> level[0]), std::max(1, height >> level[1]),
+                                std::max(1, height >> level[2]), std::max(1, height >> level[3]));
+
+    // Wrapped to [0,1), then to texels:  x0 may be -1 and x1 the width
+    __m128 U = _mm_loadu_ps(u), V = _mm_loadu_ps(v);
+    U = _mm_sub_ps(U, floor4(U));
+    V = _mm_sub_ps(V, floor4(V));
+    __m128 X = _mm_sub_ps(_mm_mul_ps(U, _mm_cvtepi32_ps(wi)), half);
+    __m128 Y = _mm_sub_ps(_mm_mul_ps(V, _mm_cvtepi32_ps(hi)), half);
+    __m128 X0 = floor4(X), Y0 = floor4(Y);
+    _mm_storeu_ps(fx, _mm_sub_ps(X, X0));
+    _mm_storeu_ps(fy, _mm_sub_ps(Y, Y0));
+
+    const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi32(1);
+    auto wrap = [&](const __m128 A0, const __m128i size, int* i0, int* i1) {
+        __m128i a0 = _mm_cvttps_epi32(A0), a1 = _mm_add_epi32(a0, ones);
+        __m128i below = _mm_cmplt_epi32(a0, zero);
+        a0 = _mm_or_si128(_mm_and_si128(below, _mm_sub_epi32(size, ones)), _mm_andnot_si128(below, a0));
+        a1 = _mm_andnot_si128(_mm_cmpeq_epi32(a1, size), a1);
+        _mm_storeu_si128((__m128i*)i0, a0);
+        _mm_storeu_si128((__m128i*)i1, a1); };
+    wrap(X0, wi, x0, x1);
+    wrap(Y0, hi, y0, y1);
+#else
+    for (int k=0;  k<4;  k++) {
+        int w = std::max(1, width >> level[k]), h = std::max(1, height >> level[k]);
+        float x = (u[k] - floorf(u[k]))*w - 0.5f, y = (v[k] - floorf(v[k]))*h - 0.5f;
+        float fx0 = floorf(x), fy0 = floorf(y);
+        fx[k] = x - fx0;
+        fy[k] = y - fy0;
+        x0[k] = (int)fx0;  x1[k] = x0[k] + 1;
+        y0[k] = (int)fy0;  y1[k] = y0[k] + 1;
+        if (x0[k] < 0) x0[k] = w-1;
+        if (x1[k] == w) x1[k] = 0;
+        if (y0[k] < 0) y0[k] = h-1;
+        if (y1[k] == h) y1[k] = 0; }
+#endif
+
+    for (int k=0;  k<4;  k++) {
+        int w = std::max(1, width >> level[k]);
+        size_t base = offset[level[k]];
+        size_t t[4] = { base + (size_t)y0[k]*w + x0[k], base + (size_t)y0[k]*w + x1[k],
+                        base + (size_t)y1[k]*w + x0[k], base + (size_t)y1[k]*w + x1[k] };
+#ifdef CPU_SSE2
+        __m128 c[4];
+        for (int i=0;  i<4;  i++) {
+            if (format == CpuRGBA32F) {
+                c[i] = _mm_loadu_ps(&floats[4*t[i]]);
+                continue; }
+            int word;
+            memcpy(&word, &bytes[4*t[i]], 4);
+            __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(word), zero);
+            c[i] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero)), _mm_set1_ps(1.0f/255.0f)); }
+        __m128 a = _mm_set1_ps(fx[k]), b = _mm_set1_ps(fy[k]);
+        __m128 top = _mm_add_ps(c[0], _mm_mul_ps(a, _mm_sub_ps(c[1], c[0])));
+        __m128 bottom = _mm_add_ps(c[2], _mm_mul_ps(a, _mm_sub_ps(c[3], c[2])));
+        _mm_storeu_ps(out + 4*k, _mm_add_ps(top, _mm_mul_ps(b, _mm_sub_ps(bottom, top))));
+#else
+        for (int ch=0;  ch<4;  ch++) {
+            float c[4];
+            for (int i=0;  i<4;  i++)
+                c[i] = format == CpuRGBA32F ? floats[4*t[i] + ch] : bytes[4*t[i] + ch]/255.0f;
+            float top = c[0] + fx[k]*(c[1] - c[0]), bottom = c[2] + fx[k]*(c[3] - c[2]);
+            out[4*k + ch] = top + fy[k]*(bottom - top); }
+#endif
+    }
+}
+
+// Four trilinear samples:  bilinear at the level below each lod, and
+// blended with the one above where lod falls between them.
+void CpuImage::Sample4(const float* u, const float* v, const float* lod, float* out) const
+{
+    int lo[4], hi[4];
+    float t[4];
+    bool blend = false;
+    for (int k=0;  k<4;  k++) {
+        float l = std::min(std::max(lod[k], 0.0f), (float)(levels-1));
+        lo[k] = (int)l;
+        hi[k] = std::min(lo[k] + 1, levels-1);
+        t[k] = l - lo[k];
+        blend = blend || t[k] > 0.0f; }
+
+    Bilinear4(u, v, lo, out);
+    if (!blend) return;
+    float upper[16];
+    Bilinear4(u, v, hi, upper);
+    for (int k=0;  k<4;  k++)
+        for (int c=0;  c<4;  c++)
+            out[4*k+c] += t[k]*(upper[4*k+c] - out[4*k+c]);
+}
+
+// Samples at lod[i], or at fixed if lod is NULL.
+void CpuImage::SampleAll(const glm::vec2* uv, const float* lod, const float fixed,
+                         const size_t count, glm::vec4* out) const
+{
+    // Runs of four, the last padded with copies of the final coordinate
+    auto run = [&](int begin, int end) {
+        for (size_t i=(size_t)begin*4;  i<std::min(count, (size_t)end*4);  i+=4) {
+            float u[4], v[4], l[4], rgba[16];
+            for (int k=0;  k<4;  k++) {
+                size_t j = std::min(i+k, count-1);
+                u[k] = uv[j].x;
+                v[k] = uv[j].y;
+                l[k] = lod ? lod[j] : fixed; }
+            Sample4(u, v, l, rgba);
+            for (int k=0;  k<4 && i+k<count;  k++)
+                out[i+k] = glm::vec4(rgba[4*k], rgba[4*k+1], rgba[4*k+2], rgba[4*k+3]); } };
+
+    int runs = (int)((count + 3)/4);
+    if (count >= parallelCount) Workers().ParallelFor(runs, run, 256);
+    else run(0, runs);
+}
+
+void CpuImage::Sample(const glm::vec2* uv, const size_t count, glm::vec4* out,
+                      const float lod) const
+{
+    SampleAll(uv, NULL, lod, count, out);
+}
+
+void CpuImage::Sample(const glm::vec2* uv, const float* lod, const size_t count,
+                      glm::vec4* out) const
+{
+    SampleAll(uv, lod, 0.0f, count, out);
+}
+
+glm::vec4 CpuImage::Texel(const glm::vec2& uv, const float lod) const
+{
+    glm::vec4 out;
+    SampleAll(&uv, NULL, lod, 1, &out);
+    return out;
+}
+
+CpuImage* ReadCpuImage(const std::string& path, const CpuFormat format, const bool mips)
+{
+    if (CompressedTexture* compressed = ReadCompressed(path)) {
+        CpuImage* image = new CpuImage(compressed, format, mips);
+        delete compressed;
+        return image; }
+    if (MipChain* chain = ReadMipChain(path, mipFilter)) {
+        CpuImage* image = new CpuImage(chain, format, mips);
+        delete chain;
+        return image; }
+    return NULL;
+}
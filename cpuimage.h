@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////
+// CPU-resident copies of textures, for code that needs texel values
+// (gameplay queries, CPU-side rendering) without reading them back
+// from the graphics card.  A copy is made from the texture's mip
+// chain (or compressed levels) as it's uploaded:  just the top level,
+// or every level, as bytes or floats.
+//
+// Sampling mimics the graphics card's:  coordinates repeat, (0,0) is
+// the first texel row as uploaded, and values are what a shader would
+// read (bytes over 255;  HDR textures, which are always kept as
+// floats, in linear light).  Batches are sampled four coordinates at a
+// time, in SSE2 registers where available, and large batches are
+// spread over the worker pool.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _CPUIMAGE_
+#define _CPUIMAGE_
+
+#include <stddef.h>
+#include <vector>
+#include <string>
+
+struct MipChain;
+struct CompressedTexture;
+
+enum CpuFormat
+{
+    CpuRGBA8 = 0,               // 4 bytes a texel
+    CpuRGBA32F = 1              // 16
+};
+
+class CpuImage
+{
+ public:
+    CpuFormat format;
+    int width, height, levels;
+
+    // Copies the top level of a chain (or compressed levels), or all
+    // of them if mips.
+    CpuImage(const MipChain* chain, const CpuFormat format, const bool mips);
+    CpuImage(const CompressedTexture* compressed, const CpuFormat format, const bool mips);
+
+    // Samples count coordinates bilinearly at level lod, or, between
+    // levels, trilinearly.  lod is clamped to the levels kept.
+    void Sample(const glm::vec2* uv, const size_t count, glm::vec4* out,
+                const float lod=0.0f) const;
+
+    // The same, with a lod for each coordinate.
+    void Sample(const glm::vec2* uv, const float* lod, const size_t count,
+                glm::vec4* out) const;
+
+    // One coordinate.
+    glm::vec4 Texel(const glm::vec2& uv, const float lod=0.0f) const;
+
+    size_t Bytes() const { return bytes.size() + floats.size()*sizeof(float); }
+
+ private:
+    std::vector<unsigned char> bytes;   // One of these holds every level kept
+    std::vector<float> floats;
+    size_t offset[16];          // Of each level, in texels
+
+    void Reserve(const int levelCount);
+    void Bilinear4(const float* u, const float* v, const int* level, float* out) const;
+    void Sample4(const float* u, const float* v, const float* lod, float* out) const;
+    void SampleAll(const glm::vec2* uv, const float* lod, const float fixed,
+                   const size_t count, glm::vec4* out) const;
+};
+
+// A copy of the image at path made from the levels its texture's load
+// cached (compressed, or the mip chain), or NULL if there are none.
+CpuImage* ReadCpuImage(const std::string& path, const CpuFormat format, const bool mips);
+
+#endif
@@ -0,0 +1,203 @@
+////////////////////////////////////////////////////////////////////////
+// Cube maps resampled from equirectangular images, by compute shader
+// or on the worker pool.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "cubemap.h"
+#include "shader.h"
+#include "texture.h"
+#include "cpuimage.h"
+#include "imageformat.h"
+#include "workers.h"
+
+#include <glu.h>                // For gluErrorString
+#define CHECKERROR {GLenum err = glGetError(); if (err != GL_NO_ERROR) { fprintf(stderr, "OpenGL error (at line cubemap.cpp:%d): %s\n", __LINE__, gluErrorString(err)); exit(-1);} }
+
+static const float PI = 3.14159265358979f;
+
+glm::vec3 CubeDirection(const int face, const float s, const float t)
+{
+    float sc = 2.0f*s - 1.0f, tc = 2.0f*t - 1.0f;
+    glm::vec3 d;
+    switch (face) {
+    case 0:  d = glm::vec3(1.0f, -tc, -sc);  break;
+    case 1:  d = glm::vec3(-1.0f, -tc, sc);  break;
+    case 2:  d = glm::vec3(sc, 1.0f, tc);  break;
+    case 3:  d = glm::vec3(sc, -1.0f, -tc);  break;
+    case 4:  d = glm::vec3(sc, -tc, 1.0f);  break;
+    default: d = glm::vec3(-sc, -tc, -1.0f);  break; }
+    return glm::normalize(d);
+}
+
+glm::vec2 EquirectUV(const glm::vec3& d)
+{
+    return glm::vec2(0.5f - atan2f(d.y, d.x)/(2.0f*PI),
+                     1.0f - acosf(std::min(std::max(d.z, -1.0f), 1.0f))/PI);
+}
+
+// The equirectangular level whose texels are the size of a cube
+// face's of size texels across (at the face's center, where they're
+// largest).
+static float SourceLod(const int envWidth, const int size)
+{
+    return std::max(0.0f, log2f(envWidth/(PI*size)));
+}
+
+CubeMap::CubeMap(const int _maxSize)
+    : size(0), levels(0), textureId(0), gpuBytes(0), maxSize(_maxSize), compute(false),
+      started(false), converted(false), program(NULL)
+{
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    int major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    compute = major > 4 || (major == 4 && minor >= 3);
+    if (!compute) return;
+
+    program = new ShaderProgram();
+    program->AddShader("cubeconvert.compute", GL_COMPUTE_SHADER);
+    program->LinkProgram();
+    CHECKERROR;
+}
+
+CubeMap::~CubeMap()
+{
+    if (textureId) glDeleteTextures(1, &textureId);
+}
+
+// Faces a quarter of the source's width (its texel size at the
+// equator), down to 1x1.
+void CubeMap::Size(const int envWidth)
+{
+    size = std::max(1, std::min(maxSize, envWidth/4));
+    for (levels=1;  (size >> levels) > 0;  levels++) ;
+}
+
+size_t CubeMap::LevelOffset(const int level) const
+{
+    size_t n = 0;
+    for (int l=0;  l<level;  l++)
+        n += 6*(size_t)std::max(1, size >> l)*std::max(1, size >> l);
+    return n;
+}
+
+void CubeMap::Update(const std::string& path, Texture* env)
+{
+    if (Ready() || !env) return;
+    if (converted) {
+        Upload();
+        printf("Cube map of %s (converted on the CPU)\n", path.c_str());
+        return; }
+
+    // The CPU conversion reads the mip chain the texture's load saved;
+    // the compute one samples the texture, so waits for its finest level.
+    if (started || !env->textureId || (compute && !env->Complete())) return;
+    started = true;
+    Size(env->width);
+    if (compute) {
+        ConvertGpu(env);
+        printf("Cube map of %s (%dx%d faces)\n", path.c_str(), size, size);
+        return; }
+
+    texels.resize(LevelOffset(levels));
+    Workers().Submit([this, path]() {
+        if (ConvertCpu(path)) converted = true; });
+}
+
+void CubeMap::ConvertGpu(Texture* env)
+{
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, GL_RGBA16F, size, size);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    program->Use();
+    int programId = program->programId;
+    env->Bind(0, programId, "equirect");
+    int loc = glGetUniformLocation(programId, "lod");
+    for (int l=0;  l<levels;  l++) {
+        int s = std::max(1, size >> l);
+        glUniform1f(loc, SourceLod(env->width, s));
+        glBindImageTexture(0, textureId, l, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glDispatchCompute((s+7)/8, (s+7)/8, 6);
+        gpuBytes += 6*8*(size_t)s*s; }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    env->Unbind();
+    program->Unuse();
+    CHECKERROR;
+}
+
+// The reference:  the same resampling, a row of a face at a time,
+// from a float copy of the source's mip chain.
+bool CubeMap::ConvertCpu(const std::string& path)
+{
+    CpuImage* env = ReadCpuImage(path, CpuRGBA32F, true);
+    if (!env) {
+        printf("No mip chain for %s;  it isn't converted to a cube map\n", path.c_str());
+        return false; }
+
+    for (int l=0;  l<levels;  l++) {
+        int s = std::max(1, size >> l);
+        float lod = SourceLod(env->width, s);
+        uint32_t* out = &texels[LevelOffset(l)];
+        Workers().ParallelFor(6*s, [&](int begin, int end) {
+            std::vector<glm::vec2> uv(s);
+            std::vector<glm::vec4> c(s);
+            std::vector<float> rgb(3*(size_t)s);
+            for (int r=begin;  r<end;  r++) {
+                int face = r/s, y = r%s;
+                for (int x=0;  x<s;  x++)
+                    uv[x] = EquirectUV(CubeDirection(face, (x + 0.5f)/s, (y + 0.5f)/s));
+                env->Sample(&uv[0], s, &c[0], lod);
+                for (int x=0;  x<s;  x++) {
+                    rgb[3*x] = c[x].x;  rgb[3*x+1] = c[x].y;  rgb[3*x+2] = c[x].z; }
+                EncodeR11G11B10F(&rgb[0], out + (size_t)r*s, s); } }, 16);
+    }
+    delete env;
+    return true;
+}
+
+// Makes the texture from texels, which are then freed.
+void CubeMap::Upload()
+{
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+    for (int l=0;  l<levels;  l++) {
+        int s = std::max(1, size >> l);
+        for (int f=0;  f<6;  f++)
+            glTexImage2D((GLenum)((int)GL_TEXTURE_CUBE_MAP_POSITIVE_X + f), l,
+                         (int)GL_R11F_G11F_B10F, s, s, 0, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV,
+                         &texels[LevelOffset(l) + f*(size_t)s*s]); }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels-1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    CHECKERROR;
+
+    gpuBytes = 4*texels.size();
+    std::vector<uint32_t>().swap(texels);
+}
+
+void CubeMap::Bind(const int unit, const int programId, const std::string& name) const
+{
+    glActiveTexture((gl::GLenum)((int)GL_TEXTURE0 + unit));
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+    int loc = glGetUniformLocation(programId, name.c_str());
+    glUniform1i(loc, unit);
+}
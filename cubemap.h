@@ -0,0 +1,76 @@
+////////////////////////////////////////////////////////////////////////
+// Cube maps resampled from equirectangular images.  Addressing an
+// equirectangular map takes an atan and an acos per fetch, squeezes a
+// whole row of texels into each pole, and its mip levels blur unevenly
+// (a level's texels cover ever less solid angle toward the poles).  A
+// cube map is addressed by the direction itself, spreads its texels
+// nearly evenly, and filters (seamlessly, across faces) like any 2D
+// texture.
+//
+// Each level of the cube is resampled from the equirectangular mip
+// level matching its texel size, so the chain is filtered as the
+// source's was, not rebuilt by the driver.  The conversion runs in a
+// compute shader (cubeconvert.compute) where OpenGL 4.3 is available,
+// and otherwise on the worker pool from the source's cached mip chain.
+//
+// The directions are those the shaders have always used for the
+// equirectangular maps (EquirectUV), and faces are in OpenGL's order
+// (+X, -X, +Y, -Y, +Z, -Z) and orientation (CubeDirection).
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _CUBEMAP_
+#define _CUBEMAP_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+class ShaderProgram;
+class Texture;
+
+class CubeMap
+{
+ public:
+    int size, levels;           // Texels across a face of level 0
+    unsigned int textureId;     // GL_TEXTURE_CUBE_MAP;  0 until converted
+    size_t gpuBytes;
+
+    CubeMap(const int maxSize=1024);
+    ~CubeMap();
+
+    // Converts the equirectangular image at path, once env (the same
+    // file, loaded as a texture) is wholly on the graphics card.  Call
+    // every frame until Ready;  the compute conversion finishes in the
+    // call that starts it, and the CPU one on a later call.
+    void Update(const std::string& path, Texture* env);
+
+    bool Ready() const { return textureId != 0; }
+
+    // Makes the cube available as samplerCube name (an empty one until
+    // Ready).  The sampler is set either way, so it never defaults to
+    // a unit a 2D sampler uses.
+    void Bind(const int unit, const int programId, const std::string& name) const;
+
+ private:
+    int maxSize;
+    bool compute;               // Compute shaders are available
+    bool started;
+    std::atomic<bool> converted; // By the worker:  texels are filled in
+    std::vector<uint32_t> texels; // R11F_G11F_B10F, a level's six faces at a time
+    ShaderProgram* program;
+
+    void Size(const int envWidth);
+    size_t LevelOffset(const int level) const;
+    void ConvertGpu(Texture* env);
+    bool ConvertCpu(const std::string& path);
+    void Upload();
+};
+
+// The direction through (s,t) in [0,1]^2 of face (0 to 5), and the
+// equirectangular coordinates of a direction.
+glm::vec3 CubeDirection(const int face, const float s, const float t);
+glm::vec2 EquirectUV(const glm::vec3& d);
+
+#endif
@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////
+// On-disk cache files:  naming, headers, and file stamps.
+////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "filecache.h"
+#include "mapfile.h"
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t length;
+};
+
+std::string CachePath(const std::string& name)
+{
+    static bool made = false;
+    if (!made) {
+#ifdef _WIN32
+        _mkdir("cache");
+#else
+        mkdir("cache", 0777);
+#endif
+        made = true; }
+    return "cache/" + name;
+}
+
+uint64_t Hash64(const void* data, const size_t length, uint64_t hash)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i=0;  i<length;  i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL; }
+    return hash;
+}
+
+uint64_t Hash64(const std::string& s, uint64_t hash)
+{
+    return Hash64(s.data(), s.size(), hash);
+}
+
+uint64_t HashFileStamp(const std::string& path, uint64_t hash)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return 0;
+    int64_t size = st.st_size;
+    int64_t time = st.st_mtime;
+    hash = Hash64(path, hash);
+    hash = Hash64(&size, sizeof(size), hash);
+    return Hash64(&time, sizeof(time), hash);
+}
+
+std::string HashName(const uint64_t hash)
+{
+    char buf[17];
+    sprintf(buf, "%016llx", (unsigned long long)hash);
+    return std::string(buf);
+}
+
+bool ReadCache(const std::string& path, const char magic[4], const uint32_t version,
+               std::vector<char>& payload)
+{
+    std::ifstream f(path.c_str(), std::ios_base::binary);
+    if (!f) return false;
+
+    CacheHeader h;
+    if (!f.read((char*)&h, sizeof(h))) return false;
+    if (memcmp(h.magic, magic, 4) != 0 || h.version != version) return false;
+
+    payload.resize(h.length);
+    if (h.length > 0 && !f.read(&payload[0], h.length)) return false;
+    return true;
+}
+
+bool WriteCache(const std::string& path, const char magic[4], const uint32_t version,
+                const void* payload, const size_t length)
+{
+    // Write to a temporary name and rename, so a crash part way
+    // through never leaves a truncated file under the real name.
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp.c_str(), std::ios_base::binary);
+        if (!f) return false;
+
+        CacheHeader h;
+        memcpy(h.magic, magic, 4);
+        h.version = version;
+        h.length = length;
+        f.write((const char*)&h, sizeof(h));
+        f.write((const char*)payload, length);
+        if (!f) return false;
+    }
+    remove(path.c_str());
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+CacheWriter::~CacheWriter()
+{
+    if (file) {
+        fclose(file);
+        remove((path + ".tmp").c_str()); }
+}
+
+bool CacheWriter::Open(const std::string& _path, const uint64_t _length)
+{
+    path = _path;
+    length = _length;
+    failed = false;
+    file = fopen((path + ".tmp").c_str(), "wb");
+    return file != NULL;
+}
+
+bool CacheWriter::Write(const uint64_t offset, const void* data, const size_t size)
+{
+    if (!file || failed || offset + size > length) {
+        failed = true;
+        return false; }
+    int64_t at = sizeof(CacheHeader) + offset;
+#ifdef _WIN32
+    failed = _fseeki64(file, at, SEEK_SET) != 0;
+#else
+    failed = fseeko(file, (off_t)at, SEEK_SET) != 0;
+#endif
+    failed = failed || fwrite(data, 1, size, file) != size;
+    return !failed;
+}
+
+bool CacheWriter::Close(const char magic[4], const uint32_t version)
+{
+    if (!file) return false;
+    CacheHeader h;
+    memcpy(h.magic, magic, 4);
+    h.version = version;
+    h.length = length;
+    bool ok = !failed && fseek(file, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    file = NULL;
+    std::string tmp = path + ".tmp";
+    if (!ok) {
+        remove(tmp.c_str());
+        return false; }
+    remove(path.c_str());
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+const char* MappedCache(const MappedFile& file, const char magic[4], const uint32_t version,
+                        size_t& length)
+{
+    if (!file.Valid()) return NULL;
+    return MappedCache(file.data, file.size, magic, version, length);
+}
+
+const char* MappedCache(const char* data, const size_t size, const char magic[4],
+                        const uint32_t version, size_t& length)
+{
+    if (!data || size < sizeof(CacheHeader)) return NULL;
+    CacheHeader h;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, magic, 4) != 0 || h.version != version) return NULL;
+    if (h.length > size - sizeof(h)) return NULL;
+    length = h.length;
+    return data + sizeof(h);
+}
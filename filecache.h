@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////
+// Small helpers shared by the on-disk caches of baked and processed
+// data.  Cache files live in a "cache" directory next to the
+// executable's working directory, are named by a hash of whatever
+// produced them, and start with a short header (magic + version +
+// payload length) so stale or foreign files are simply ignored.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _FILECACHE_
+#define _FILECACHE_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class MappedFile;
+
+// Returns "cache/<name>", creating the cache directory if needed.
+std::string CachePath(const std::string& name);
+
+// 64 bit FNV-1a hash; pass a previous result as hash to chain calls.
+const uint64_t HashSeed = 14695981039346656037ULL;
+uint64_t Hash64(const void* data, const size_t length, uint64_t hash=HashSeed);
+uint64_t Hash64(const std::string& s, uint64_t hash=HashSeed);
+
+// Hash of a file's size and modification time (cheap, and enough to
+// notice that a source asset changed).  Returns 0 if it doesn't exist.
+uint64_t HashFileStamp(const std::string& path, uint64_t hash=HashSeed);
+
+// Hex form of a hash, for use in cache file names.
+std::string HashName(const uint64_t hash);
+
+// Read/write a whole cache file.  ReadCache returns false if the
+// file is missing, truncated, or has the wrong magic or version.
+bool ReadCache(const std::string& path, const char magic[4], const uint32_t version,
+               std::vector<char>& payload);
+bool WriteCache(const std::string& path, const char magic[4], const uint32_t version,
+                const void* payload, const size_t length);
+
+// Writes a cache file too large to assemble in memory.  The payload
+// is written in pieces, at any offsets (within length), and Close
+// fills in the header and moves the file into place.  A writer that
+// is destroyed without Close leaves nothing behind.
+class CacheWriter
+{
+ public:
+    CacheWriter() : file(NULL) {}
+    ~CacheWriter();
+    bool Open(const std::string& path, const uint64_t length);
+    bool Write(const uint64_t offset, const void* data, const size_t size);
+    bool Close(const char magic[4], const uint32_t version);
+
+ private:
+    FILE* file;
+    std::string path;
+    uint64_t length;
+    bool failed;
+};
+
+// Validates a memory-mapped cache file's header and returns a pointer
+// to its payload (16 byte aligned within the mapping), or NULL.
+const char* MappedCache(const MappedFile& file, const char magic[4], const uint32_t version,
+                        size_t& length);
+
+// The same, for a cache file image at data (such as one stored in an
+// asset pack).
+const char* MappedCache(const char* data, const size_t size, const char magic[4],
+                        const uint32_t version, size_t& length);
+
+#endif
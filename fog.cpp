@@ -0,0 +1,242 @@
+////////////////////////////////////////////////////////////////////////
+// Froxel-based volumetric fog.  The view frustum is divided into a
+// fixed grid of froxels (frustum-aligned voxels, exponentially spaced
+// in depth).  Each frame one compute pass (foginject.compute) fills
+// every froxel with fog density (from a baked 3D noise volume and a
+// height falloff) and the light scattered toward the eye, and a
+// second (fogintegrate.compute) accumulates that front to back.  The
+// lighting pass then applies fog with a single 3D texture lookup per
+// pixel.  Local lights are binned into clusters of froxels first.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "fog.h"
+#include "shader.h"
+#include "transform.h"
+#include "noisetex.h"
+
+#include <glu.h>                // For gluErrorString
+#define CHECKERROR {GLenum err = glGetError(); if (err != GL_NO_ERROR) { fprintf(stderr, "OpenGL error (at line fog.cpp:%d): %s\n", __LINE__, gluErrorString(err)); exit(-1);} }
+
+// Froxels per cluster of the light list;  must agree with foginject.compute.
+const int clusterXY = 8, clusterZ = 4;
+
+unsigned int FroxelTexture(const int x, const int y, const int z)
+{
+    unsigned int id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_3D, id);
+    glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA16F, x, y, z);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, (int)GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, (int)GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, (int)GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    return id;
+}
+
+VolumetricFog::VolumetricFog(const int _gridX, const int _gridY, const int _gridZ,
+                             const float _nearDepth, const float _farDepth)
+    : gridX(_gridX), gridY(_gridY), gridZ(_gridZ), nearDepth(_nearDepth), farDepth(_farDepth),
+      density(0.02), heightFalloff(0.15), anisotropy(0.6),
+      albedo(0.9, 0.9, 1.0), wind(0.5, 0.2, 0.0), noisePeriod(60.0)
+{
+    noise = new NoiseTexture(3, 64, 3.0, 0.5, 1.0, 8.0);
+
+    injectId = FroxelTexture(gridX, gridY, gridZ);
+    integrateId = FroxelTexture(gridX, gridY, gridZ);
+
+    injectProgram = new ShaderProgram();
+    injectProgram->AddShader("foginject.compute", GL_COMPUTE_SHADER);
+    injectProgram->LinkProgram();
+
+    integrateProgram = new ShaderProgram();
+    integrateProgram->AddShader("fogintegrate.compute", GL_COMPUTE_SHADER);
+    integrateProgram->LinkProgram();
+
+    glGenBuffers(1, &lightBuffer);
+    glGenBuffers(1, &clusterBuffer);
+    glGenBuffers(1, &indexBuffer);
+    CHECKERROR;
+}
+
+// Lists, for each cluster of froxels, the local lights whose spheres
+// may reach it, and sends the lists (and the lights) to the injection
+// pass.  A sphere's cluster range is found from its view-space
+// bounding box:  its depth range gives the slices, and its sides,
+// projected at both ends of that range, the columns and rows.
+void VolumetricFog::BinLights(const glm::mat4& WorldView, const float rx, const float ry,
+                              const std::vector<glm::vec3>& localPositions,
+                              const std::vector<glm::vec3>& localColors,
+                              const std::vector<float>& localRadii)
+{
+    int cx = (gridX + clusterXY-1)/clusterXY, cy = (gridY + clusterXY-1)/clusterXY;
+    int cz = (gridZ + clusterZ-1)/clusterZ;
+    int n = localPositions.size();
+    float logRange = logf(farDepth/nearDepth);
+    auto slice = [&](const float d) {
+        return std::min(gridZ-1, std::max(0, (int)floorf(gridZ*logf(d/nearDepth)/logRange))); };
+    auto column = [](const float ndc, const int grid) {
+        return std::min(grid-1, std::max(0, (int)floorf(0.5f*(ndc + 1.0f)*grid))); };
+
+    // Each light's cluster box (or an empty one, for lights out of range)
+    std::vector<glm::ivec3> lo(n), hi(n);
+    std::vector<int> count(cx*cy*cz, 0);
+    std::vector<glm::vec4> lights(2*std::max(n, 1));
+    for (int i=0;  i<n;  i++) {
+        glm::vec3 v = (WorldView*glm::vec4(localPositions[i], 1.0f)).xyz();
+        float r = localRadii[i], d0 = std::max(-v.z - r, nearDepth), d1 = std::min(-v.z + r, farDepth);
+        lights[2*i] = glm::vec4(localPositions[i], r);
+        lights[2*i+1] = glm::vec4(localColors[i], 0.0f);
+        lo[i] = glm::ivec3(0);
+        hi[i] = glm::ivec3(-1);
+        if (d0 > d1) continue;
+        float x0 = std::min((v.x - r)/(rx*d0), (v.x - r)/(rx*d1));
+        float x1 = std::max((v.x + r)/(rx*d0), (v.x + r)/(rx*d1));
+        float y0 = std::min((v.y - r)/(ry*d0), (v.y - r)/(ry*d1));
+        float y1 = std::max((v.y + r)/(ry*d0), (v.y + r)/(ry*d1));
+        if (x0 > 1.0f || x1 < -1.0f || y0 > 1.0f || y1 < -1.0f) continue;
+        lo[i] = glm::ivec3(column(x0, gridX)/clusterXY, column(y0, gridY)/clusterXY, slice(d0)/clusterZ);
+        hi[i] = glm::ivec3(column(x1, gridX)/clusterXY, column(y1, gridY)/clusterXY, slice(d1)/clusterZ);
+        for (int z=lo[i].z;  z<=hi[i].z;  z++)
+            for (int y=lo[i].y;  y<=hi[i].y;  y++)
+                for (int x=lo[i].x;  x<=hi[i].x;  x++)
+                    count[(z*cy + y)*cx + x]++; }
+
+    // Each cluster's (offset, count) into one index list
+    std::vector<glm::uvec2> clusters(cx*cy*cz);
+    unsigned int total = 0;
+    for (size_t c=0;  c<clusters.size();  c++) {
+        clusters[c] = glm::uvec2(total, 0);
+        total += count[c]; }
+    std::vector<unsigned int> index(std::max(total, 1u));
+    for (int i=0;  i<n;  i++)
+        for (int z=lo[i].z;  z<=hi[i].z;  z++)
+            for (int y=lo[i].y;  y<=hi[i].y;  y++)
+                for (int x=lo[i].x;  x<=hi[i].x;  x++) {
+                    glm::uvec2& c = clusters[(z*cy + y)*cx + x];
+                    index[c.x + c.y++] = i; }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, lights.size()*sizeof(glm::vec4), &lights[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, clusterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, clusters.size()*sizeof(glm::uvec2), &clusters[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, index.size()*sizeof(unsigned int), &index[0], GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    int loc = glGetUniformLocation(injectProgram->programId, "clusterCount");
+    glUniform3i(loc, cx, cy, cz);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, lightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, clusterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indexBuffer);
+}
+
+void VolumetricFog::Compute(const glm::mat4& WorldInverse, const float rx, const float ry,
+                            const glm::vec3& eye, const glm::vec3& lightPos, const glm::vec3& Light,
+                            const std::vector<glm::vec3>& localPositions,
+                            const std::vector<glm::vec3>& localColors,
+                            const std::vector<float>& localRadii, const float time)
+{
+    int loc, programId;
+    glm::mat4 inverse = WorldInverse;
+
+    ////////////////////////////////////////////////////////////////////
+    // Injection: density and in-scattered light per froxel
+    injectProgram->Use();
+    programId = injectProgram->programId;
+
+    BinLights(glm::inverse(WorldInverse), rx, ry, localPositions, localColors, localRadii);
+
+    loc = glGetUniformLocation(programId, "WorldInverse");
+    glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(inverse));
+    loc = glGetUniformLocation(programId, "rx");
+    glUniform1f(loc, rx);
+    loc = glGetUniformLocation(programId, "ry");
+    glUniform1f(loc, ry);
+    loc = glGetUniformLocation(programId, "fogNear");
+    glUniform1f(loc, nearDepth);
+    loc = glGetUniformLocation(programId, "fogFar");
+    glUniform1f(loc, farDepth);
+    loc = glGetUniformLocation(programId, "eyePos");
+    glUniform3fv(loc, 1, &eye[0]);
+    loc = glGetUniformLocation(programId, "lightPos");
+    glUniform3fv(loc, 1, &lightPos[0]);
+    loc = glGetUniformLocation(programId, "Light");
+    glUniform3fv(loc, 1, &Light[0]);
+    loc = glGetUniformLocation(programId, "density");
+    glUniform1f(loc, density);
+    loc = glGetUniformLocation(programId, "heightFalloff");
+    glUniform1f(loc, heightFalloff);
+    loc = glGetUniformLocation(programId, "anisotropy");
+    glUniform1f(loc, anisotropy);
+    loc = glGetUniformLocation(programId, "albedo");
+    glUniform3fv(loc, 1, &albedo[0]);
+    glm::vec3 drift = time*wind;
+    loc = glGetUniformLocation(programId, "noiseOffset");
+    glUniform3fv(loc, 1, &drift[0]);
+    loc = glGetUniformLocation(programId, "noisePeriod");
+    glUniform1f(loc, noisePeriod);
+
+    noise->Bind(0, programId, "noiseVolume");
+
+    loc = glGetUniformLocation(programId, "dst");
+    glBindImageTexture(0, injectId, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glUniform1i(loc, 0);
+
+    glDispatchCompute((gridX+7)/8, (gridY+7)/8, gridZ);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    noise->Unbind();
+    injectProgram->Unuse();
+    CHECKERROR;
+
+    ////////////////////////////////////////////////////////////////////
+    // Integration: front-to-back accumulation along each froxel column
+    integrateProgram->Use();
+    programId = integrateProgram->programId;
+
+    loc = glGetUniformLocation(programId, "rx");
+    glUniform1f(loc, rx);
+    loc = glGetUniformLocation(programId, "ry");
+    glUniform1f(loc, ry);
+    loc = glGetUniformLocation(programId, "fogNear");
+    glUniform1f(loc, nearDepth);
+    loc = glGetUniformLocation(programId, "fogFar");
+    glUniform1f(loc, farDepth);
+
+    loc = glGetUniformLocation(programId, "src");
+    glBindImageTexture(0, injectId, 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA16F);
+    glUniform1i(loc, 0);
+    loc = glGetUniformLocation(programId, "dst");
+    glBindImageTexture(1, integrateId, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glUniform1i(loc, 1);
+
+    glDispatchCompute((gridX+7)/8, (gridY+7)/8, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    integrateProgram->Unuse();
+    CHECKERROR;
+}
+
+void VolumetricFog::Bind(const int unit, const int programId, const std::string& name)
+{
+    glActiveTexture((gl::GLenum)((int)GL_TEXTURE0 + unit));
+    glBindTexture(GL_TEXTURE_3D, integrateId);
+    int loc = glGetUniformLocation(programId, name.c_str());
+    glUniform1i(loc, unit);
+    loc = glGetUniformLocation(programId, "fogNear");
+    glUniform1f(loc, nearDepth);
+    loc = glGetUniformLocation(programId, "fogFar");
+    glUniform1f(loc, farDepth);
+}
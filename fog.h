@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////
+// Froxel-based volumetric fog.  The view frustum is divided into a
+// fixed grid of froxels (frustum-aligned voxels, exponentially spaced
+// in depth).  Each frame one compute pass (foginject.compute) fills
+// every froxel with fog density (from a baked 3D noise volume and a
+// height falloff) and the light scattered toward the eye, and a
+// second (fogintegrate.compute) accumulates that front to back.  The
+// lighting pass then applies fog with a single 3D texture lookup per
+// pixel, so the cost does not depend on the screen size.
+//
+// Local lights reach the injection pass through a clustered light
+// list, built on the CPU once per frame:  the grid is split into
+// clusters of 8x8x4 froxels, each listing the lights whose spheres
+// overlap it, so a froxel evaluates only the lights near it, however
+// many the scene has.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _FOG_
+#define _FOG_
+
+#include <string>
+#include <vector>
+
+class ShaderProgram;
+class NoiseTexture;
+
+class VolumetricFog
+{
+ public:
+    int gridX, gridY, gridZ;    // Froxel counts across, up, and in depth
+    float nearDepth, farDepth;  // View-space depth covered by the grid
+    float density;              // Extinction per world unit at height 0
+    float heightFalloff;        // Exponential density falloff with height
+    float anisotropy;           // Henyey-Greenstein g (0: isotropic, >0: forward)
+    glm::vec3 albedo;           // Scattering color
+    glm::vec3 wind;             // Noise drift per second
+    NoiseTexture* noise;        // Baked 3D noise modulating the density
+    float noisePeriod;          // World units covered by one noise tile
+
+    unsigned int injectId, integrateId; // 3D textures (RGBA16F)
+
+    VolumetricFog(const int gridX=160, const int gridY=90, const int gridZ=64,
+                  const float nearDepth=0.5, const float farDepth=300.0);
+
+    // Runs the injection and integration passes for the current view.
+    // Light positions/colors/radii are the scene's local lights (any
+    // number of them).
+    void Compute(const glm::mat4& WorldInverse, const float rx, const float ry,
+                 const glm::vec3& eye, const glm::vec3& lightPos, const glm::vec3& Light,
+                 const std::vector<glm::vec3>& localPositions,
+                 const std::vector<glm::vec3>& localColors,
+                 const std::vector<float>& localRadii, const float time);
+
+    // Makes the integrated volume (and its depth mapping) available to
+    // a shader as sampler3D name, with uniforms fogNear and fogFar.
+    void Bind(const int unit, const int programId, const std::string& name);
+
+ private:
+    ShaderProgram* injectProgram;
+    ShaderProgram* integrateProgram;
+    unsigned int lightBuffer, clusterBuffer, indexBuffer; // The clustered light list
+
+    void BinLights(const glm::mat4& WorldView, const float rx, const float ry,
+                   const std::vector<glm::vec3>& localPositions,
+                   const std::vector<glm::vec3>& localColors,
+                   const std::vector<float>& localRadii);
+};
+
+#endif
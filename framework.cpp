@@ -4,6 +4,7 @@
 ////////////////////////////////////////////////////////////////////////
 
 #include "framework.h"
+#include "stb_image.h"
 
 Scene scene;
 
@@ -18,6 +19,10 @@ int main(int argc, char** argv)
 {
     glfwSetErrorCallback(error_callback);
 
+    // Images load bottom row first, as OpenGL expects.  The setting is
+    // global to stb_image, so it is made once, before any loader runs.
+    stbi_set_flip_vertically_on_load(true);
+
     // Initialize the OpenGL bindings
     glbinding::Binding::initialize(false);
 
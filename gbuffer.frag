@@ -19,12 +19,16 @@ const int     teapotId	= 9;
 const int     spheresId	= 10;
 const int     floorId	= 11;
 const int     otherId	= 12;
+const int     scatterId	= 13;
+const int     pointsId	= 14;
 
 in vec3 normalVec, lightVec, eyeVec, tanVec;
+in vec3 colorVec;
 in vec2 texCoord;
 in vec4 worldPos;
 
 uniform int objectId, useTexture, useNormal;
+uniform int normalXY;           // The normal map is BC5:  X and Y only
 
 uniform vec3 diffuse; // Kd
 uniform vec3 specular; // Ks
@@ -34,6 +38,32 @@ uniform vec3 Light; // Ii
 uniform vec3 Ambient; // Ia
 
 uniform sampler2D shadowMap, texMap, normalMap;
+uniform sampler2D noiseMap;     // Baked tileable noise in (-1,1), see noisetex.cpp
+
+// The sky as a cube map (see cubemap.h), once useSkyMap is set;  until
+// then the sky and the sea's reflection read the equirectangular texMap.
+uniform samplerCube skyMap;
+uniform int useSkyMap;
+
+// Textures kept in texture arrays (see texarray.h):  a layer of -1
+// means the object's own texMap or normalMap instead.
+uniform sampler2DArray texArray, normalArray;
+uniform int texLayer, normalLayer;
+uniform vec2 texScale, normalScale;     // Of the layer the image covers
+
+// The wrapped coordinates are scaled into the part of the layer the
+// image covers, sampled with the gradients of the unwrapped ones.
+vec4 ArrayTexel(sampler2DArray a, int layer, vec2 scale, vec2 uv) {
+    return textureGrad(a, vec3(fract(uv)*scale, layer), dFdx(uv)*scale, dFdy(uv)*scale);
+}
+
+vec4 TexMap(vec2 uv) {
+    return texLayer < 0 ? texture(texMap, uv) : ArrayTexel(texArray, texLayer, texScale, uv);
+}
+
+vec4 NormalMap(vec2 uv) {
+    return normalLayer < 0 ? texture(normalMap, uv) : ArrayTexel(normalArray, normalLayer, normalScale, uv);
+}
 
 void main() {
     bool debug = false;
@@ -58,17 +88,22 @@ void main() {
 
         if (uT != 0) {
             if (objectId == floorId) {
-                Kd = texture(texMap, fract(5.0*texCoord)).xyz;
+                Kd = TexMap(fract(5.0*texCoord)).xyz;
             }
             else if (objectId == roomId) {
-                Kd = texture(texMap, fract(20.0*texCoord.yx)).xyz;
+                Kd = TexMap(fract(20.0*texCoord.yx)).xyz;
             }
             else if (objectId == groundId) {
-                Kd = texture(texMap, fract(50.0*texCoord)).xyz;
+                Kd = TexMap(fract(50.0*texCoord)).xyz;
+                Kd *= 1.0 + 0.2*texture(noiseMap, worldPos.xy/64.0).r;
             }
             else if (objectId == skyId) {
-                vec2 uv = vec2(-atan(V.y, V.x)/(2*PI), acos(V.z)/PI);
-                Kd = texture(texMap, uv).xyz;
+                if (useSkyMap != 0)
+                    Kd = texture(skyMap, -V).xyz;
+                else {
+                    vec2 uv = vec2(-atan(V.y, V.x)/(2*PI), acos(V.z)/PI);
+                    Kd = TexMap(uv).xyz;
+                }
                 a = -1;
             }
             else if (objectId == rPicId) {
@@ -76,11 +111,11 @@ void main() {
                     Kd = vec3(0.6, 0.6, 0.6);
                 }
                 else {
-                    Kd = texture(texMap, fract((texCoord * 1.2) - vec2(0.1, 0.1))).xyz;
+                    Kd = TexMap(fract((texCoord * 1.2) - vec2(0.1, 0.1))).xyz;
                 }
             }
             else {
-                Kd = texture(texMap, texCoord).xyz;
+                Kd = TexMap(texCoord).xyz;
             }
         }
 
@@ -94,19 +129,22 @@ void main() {
         }
 
         if (uN != 0) {
-            vec3 delta = texture(normalMap, texCoord).xyz;
+            vec3 delta = NormalMap(texCoord).xyz;
 
             if (objectId == floorId) {
-                delta = texture(normalMap, fract(5.0*texCoord)).xyz;
+                delta = NormalMap(fract(5.0*texCoord)).xyz;
             }
             else if (objectId == roomId) {
-                delta = texture(normalMap, fract(20.0*texCoord.yx)).xyz;
+                delta = NormalMap(fract(20.0*texCoord.yx)).xyz;
             }
             else if (objectId == seaId) {
-                delta = texture(normalMap, fract(50.0*texCoord)).xyz;
+                delta = NormalMap(fract(50.0*texCoord)).xyz;
             }
 
             delta = delta * 2.0 - vec3(1.0, 1.0, 1.0);
+            // BC5 normal maps store only X and Y;  rebuild Z from them.
+            if (normalXY != 0)
+                delta.z = sqrt(max(0.0, 1.0 - dot(delta.xy, delta.xy)));
 
             vec3 T = normalize(tanVec);
             vec3 B = normalize(cross(T,N));
@@ -116,12 +154,24 @@ void main() {
 
         if (objectId == seaId) {
             vec3 R = -(2 * dot(V, N) * N - V);
-            vec2 uv = vec2(-atan(R.y, R.x)/(2*PI), acos(R.z)/PI);
-            Kd = texture(texMap, uv).xyz;
+            if (useSkyMap != 0)
+                Kd = texture(skyMap, -R).xyz;
+            else {
+                vec2 uv = vec2(-atan(R.y, R.x)/(2*PI), acos(R.z)/PI);
+                Kd = TexMap(uv).xyz;
+            }
+        }
+
+        // Scanned points carry their own color, and face the eye when
+        // the scan has no normals.
+        vec3 Nout = normalVec;
+        if (objectId == pointsId) {
+            Kd = colorVec;
+            if (dot(Nout, Nout) < 1e-8) Nout = eyeVec;
         }
 
         gl_FragData[0].xyz = worldPos.xyz;
-        gl_FragData[1].xyz = normalVec.xyz;
+        gl_FragData[1].xyz = Nout.xyz;
         gl_FragData[2].rgb = Kd.rgb;
         gl_FragData[3].rgb = Ks.rgb;
         gl_FragData[3].w = a;
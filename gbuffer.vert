@@ -12,21 +12,35 @@ in vec4 vertex;
 in vec3 vertexNormal, vertexTangent;
 in vec2 vertexTexture;
 
+// Per-instance placement for instanced scatter draws (see scatter.cpp).
+// When these attributes are not enabled they read as (0,0,0,1), which
+// leaves the vertex unchanged.
+in vec4 instanceOffset;         // xyz translation, w scale
+in vec4 instanceSpin;           // x rotation about Z
+
+// Per-vertex color, used by point clouds (see pointcloud.cpp).
+in vec3 vertexColor;
 
 out vec3 normalVec, lightVec, eyeVec, tanVec;
+out vec3 colorVec;
 out vec2 texCoord;
 out vec4 shadowCoord, worldPos;
 
 void main()
 {      
-    gl_Position = WorldProj*WorldView*ModelTr*vertex;
+    float c = cos(instanceSpin.x), s = sin(instanceSpin.x);
+    mat3 spin = mat3(c, s, 0, -s, c, 0, 0, 0, 1);
+    vec4 P = vec4(instanceOffset.xyz + instanceOffset.w*(spin*vertex.xyz), vertex.w);
+
+    gl_Position = WorldProj*WorldView*ModelTr*P;
     
-    worldPos.xyz = (ModelTr*vertex).xyz;
+    worldPos.xyz = (ModelTr*P).xyz;
 
-    normalVec = vertexNormal*mat3(NormalTr);
+    normalVec = (spin*vertexNormal)*mat3(NormalTr);
     lightVec = lightPos - worldPos.xyz;
     eyeVec = eyePos - worldPos.xyz;
 
     texCoord = vertexTexture;
-    tanVec = mat3(ModelTr) * vertexTangent;
+    colorVec = vertexColor;
+    tanVec = mat3(ModelTr) * (spin*vertexTangent);
 }
@@ -0,0 +1,391 @@
+////////////////////////////////////////////////////////////////////////
+// glTF 2.0 loading.  LoadGltf reads a .glb (or a .gltf with external
+// .bin buffers) and returns an Object hierarchy mirroring the file's
+// node tree:  one Object per node, carrying the node's transformation,
+// with one child Object per mesh primitive, carrying its material.
+//
+// Vertex and index data are never unpacked.  Each buffer view is sent
+// to the graphics card straight from the memory-mapped file, and each
+// accessor becomes a vertex attribute pointer (offset, stride, and
+// component type) into it.
+////////////////////////////////////////////////////////////////////////
+
+#include <map>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "framework.h"
+#include "gltf.h"
+#include "object.h"
+#include "texture.h"
+#include "transform.h"
+#include "json.h"
+#include "mapfile.h"
+
+#include <glu.h>                // For gluErrorString
+#define CHECKERROR {GLenum err = glGetError(); if (err != GL_NO_ERROR) { fprintf(stderr, "OpenGL error (at line gltf.cpp:%d): %s\n", __LINE__, gluErrorString(err)); exit(-1);} }
+
+void GltfPrimitive::DrawVAO()
+{
+    CHECKERROR;
+    glBindVertexArray(vaoID);
+    if (indexType)
+        glDrawElements((GLenum)mode, elementCount, (GLenum)indexType, (void*)indexOffset);
+    else
+        glDrawArrays((GLenum)mode, 0, elementCount);
+    glBindVertexArray(0);
+    CHECKERROR;
+}
+
+static int Components(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    return 0;
+}
+
+static int ComponentSize(const int componentType)
+{
+    switch (componentType) {
+    case 5120: case 5121: return 1;     // BYTE, UNSIGNED_BYTE
+    case 5122: case 5123: return 2;     // SHORT, UNSIGNED_SHORT
+    case 5125: case 5126: return 4;     // UNSIGNED_INT, FLOAT
+    default: return 0; }
+}
+
+// Everything needed while one file is being turned into Objects.
+struct GltfLoader
+{
+    JsonValue doc;
+    std::string dir;                        // For resolving relative URIs
+    int objectId;
+    std::vector<MappedFile*> files;         // Kept mapped until loading ends
+    std::vector<const char*> buffers;       // Start of each glTF buffer
+    std::vector<size_t> bufferLengths;
+    std::map<int, unsigned int> viewBuffers;    // bufferView -> GL buffer
+    std::map<int, Texture*> images;             // image -> texture
+    std::map<int, std::vector<std::pair<GltfPrimitive*, int> > > meshes; // mesh -> (primitive, material)
+
+    ~GltfLoader() {
+        for (size_t i=0;  i<files.size();  i++) delete files[i]; }
+
+    const char* MapFile(const std::string& path, size_t& length) {
+        MappedFile* file = new MappedFile(path);
+        files.push_back(file);
+        length = file->size;
+        if (!file->Valid()) printf("glTF: can't read %s\n", path.c_str());
+        return file->data; }
+
+    bool Open(const std::string& path);
+    const char* ViewData(const int view, size_t& length);
+    unsigned int ViewBuffer(const int view, const GLenum target);
+    bool Attribute(const int slot, const int accessor);
+    GltfPrimitive* Primitive(const JsonValue& primitive);
+    Texture* TextureOf(const JsonValue& textureInfo);
+    void Material(Object* object, const int material);
+    glm::mat4 NodeMatrix(const JsonValue& node);
+    Object* Node(const int node, const int depth);
+};
+
+// Maps the file and finds the JSON document and the buffers.  A .glb
+// is a 12 byte header followed by a JSON chunk and an optional binary
+// chunk, which is buffer 0.  Other buffers are external files.
+bool GltfLoader::Open(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    dir = slash == std::string::npos ? "" : path.substr(0, slash+1);
+
+    size_t length;
+    const char* data = MapFile(path, length);
+    if (!data) return false;
+
+    const char* binChunk = NULL;
+    size_t binLength = 0;
+    if (length >= 12 && memcmp(data, "glTF", 4) == 0) {
+        uint32_t header[3];
+        memcpy(header, data, 12);
+        if (header[1] != 2) { printf("glTF: %s is version %u, not 2\n", path.c_str(), header[1]);  return false; }
+        size_t end = std::min<size_t>(header[2], length);
+        bool haveJson = false;
+        for (size_t p=12;  p+8 <= end;  ) {
+            uint32_t chunk[2];
+            memcpy(chunk, data+p, 8);
+            if (chunk[0] > end - p - 8) return false;
+            if (chunk[1] == 0x4E4F534A && !haveJson) {           // "JSON"
+                if (!doc.Parse(data+p+8, chunk[0])) return false;
+                haveJson = true; }
+            else if (chunk[1] == 0x004E4942 && !binChunk) {      // "BIN\0"
+                binChunk = data+p+8;
+                binLength = chunk[0]; }
+            p += 8 + ((chunk[0] + 3) & ~3u); }
+        if (!haveJson) return false; }
+    else if (!doc.Parse(data, length))
+        return false;
+
+    const JsonValue& list = doc["buffers"];
+    for (size_t b=0;  b<list.Size();  b++) {
+        const JsonValue& buffer = list[b];
+        const char* p = NULL;
+        size_t n = 0;
+        if (!buffer.Has("uri")) {
+            p = binChunk;
+            n = binLength; }
+        else if (buffer["uri"].Str().compare(0, 5, "data:") == 0)
+            printf("glTF: embedded data URIs are not supported (buffer %d)\n", (int)b);
+        else
+            p = MapFile(dir + buffer["uri"].Str(), n);
+        size_t declared = (size_t)buffer["byteLength"].Num();
+        buffers.push_back(p);
+        bufferLengths.push_back(p ? std::min(n, declared) : 0); }
+    return true;
+}
+
+// Returns the bytes of a buffer view (within the mapped file).
+const char* GltfLoader::ViewData(const int view, size_t& length)
+{
+    const JsonValue& v = doc["bufferViews"][view];
+    int buffer = v["buffer"].Int(-1);
+    size_t offset = (size_t)v["byteOffset"].Num();
+    length = (size_t)v["byteLength"].Num();
+    if (buffer < 0 || buffer >= (int)buffers.size() || !buffers[buffer]) return NULL;
+    if (offset > bufferLengths[buffer] || length > bufferLengths[buffer] - offset) return NULL;
+    return buffers[buffer] + offset;
+}
+
+// Sends a buffer view to the graphics card, once, straight from the
+// mapping, and binds it to target.
+unsigned int GltfLoader::ViewBuffer(const int view, const GLenum target)
+{
+    std::map<int, unsigned int>::iterator found = viewBuffers.find(view);
+    if (found != viewBuffers.end()) {
+        glBindBuffer(target, found->second);
+        return found->second; }
+
+    size_t length;
+    const char* data = ViewData(view, length);
+    if (!data) return 0;
+    unsigned int id;
+    glGenBuffers(1, &id);
+    glBindBuffer(target, id);
+    glBufferData(target, length, data, GL_STATIC_DRAW);
+    viewBuffers[view] = id;
+    return id;
+}
+
+// Points vertex attribute slot (of the bound vertex array) at an
+// accessor's data.  Any layout glTF allows is one GL can read
+// directly, so there's no conversion.
+bool GltfLoader::Attribute(const int slot, const int accessor)
+{
+    const JsonValue& a = doc["accessors"][accessor];
+    int components = Components(a["type"].Str());
+    int componentType = a["componentType"].Int();
+    int size = ComponentSize(componentType)*components;
+    int view = a["bufferView"].Int(-1);
+    size_t count = (size_t)a["count"].Num();
+    if (view < 0 || size == 0 || count == 0) return false;
+    if (a.Has("sparse"))
+        printf("glTF: sparse accessor %d drawn without its substitutions\n", accessor);
+
+    size_t length;
+    if (!ViewData(view, length)) return false;
+    int stride = doc["bufferViews"][view]["byteStride"].Int(0);
+    size_t offset = (size_t)a["byteOffset"].Num();
+    if (offset + (count-1)*(stride ? stride : size) + size > length) return false;
+
+    if (!ViewBuffer(view, GL_ARRAY_BUFFER)) return false;
+    glEnableVertexAttribArray(slot);
+    glVertexAttribPointer(slot, components, (GLenum)componentType,
+                          a["normalized"].Boolean() ? GL_TRUE : GL_FALSE, stride, (void*)offset);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+GltfPrimitive* GltfLoader::Primitive(const JsonValue& primitive)
+{
+    const JsonValue& attributes = primitive["attributes"];
+    int position = attributes["POSITION"].Int(-1);
+    if (position < 0) return NULL;
+
+    GltfPrimitive* shape = new GltfPrimitive();
+    shape->mode = primitive["mode"].Int(4);
+    shape->modelTr = glm::mat4();
+
+    glGenVertexArrays(1, &shape->vaoID);
+    glBindVertexArray(shape->vaoID);
+    bool ok = Attribute(0, position);
+    if (attributes.Has("NORMAL"))     Attribute(1, attributes["NORMAL"].Int());
+    if (attributes.Has("TEXCOORD_0")) Attribute(2, attributes["TEXCOORD_0"].Int());
+    if (attributes.Has("TANGENT"))    Attribute(3, attributes["TANGENT"].Int());
+
+    const JsonValue& p = doc["accessors"][position];
+    shape->elementCount = p["count"].Int();
+    if (primitive.Has("indices")) {
+        const JsonValue& a = doc["accessors"][primitive["indices"].Int()];
+        int view = a["bufferView"].Int(-1);
+        size_t length;
+        shape->indexType = a["componentType"].Int();
+        shape->indexOffset = (size_t)a["byteOffset"].Num();
+        shape->elementCount = a["count"].Int();
+        ok = ok && view >= 0 && ViewData(view, length)
+            && shape->indexOffset + shape->elementCount*ComponentSize(shape->indexType) <= length
+            && ViewBuffer(view, GL_ELEMENT_ARRAY_BUFFER); }
+    glBindVertexArray(0);
+    CHECKERROR;
+
+    if (!ok) {
+        printf("glTF: skipping a primitive with unreadable data\n");
+        delete shape;
+        return NULL; }
+    shape->count = shape->elementCount/3;
+
+    // Bounds come from the accessor (min and max are required on POSITION).
+    for (int c=0;  c<3;  c++) {
+        shape->minP[c] = p["min"][c].Num();
+        shape->maxP[c] = p["max"][c].Num(); }
+    shape->center = (shape->minP + shape->maxP)/2.0f;
+    shape->size = 0.0f;
+    for (int c=0;  c<3;  c++)
+        shape->size = std::max(shape->size, (shape->maxP[c] - shape->minP[c])/2.0f);
+    return shape;
+}
+
+Texture* GltfLoader::TextureOf(const JsonValue& textureInfo)
+{
+    int image = doc["textures"][textureInfo["index"].Int(-1)]["source"].Int(-1);
+    const JsonValue& im = doc["images"][image];
+    if (im.IsNull()) return NULL;
+    if (images.count(image)) return images[image];
+
+    const char* data = NULL;
+    size_t length = 0;
+    std::string name = im["name"].Str();
+    if (im.Has("bufferView"))
+        data = ViewData(im["bufferView"].Int(), length);
+    else if (im.Has("uri") && im["uri"].Str().compare(0, 5, "data:") != 0) {
+        name = dir + im["uri"].Str();
+        data = MapFile(name, length); }
+
+    Texture* texture = data ? new Texture((const unsigned char*)data, (int)length, name, false) : NULL;
+    images[image] = texture;
+    return texture;
+}
+
+// Maps a metallic-roughness material onto the framework's Phong-style
+// parameters:  metals lose their diffuse color and tint the specular;
+// roughness (squared, as GGX uses it) becomes an equivalent exponent.
+void GltfLoader::Material(Object* object, const int material)
+{
+    const JsonValue& m = doc["materials"][material];
+    const JsonValue& pbr = m["pbrMetallicRoughness"];
+    const JsonValue& factor = pbr["baseColorFactor"];
+    glm::vec3 base(factor[0].Num(1.0), factor[1].Num(1.0), factor[2].Num(1.0));
+    float metal = pbr["metallicFactor"].Num(m.IsNull() ? 0.0 : 1.0);
+    float rough = pbr["roughnessFactor"].Num(m.IsNull() ? 0.5 : 1.0);
+
+    object->diffuseColor = base*(1.0f - metal);
+    object->specularColor = glm::vec3(0.04f)*(1.0f - metal) + base*metal;
+    float alpha = std::max(rough*rough, 0.02f);
+    object->shininess = std::max(2.0f/(alpha*alpha) - 2.0f, 1.0f);
+
+    if (pbr.Has("baseColorTexture"))
+        object->objTexture = TextureOf(pbr["baseColorTexture"]);
+    if (m.Has("normalTexture"))
+        object->normalTexture = TextureOf(m["normalTexture"]);
+}
+
+glm::mat4 GltfLoader::NodeMatrix(const JsonValue& node)
+{
+    glm::mat4 M;
+    const JsonValue& matrix = node["matrix"];
+    if (matrix.Size() == 16) {
+        for (int c=0;  c<4;  c++)
+            for (int r=0;  r<4;  r++)
+                M[c][r] = matrix[4*c+r].Num();
+        return M; }
+
+    const JsonValue& t = node["translation"];
+    const JsonValue& q = node["rotation"];
+    const JsonValue& s = node["scale"];
+    float x = q[0].Num(0.0), y = q[1].Num(0.0), z = q[2].Num(0.0), w = q[3].Num(1.0);
+    glm::mat4 R;
+    R[0][0] = 1-2*(y*y+z*z);  R[0][1] = 2*(x*y+w*z);    R[0][2] = 2*(x*z-w*y);
+    R[1][0] = 2*(x*y-w*z);    R[1][1] = 1-2*(x*x+z*z);  R[1][2] = 2*(y*z+w*x);
+    R[2][0] = 2*(x*z+w*y);    R[2][1] = 2*(y*z-w*x);    R[2][2] = 1-2*(x*x+y*y);
+    return Translate(t[0].Num(0.0), t[1].Num(0.0), t[2].Num(0.0)) * R
+        * Scale(s[0].Num(1.0), s[1].Num(1.0), s[2].Num(1.0));
+}
+
+// One Object per node;  its mesh's primitives (created once per mesh,
+// however many nodes use it) become children with their materials.
+Object* GltfLoader::Node(const int node, const int depth)
+{
+    const JsonValue& n = doc["nodes"][node];
+    Object* object = new Object(NULL, objectId);
+    if (depth > 64) return object;
+
+    int mesh = n["mesh"].Int(-1);
+    if (mesh >= 0) {
+        if (!meshes.count(mesh)) {
+            const JsonValue& primitives = doc["meshes"][mesh]["primitives"];
+            std::vector<std::pair<GltfPrimitive*, int> >& list = meshes[mesh];
+            for (size_t i=0;  i<primitives.Size();  i++) {
+                GltfPrimitive* shape = Primitive(primitives[i]);
+                if (shape)
+                    list.push_back(std::make_pair(shape, primitives[i]["material"].Int(-1))); } }
+        std::vector<std::pair<GltfPrimitive*, int> >& list = meshes[mesh];
+        for (size_t i=0;  i<list.size();  i++) {
+            Object* part = new Object(list[i].first, objectId);
+            Material(part, list[i].second);
+            object->add(part); } }
+
+    const JsonValue& children = n["children"];
+    for (size_t i=0;  i<children.Size();  i++) {
+        int child = children[i].Int();
+        object->add(Node(child, depth+1), NodeMatrix(doc["nodes"][child])); }
+    return object;
+}
+
+Object* LoadGltf(const std::string& path, const int objectId)
+{
+    GltfLoader loader;
+    loader.objectId = objectId;
+    if (!loader.Open(path)) {
+        printf("glTF: can't load %s\n", path.c_str());
+        return NULL; }
+
+    // The default scene's root nodes, or every parentless node if
+    // the file has no scenes.
+    std::vector<int> roots;
+    const JsonValue& doc = loader.doc;
+    const JsonValue& scene = doc["scenes"][doc["scene"].Int(0)];
+    if (!scene.IsNull()) {
+        for (size_t i=0;  i<scene["nodes"].Size();  i++)
+            roots.push_back(scene["nodes"][i].Int()); }
+    else {
+        std::vector<bool> child(doc["nodes"].Size(), false);
+        for (size_t i=0;  i<child.size();  i++)
+            for (size_t c=0;  c<doc["nodes"][i]["children"].Size();  c++) {
+                size_t k = doc["nodes"][i]["children"][c].Int();
+                if (k < child.size()) child[k] = true; }
+        for (size_t i=0;  i<child.size();  i++)
+            if (!child[i]) roots.push_back(i); }
+
+    // glTF is Y up;  this framework is Z up.
+    Object* root = new Object(NULL, objectId);
+    for (size_t i=0;  i<roots.size();  i++)
+        root->add(loader.Node(roots[i], 0), Rotate(0, 90)*loader.NodeMatrix(doc["nodes"][roots[i]]));
+    return root;
+}
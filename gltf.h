@@ -0,0 +1,45 @@
+////////////////////////////////////////////////////////////////////////
+// glTF 2.0 loading.  LoadGltf reads a .glb (or a .gltf with external
+// .bin buffers) and returns an Object hierarchy mirroring the file's
+// node tree:  one Object per node, carrying the node's transformation,
+// with one child Object per mesh primitive, carrying its material.
+//
+// Vertex and index data are never unpacked.  Each buffer view is sent
+// to the graphics card straight from the memory-mapped file, and each
+// accessor becomes a vertex attribute pointer (offset, stride, and
+// component type) into it.  Attributes map onto the usual slots:
+//   POSITION -> 0,  NORMAL -> 1,  TEXCOORD_0 -> 2,  TANGENT -> 3.
+//
+// Materials (metallic-roughness) map onto the Object's diffuseColor,
+// specularColor, shininess, objTexture and normalTexture.  glTF is Y
+// up, so the returned root turns Y into this framework's Z.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _GLTF_
+#define _GLTF_
+
+#include <string>
+
+#include "shapes.h"
+
+class Object;
+
+// A single glTF mesh primitive, drawn from its own GL buffers.  The
+// CPU-side data arrays stay empty;  bounds come from the accessors.
+class GltfPrimitive: public Shape
+{
+ public:
+    unsigned int mode;          // Primitive type (GL_TRIANGLES, ...)
+    unsigned int indexType;     // GL_UNSIGNED_BYTE/SHORT/INT, or 0 if not indexed
+    size_t indexOffset;         // Byte offset of the first index in the index buffer
+    int elementCount;           // Indices (or vertices if not indexed) to draw
+
+    GltfPrimitive() : mode(4), indexType(0), indexOffset(0), elementCount(0) {}
+    virtual void DrawVAO();
+};
+
+// Returns the root of the file's default scene, or NULL on failure.
+// Every Object created gets the given objectId.
+Object* LoadGltf(const std::string& path, const int objectId);
+
+#endif
@@ -0,0 +1,405 @@
+////////////////////////////////////////////////////////////////////////
+// Split-sum specular image based lighting:  the prefiltered
+// environment and the BRDF table, baked by compute shader or on the
+// worker pool, and cached.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "iblbake.h"
+#include "cubemap.h"
+#include "shader.h"
+#include "cpuimage.h"
+#include "imageformat.h"
+#include "filecache.h"
+#include "assetpack.h"
+#include "workers.h"
+
+#include <glu.h>                // For gluErrorString
+#define CHECKERROR {GLenum err = glGetError(); if (err != GL_NO_ERROR) { fprintf(stderr, "OpenGL error (at line iblbake.cpp:%d): %s\n", __LINE__, gluErrorString(err)); exit(-1);} }
+
+static const float PI = 3.14159265358979f;
+
+static const char bakeMagic[4] = { 'E', 'N', 'V', 'P' };
+static const uint32_t bakeVersion = 2;
+
+// The table needs more samples than a prefiltered texel (its integrand
+// isn't smoothed by any texture filtering), and there are few texels.
+static const int lutSamples = 1024;   // Must agree with brdflut.compute
+
+// Roughest alpha the table treats as a mirror, and the smallest
+// W.H its BRDF divides by (near the horizon of a rough lobe, where
+// W nears -V, the Phong BRDF's 1/(4 W.H^2) grows without bound).
+static const float minAlpha = 0.01f;  // These two also in brdflut.compute
+static const float minWH = 0.1f;
+
+// The head of a cache file;  the levels and then the table follow.
+struct BakeHeader
+{
+    uint32_t width, height, levels, samples, lutSize, reserved;
+    uint64_t stamp;
+};
+
+// The Phong exponent for roughness r.
+static float RoughnessExponent(const float r)
+{
+    float alpha = std::max(r*r, minAlpha);
+    return 2.0f/(alpha*alpha) - 2.0f;
+}
+
+// Sample i of n of the Phong lobe of exponent a about R, in the frame
+// (A, B, R):  its direction, and the cosine of its angle from R.  The
+// same Hammersley points, and mapping, as the lighting pass's loop.
+static glm::vec3 LobeSample(const int i, const int n, const float a, const glm::vec3& R,
+                            const glm::vec3& A, const glm::vec3& B, float& cosTheta)
+{
+    float E1 = 0.0f, p = 0.5f;
+    for (int k=i;  k;  p*=0.5f, k>>=1)
+        if (k & 1) E1 += p;
+    float E2 = (i + 0.5f)/n;
+    cosTheta = powf(E2, 1.0f/(a + 1.0f));
+    float sinTheta = sqrtf(std::max(0.0f, 1.0f - cosTheta*cosTheta));
+    float phi = 2.0f*PI*(0.5f - E1);
+    return glm::normalize(cosf(phi)*sinTheta*A + sinf(phi)*sinTheta*B + cosTheta*R);
+}
+
+// A frame about R (which the lighting pass's loop lacked at the poles).
+static void LobeFrame(const glm::vec3& R, glm::vec3& A, glm::vec3& B)
+{
+    A = fabsf(R.z) < 0.999f ? glm::normalize(glm::vec3(-R.y, R.x, 0.0f)) : glm::vec3(1, 0, 0);
+    B = glm::normalize(glm::cross(R, A));
+}
+
+SpecularIBL::SpecularIBL(const int _levels, const int _maxSize, const int _samples,
+                         const int _lutSize)
+    : size(0), levels(_levels), samples(_samples), lutSize(_lutSize),
+      prefilteredId(0), lutId(0), maxSize(_maxSize), compute(false), stamp(0),
+      started(false), baked(false), prefilterProgram(NULL), lutProgram(NULL)
+{
+    int major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    compute = major > 4 || (major == 4 && minor >= 3);
+    if (!compute) {
+        printf("No compute shaders;  specular IBL is baked on the CPU\n");
+        return; }
+
+    prefilterProgram = new ShaderProgram();
+    prefilterProgram->AddShader("iblprefilter.compute", GL_COMPUTE_SHADER);
+    prefilterProgram->LinkProgram();
+
+    lutProgram = new ShaderProgram();
+    lutProgram->AddShader("brdflut.compute", GL_COMPUTE_SHADER);
+    lutProgram->LinkProgram();
+    CHECKERROR;
+}
+
+SpecularIBL::~SpecularIBL()
+{
+    if (prefilteredId) glDeleteTextures(1, &prefilteredId);
+    if (lutId) glDeleteTextures(1, &lutId);
+}
+
+// Level 0's size for an environment cube of envSize, and the space for
+// every level and the table.
+void SpecularIBL::Size(const int envSize)
+{
+    size = std::max(1, std::min(envSize, maxSize));
+    while (levels > 1 && (size >> (levels-1)) == 0) levels--;
+    texels.resize(LevelOffset(levels));
+    table.resize(2*(size_t)lutSize*lutSize);
+}
+
+size_t SpecularIBL::LevelOffset(const int level) const
+{
+    size_t n = 0;
+    for (int l=0;  l<level;  l++)
+        n += 6*(size_t)std::max(1, size >> l)*std::max(1, size >> l);
+    return n;
+}
+
+std::string SpecularIBL::CacheName(const std::string& path) const
+{
+    uint64_t h = Hash64(PackName(path));
+    h = Hash64(&levels, sizeof(levels), h);
+    h = Hash64(&maxSize, sizeof(maxSize), h);
+    h = Hash64(&samples, sizeof(samples), h);
+    h = Hash64(&lutSize, sizeof(lutSize), h);
+    return CachePath("env" + HashName(h) + ".bin");
+}
+
+////////////////////////////////////////////////////////////////////////
+// The cache
+
+bool SpecularIBL::Load(const std::string& path)
+{
+    std::vector<char> payload;
+    if (!ReadCache(CacheName(path), bakeMagic, bakeVersion, payload)) return false;
+    BakeHeader head;
+    if (payload.size() < sizeof(head)) return false;
+    memcpy(&head, &payload[0], sizeof(head));
+    if (head.stamp != HashFileStamp(PackName(path)) || (int)head.samples != samples
+        || (int)head.lutSize != lutSize || (int)head.levels > levels || head.width == 0
+        || head.height != head.width)
+        return false;
+
+    levels = head.levels;
+    size = head.width;
+    size_t words = LevelOffset(levels), floats = 2*(size_t)lutSize*lutSize;
+    if (payload.size() != sizeof(head) + 4*words + sizeof(float)*floats) return false;
+    texels.resize(words);
+    table.resize(floats);
+    memcpy(&texels[0], &payload[sizeof(head)], 4*words);
+    memcpy(&table[0], &payload[sizeof(head) + 4*words], sizeof(float)*floats);
+    stamp = head.stamp;
+    Upload();
+    printf("Specular IBL for %s (cached)\n", path.c_str());
+    return true;
+}
+
+void SpecularIBL::Save(const std::string& name)
+{
+    BakeHeader head = { (uint32_t)size, (uint32_t)size, (uint32_t)levels, (uint32_t)samples,
+                        (uint32_t)lutSize, 0, stamp };
+    std::vector<char> payload(sizeof(head) + 4*texels.size() + sizeof(float)*table.size());
+    memcpy(&payload[0], &head, sizeof(head));
+    memcpy(&payload[sizeof(head)], &texels[0], 4*texels.size());
+    memcpy(&payload[sizeof(head) + 4*texels.size()], &table[0], sizeof(float)*table.size());
+    WriteCache(name, bakeMagic, bakeVersion, &payload[0], payload.size());
+}
+
+// Makes the textures from texels and table, which are then freed.
+void SpecularIBL::Upload()
+{
+    glGenTextures(1, &prefilteredId);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilteredId);
+    for (int l=0;  l<levels;  l++) {
+        int s = std::max(1, size >> l);
+        for (int f=0;  f<6;  f++)
+            glTexImage2D((GLenum)((int)GL_TEXTURE_CUBE_MAP_POSITIVE_X + f), l,
+                         (int)GL_R11F_G11F_B10F, s, s, 0, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV,
+                         &texels[LevelOffset(l) + f*(size_t)s*s]); }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels-1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    glGenTextures(1, &lutId);
+    glBindTexture(GL_TEXTURE_2D, lutId);
+    glTexImage2D(GL_TEXTURE_2D, 0, (int)GL_RG16F, lutSize, lutSize, 0, GL_RG, GL_FLOAT, &table[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, (int)GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, (int)GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    CHECKERROR;
+
+    std::vector<uint32_t>().swap(texels);
+    std::vector<float>().swap(table);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Baking
+
+void SpecularIBL::Update(const std::string& path, const CubeMap* env)
+{
+    if (Ready() || !env) return;
+    if (baked) {
+        Upload();
+        printf("Specular IBL for %s (baked on the CPU)\n", path.c_str());
+        return; }
+
+    // The compute bake samples the cube;  the CPU one reads the mip
+    // chain the texture's load saved, which is there by then too.
+    if (started || !env->Ready()) return;
+    started = true;
+    std::string name = CacheName(path);
+    Size(env->size);
+    stamp = HashFileStamp(PackName(path));
+    if (compute) {
+        BakeGpu(env);
+        Save(name);
+        std::vector<uint32_t>().swap(texels);
+        std::vector<float>().swap(table);
+        printf("Specular IBL for %s (baked)\n", path.c_str());
+        return; }
+
+    Workers().Submit([this, path, name]() {
+        if (!BakeCpu(path)) return;
+        Save(name);
+        baked = true; });
+}
+
+void SpecularIBL::BakeGpu(const CubeMap* env)
+{
+    int loc, programId;
+
+    ////////////////////////////////////////////////////////////////////
+    // The prefiltered levels, written as images, then read back for
+    // the cache
+    glGenTextures(1, &prefilteredId);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilteredId);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, GL_RGBA16F, size, size);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    prefilterProgram->Use();
+    programId = prefilterProgram->programId;
+    env->Bind(0, programId, "environment");
+    loc = glGetUniformLocation(programId, "envSize");
+    glUniform1f(loc, (float)env->size);
+    loc = glGetUniformLocation(programId, "samples");
+    glUniform1i(loc, samples);
+    loc = glGetUniformLocation(programId, "mirrorLod");
+    glUniform1f(loc, log2f((float)env->size/size));
+
+    for (int l=0;  l<levels;  l++) {
+        int s = std::max(1, size >> l);
+        loc = glGetUniformLocation(programId, "exponent");
+        glUniform1f(loc, l == 0 ? -1.0f : RoughnessExponent((float)l/(levels-1)));
+        glBindImageTexture(0, prefilteredId, l, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glDispatchCompute((s+7)/8, (s+7)/8, 6); }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    prefilterProgram->Unuse();
+    CHECKERROR;
+
+    ////////////////////////////////////////////////////////////////////
+    // The table
+    glGenTextures(1, &lutId);
+    glBindTexture(GL_TEXTURE_2D, lutId);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, lutSize, lutSize);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, (int)GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, (int)GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    lutProgram->Use();
+    glBindImageTexture(0, lutId, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+    glDispatchCompute((lutSize+7)/8, (lutSize+7)/8, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    lutProgram->Unuse();
+    CHECKERROR;
+
+    ////////////////////////////////////////////////////////////////////
+    // Read back, once, for the cache
+    std::vector<float> rgb(3*(size_t)size*size);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilteredId);
+    for (int l=0;  l<levels;  l++) {
+        int s = std::max(1, size >> l);
+        for (int f=0;  f<6;  f++) {
+            glGetTexImage((GLenum)((int)GL_TEXTURE_CUBE_MAP_POSITIVE_X + f), l, GL_RGB, GL_FLOAT, &rgb[0]);
+            EncodeR11G11B10F(&rgb[0], &texels[LevelOffset(l) + f*(size_t)s*s], (size_t)s*s); } }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glBindTexture(GL_TEXTURE_2D, lutId);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_FLOAT, &table[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    CHECKERROR;
+}
+
+// The same sums as the compute shaders, on the worker pool, sampling
+// a float copy of the environment's mip chain.
+bool SpecularIBL::BakeCpu(const std::string& path)
+{
+    CpuImage* env = ReadCpuImage(path, CpuRGBA32F, true);
+    if (!env) {
+        printf("No mip chain for %s;  its specular IBL isn't baked\n", path.c_str());
+        return false; }
+
+    // The lighting pass's filtered importance sampling:  each sample
+    // reads the level whose texels cover its share of the lobe.  (The
+    // mirror level reads the level as fine as its texels, as cube
+    // maps are converted.)
+    float mirrorLod = std::max(0.0f, log2f(env->width/(PI*size)));
+    float lodBase = 0.5f*log2f((float)env->width*env->height/samples);
+    for (int l=0;  l<levels;  l++) {
+        int s = std::max(1, size >> l);
+        float a = RoughnessExponent((float)l/(levels-1));
+        uint32_t* out = &texels[LevelOffset(l)];
+        Workers().ParallelFor(6*s, [&](int begin, int end) {
+            std::vector<glm::vec2> uv(std::max(s, samples));
+            std::vector<float> lod(samples), weight(samples), rgb(3*(size_t)s);
+            std::vector<glm::vec4> c(uv.size());
+            for (int r=begin;  r<end;  r++) {
+                int face = r/s, y = r%s;
+                if (l == 0) {
+                    for (int x=0;  x<s;  x++)
+                        uv[x] = EquirectUV(CubeDirection(face, (x + 0.5f)/s, (y + 0.5f)/s));
+                    env->Sample(&uv[0], s, &c[0], mirrorLod);
+                    for (int x=0;  x<s;  x++) {
+                        rgb[3*x] = c[x].x;  rgb[3*x+1] = c[x].y;  rgb[3*x+2] = c[x].z; }
+                    EncodeR11G11B10F(&rgb[0], out + (size_t)r*s, s);
+                    continue; }
+
+                for (int x=0;  x<s;  x++) {
+                    glm::vec3 R = CubeDirection(face, (x + 0.5f)/s, (y + 0.5f)/s), A, B;
+                    LobeFrame(R, A, B);
+                    for (int i=0;  i<samples;  i++) {
+                        glm::vec3 W = LobeSample(i, samples, a, R, A, B, weight[i]);
+                        float D = (a + 2.0f)/(2.0f*PI)*powf(weight[i], a);
+                        uv[i] = EquirectUV(W);
+                        lod[i] = lodBase - 0.5f*log2f(std::max(D, 1e-8f)); }
+                    env->Sample(&uv[0], &lod[0], samples, &c[0]);
+                    glm::vec3 sum(0.0f);
+                    float total = 0.0f;
+                    for (int i=0;  i<samples;  i++) {
+                        sum += weight[i]*glm::vec3(c[i]);
+                        total += weight[i]; }
+                    sum /= std::max(total, 1e-8f);
+                    rgb[3*x] = sum.x;  rgb[3*x+1] = sum.y;  rgb[3*x+2] = sum.z; }
+                EncodeR11G11B10F(&rgb[0], out + (size_t)r*s, s); } }, 4); }
+    delete env;
+
+    // The table:  with N = z and V in the xz plane, the lobe's mean
+    // of cos(theta)/(4 W.H^2), times 1-F and F of Schlick's Fresnel
+    // factor F = (1 - W.H)^5
+    Workers().ParallelFor(lutSize, [&](int begin, int end) {
+        for (int y=begin;  y<end;  y++) {
+            float a = RoughnessExponent((y + 0.5f)/lutSize);
+            for (int x=0;  x<lutSize;  x++) {
+                float VN = (x + 0.5f)/lutSize;
+                glm::vec3 V(sqrtf(1.0f - VN*VN), 0.0f, VN), R(-V.x, 0.0f, VN), A, B;
+                LobeFrame(R, A, B);
+                float scale = 0.0f, bias = 0.0f, cosTheta;
+                for (int i=0;  i<lutSamples;  i++) {
+                    glm::vec3 W = LobeSample(i, lutSamples, a, R, A, B, cosTheta);
+                    float WH = std::max(glm::dot(W, glm::normalize(W + V)), minWH);
+                    float F = powf(1.0f - WH, 5.0f), g = cosTheta/(4.0f*WH*WH);
+                    scale += (1.0f - F)*g;
+                    bias += F*g; }
+                table[2*((size_t)y*lutSize + x)] = scale/lutSamples;
+                table[2*((size_t)y*lutSize + x) + 1] = bias/lutSamples; } } }, 4);
+    return true;
+}
+
+void SpecularIBL::Bind(const int unit, const int lutUnit, const int programId)
+{
+    int loc = glGetUniformLocation(programId, "iblLevels");
+    glUniform1i(loc, Ready() ? levels : 0);
+
+    // Set even while there's nothing to bind, so samplerCube
+    // prefilteredIBL doesn't default to a unit a 2D sampler uses
+    glActiveTexture((gl::GLenum)((int)GL_TEXTURE0 + unit));
+    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilteredId);
+    loc = glGetUniformLocation(programId, "prefilteredIBL");
+    glUniform1i(loc, unit);
+
+    glActiveTexture((gl::GLenum)((int)GL_TEXTURE0 + lutUnit));
+    glBindTexture(GL_TEXTURE_2D, lutId);
+    loc = glGetUniformLocation(programId, "brdfLUT");
+    glUniform1i(loc, lutUnit);
+}
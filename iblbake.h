@@ -0,0 +1,89 @@
+////////////////////////////////////////////////////////////////////////
+// Split-sum specular image based lighting.  The lighting pass used to
+// integrate the Phong lobe about the reflection vector with a loop of
+// Hammersley samples per pixel, each fetching from the equirectangular
+// environment at a filtered level.  That sum is split in two, each
+// baked once:
+//
+//   * The environment prefiltered by the lobe:  a cube map whose mip
+//     level k holds roughness k/(levels-1), each texel the
+//     cosine-weighted average of the lobe's samples about its
+//     direction (level 0 is a plain resample, for mirrors).
+//   * The BRDF's integral over the lobe, split into a scale and a bias
+//     of the specular color Ks, in a 2D table indexed by N.V and
+//     roughness.
+//
+// so the lighting pass does the specular in two fetches.  Roughness is
+// sqrt(alpha), with alpha = sqrt(2/(a+2)) for Phong exponent a.
+//
+// The bake runs in two compute shaders (iblprefilter.compute and
+// brdflut.compute), sampling the environment's cube map (see
+// cubemap.h), where OpenGL 4.3 is available, and otherwise on the
+// worker pool from the environment's cached mip chain.  Either
+// way, the results are saved in the file cache, keyed by the
+// environment's file stamp, and later runs just load them.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _IBLBAKE_
+#define _IBLBAKE_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+class ShaderProgram;
+class CubeMap;
+
+class SpecularIBL
+{
+ public:
+    int size;                   // Texels across a face of level 0
+    int levels;                 // Roughness steps, 0 to 1
+    int samples;                // Per texel of each prefiltered level
+    int lutSize;                // The table is lutSize x lutSize
+
+    unsigned int prefilteredId, lutId; // 0 until baked or loaded
+
+    SpecularIBL(const int levels=6, const int maxSize=256, const int samples=128,
+                const int lutSize=128);
+    ~SpecularIBL();
+
+    // Loads a bake of the environment at path from the cache, if one
+    // was saved from the file as it is now.
+    bool Load(const std::string& path);
+
+    // Bakes the environment at path, once env (its cube map) is
+    // converted.  Call every frame until Ready;  the compute bake
+    // finishes in the call that starts it, and the CPU one on a later
+    // call.
+    void Update(const std::string& path, const CubeMap* env);
+
+    bool Ready() const { return prefilteredId != 0 && lutId != 0; }
+
+    // Makes the prefiltered environment and the table available to a
+    // shader as samplerCube prefilteredIBL and brdfLUT, with their level count as
+    // iblLevels (0 while not Ready, for the shader's fallback).
+    void Bind(const int unit, const int lutUnit, const int programId);
+
+ private:
+    int maxSize;
+    bool compute;               // Compute shaders are available
+    uint64_t stamp;             // Of the environment baked
+    bool started;
+    std::atomic<bool> baked;    // By the worker:  texels and table are filled in
+    std::vector<uint32_t> texels; // Every level's faces as R11F_G11F_B10F words, finest first
+    std::vector<float> table;   // RG pairs
+    ShaderProgram* prefilterProgram;
+    ShaderProgram* lutProgram;
+
+    void Size(const int envSize);
+    size_t LevelOffset(const int level) const;
+    std::string CacheName(const std::string& path) const;
+    void BakeGpu(const CubeMap* env);
+    bool BakeCpu(const std::string& path);
+    void Save(const std::string& name);
+    void Upload();
+};
+
+#endif
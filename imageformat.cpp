@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////
+// CPU-side texel format conversions.
+////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <math.h>
+
+#include "imageformat.h"
+
+uint32_t PackUnsignedFloat(const float f, const int mantissaBits)
+{
+    if (!(f > 0.0f)) return 0;  // Negative, zero, or NaN
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    const uint32_t largest = (31u << mantissaBits) - 1; // Exponent 30, mantissa all ones
+    int exponent = (int)(bits >> 23) - 127 + 15;
+    if (exponent >= 31) return largest;
+
+    int shift = 23 - mantissaBits;
+    if (exponent > 0) {
+        // A carry out of the mantissa when rounding bumps the exponent, as it should
+        uint32_t v = ((uint32_t)exponent << 23) | (bits & 0x7fffff);
+        v = (v + (1u << (shift-1))) >> shift;
+        return v < largest ? v : largest; }
+
+    // Denormal:  shift the mantissa (with its implicit 1) further down
+    shift += 1 - exponent;
+    if (shift > 24) return 0;
+    uint32_t m = (bits & 0x7fffff) | 0x800000;
+    return (m + (1u << (shift-1))) >> shift;
+}
+
+float UnpackUnsignedFloat(const uint32_t v, const int mantissaBits)
+{
+    int exponent = v >> mantissaBits;
+    uint32_t m = v & ((1u << mantissaBits) - 1);
+    if (exponent == 0)
+        return ldexpf((float)m, -14 - mantissaBits);
+    return ldexpf((float)(m | (1u << mantissaBits)), exponent - 15 - mantissaBits);
+}
+
+void EncodeR11G11B10F(const float* rgb, uint32_t* out, const size_t count)
+{
+    // Word i is written after triple i is read, and never overlaps a
+    // later triple, so this works in place.
+    for (size_t i=0;  i<count;  i++) {
+        float r = rgb[3*i], g = rgb[3*i+1], b = rgb[3*i+2];
+        out[i] = PackUnsignedFloat(r, 6) | (PackUnsignedFloat(g, 6) << 11)
+            | (PackUnsignedFloat(b, 5) << 22); }
+}
+
+void DecodeR11G11B10F(const uint32_t* in, float* rgb, const size_t count)
+{
+    for (size_t i=0;  i<count;  i++) {
+        rgb[3*i] = UnpackUnsignedFloat(in[i] & 0x7ff, 6);
+        rgb[3*i+1] = UnpackUnsignedFloat((in[i] >> 11) & 0x7ff, 6);
+        rgb[3*i+2] = UnpackUnsignedFloat(in[i] >> 22, 5); }
+}
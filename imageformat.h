@@ -0,0 +1,36 @@
+////////////////////////////////////////////////////////////////////////
+// CPU-side texel formats, shared by the texture loader and packtool
+// (which stores images already converted).  Ordinary images are RGBA
+// bytes.  HDR images (.hdr radiance files) are kept as floats by
+// packing each texel into GL's R11F_G11F_B10F layout:  the same 4
+// bytes per texel as RGBA8, with a 5 bit exponent per channel, so the
+// full range survives and the hardware filters (and builds mipmaps)
+// in linear floating point.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _IMAGEFORMAT_
+#define _IMAGEFORMAT_
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum ImageFormat
+{
+    ImageRGBA8 = 0,             // 4 bytes, GL_RGBA / GL_UNSIGNED_BYTE
+    ImageR11G11B10F = 1         // 1 word, GL_RGB / GL_UNSIGNED_INT_10F_11F_11F_REV
+};
+
+// Packs count linear RGB float triples into R11F_G11F_B10F words.
+// Negative values and NaNs become 0, and values beyond the format's
+// range (about 65000) are clamped.  out may be the same memory as rgb,
+// which is converted in place.
+void EncodeR11G11B10F(const float* rgb, uint32_t* out, const size_t count);
+void DecodeR11G11B10F(const uint32_t* in, float* rgb, const size_t count);
+
+// Unsigned floats with a 5 bit exponent (bias 15) and mantissaBits bits
+// of mantissa:  6 or 5 for the packed format above, 10 for the bit
+// pattern of a (non-negative) half float.
+uint32_t PackUnsignedFloat(const float f, const int mantissaBits);
+float UnpackUnsignedFloat(const uint32_t v, const int mantissaBits);
+
+#endif
@@ -0,0 +1,151 @@
+////////////////////////////////////////////////////////////////////////
+// A minimal JSON reader, enough for asset descriptions such as glTF.
+// Parse builds a tree of JsonValues;  lookups of missing members or
+// out of range elements return a shared null value, so chains like
+// doc["nodes"][i]["mesh"].Int(-1) need no checks along the way.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+static const JsonValue nullValue;
+
+struct JsonParser
+{
+    const char* p;
+    const char* end;
+    int depth;
+
+    void Skip() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++; }
+
+    bool Literal(const char* word) {
+        size_t n = strlen(word);
+        if ((size_t)(end-p) < n || strncmp(p, word, n) != 0) return false;
+        p += n;
+        return true; }
+
+    static void Utf8(std::string& s, unsigned int c) {
+        if (c < 0x80) s += (char)c;
+        else if (c < 0x800) { s += (char)(0xC0 | (c>>6));  s += (char)(0x80 | (c&0x3F)); }
+        else if (c < 0x10000) { s += (char)(0xE0 | (c>>12));  s += (char)(0x80 | ((c>>6)&0x3F));
+                                s += (char)(0x80 | (c&0x3F)); }
+        else { s += (char)(0xF0 | (c>>18));  s += (char)(0x80 | ((c>>12)&0x3F));
+               s += (char)(0x80 | ((c>>6)&0x3F));  s += (char)(0x80 | (c&0x3F)); } }
+
+    bool Hex4(unsigned int& c) {
+        if (end-p < 4) return false;
+        c = 0;
+        for (int i=0;  i<4;  i++, p++) {
+            char h = *p;
+            c <<= 4;
+            if (h >= '0' && h <= '9') c |= h - '0';
+            else if (h >= 'a' && h <= 'f') c |= h - 'a' + 10;
+            else if (h >= 'A' && h <= 'F') c |= h - 'A' + 10;
+            else return false; }
+        return true; }
+
+    bool String(std::string& s) {
+        if (p == end || *p != '"') return false;
+        p++;
+        while (p < end && *p != '"') {
+            if (*p != '\\') { s += *p++;  continue; }
+            if (++p == end) return false;
+            char e = *p++;
+            switch (e) {
+            case '"': case '\\': case '/': s += e;  break;
+            case 'b': s += '\b';  break;
+            case 'f': s += '\f';  break;
+            case 'n': s += '\n';  break;
+            case 'r': s += '\r';  break;
+            case 't': s += '\t';  break;
+            case 'u': {
+                unsigned int c;
+                if (!Hex4(c)) return false;
+                if (c >= 0xD800 && c < 0xDC00 && end-p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    unsigned int low;
+                    p += 2;
+                    if (!Hex4(low)) return false;
+                    c = 0x10000 + ((c-0xD800)<<10) + (low-0xDC00); }
+                Utf8(s, c);
+                break; }
+            default: return false; } }
+        if (p == end) return false;
+        p++;
+        return true; }
+
+    bool Value(JsonValue& v) {
+        if (++depth > 256) return false;
+        Skip();
+        if (p == end) return false;
+        bool ok = true;
+        if (*p == '{') {
+            v.type = JsonValue::Object;
+            p++;  Skip();
+            if (p < end && *p == '}') p++;
+            else for (;;) {
+                std::pair<std::string, JsonValue> m;
+                Skip();
+                if (!String(m.first)) return false;
+                Skip();
+                if (p == end || *p++ != ':') return false;
+                if (!Value(m.second)) return false;
+                v.members.push_back(m);
+                Skip();
+                if (p < end && *p == ',') { p++;  continue; }
+                if (p < end && *p == '}') { p++;  break; }
+                return false; } }
+        else if (*p == '[') {
+            v.type = JsonValue::Array;
+            p++;  Skip();
+            if (p < end && *p == ']') p++;
+            else for (;;) {
+                v.elements.push_back(JsonValue());
+                if (!Value(v.elements.back())) return false;
+                Skip();
+                if (p < end && *p == ',') { p++;  continue; }
+                if (p < end && *p == ']') { p++;  break; }
+                return false; } }
+        else if (*p == '"') {
+            v.type = JsonValue::String;
+            ok = String(v.string); }
+        else if (Literal("true"))  { v.type = JsonValue::Bool;  v.boolean = true; }
+        else if (Literal("false")) { v.type = JsonValue::Bool;  v.boolean = false; }
+        else if (Literal("null"))  { v.type = JsonValue::Null; }
+        else {
+            // Numbers: copy the token so strtod can't run past the end
+            const char* start = p;
+            while (p < end && (strchr("+-.eE", *p) || (*p >= '0' && *p <= '9'))) p++;
+            std::string token(start, p);
+            char* stop;
+            v.type = JsonValue::Number;
+            v.number = strtod(token.c_str(), &stop);
+            ok = !token.empty() && *stop == 0; }
+        depth--;
+        return ok; }
+};
+
+bool JsonValue::Parse(const char* text, const size_t length)
+{
+    *this = JsonValue();
+    JsonParser parser = {text, text+length, 0};
+    if (!parser.Value(*this)) return false;
+    parser.Skip();
+    return parser.p == parser.end;
+}
+
+const JsonValue& JsonValue::operator[](const char* name) const
+{
+    if (type == Object)
+        for (size_t i=0;  i<members.size();  i++)
+            if (members[i].first == name) return members[i].second;
+    return nullValue;
+}
+
+const JsonValue& JsonValue::operator[](const size_t i) const
+{
+    if (type == Array && i < elements.size()) return elements[i];
+    return nullValue;
+}
@@ -0,0 +1,46 @@
+////////////////////////////////////////////////////////////////////////
+// A minimal JSON reader, enough for asset descriptions such as glTF.
+// Parse builds a tree of JsonValues;  lookups of missing members or
+// out of range elements return a shared null value, so chains like
+// doc["nodes"][i]["mesh"].Int(-1) need no checks along the way.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _JSON_
+#define _JSON_
+
+#include <string>
+#include <vector>
+#include <utility>
+
+class JsonValue
+{
+ public:
+    enum Type { Null, Bool, Number, String, Array, Object };
+
+    Type type;
+    bool boolean;
+    double number;
+    std::string string;
+    std::vector<JsonValue> elements;                          // Array
+    std::vector<std::pair<std::string, JsonValue> > members;  // Object
+
+    JsonValue() : type(Null), boolean(false), number(0.0) {}
+
+    // Parses text[0..length);  returns false on a syntax error.
+    bool Parse(const char* text, const size_t length);
+
+    bool IsNull() const { return type == Null; }
+    bool Has(const char* name) const { return !(*this)[name].IsNull(); }
+    size_t Size() const { return type == Array ? elements.size() : members.size(); }
+
+    const JsonValue& operator[](const char* name) const;
+    const JsonValue& operator[](const size_t i) const;
+    const JsonValue& operator[](const int i) const { return (*this)[(size_t)i]; }
+
+    double Num(const double otherwise=0.0) const { return type == Number ? number : otherwise; }
+    int Int(const int otherwise=0) const { return type == Number ? (int)number : otherwise; }
+    bool Boolean(const bool otherwise=false) const { return type == Bool ? boolean : otherwise; }
+    const std::string& Str() const { return string; }
+};
+
+#endif
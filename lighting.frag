@@ -20,6 +20,7 @@ const int     teapotId	= 9;
 const int     spheresId	= 10;
 const int     floorId	= 11;
 const int     otherId	= 12;
+const int     scatterId	= 13;
 
 in vec3 normalVec, lightVec, eyeVec, tanVec;
 in vec2 texCoord;
@@ -21,6 +21,7 @@ const int     teapotId	= 9;
 const int     spheresId	= 10;
 const int     floorId	= 11;
 const int     otherId   = 12;
+const int     scatterId = 13;
 
 uniform vec3 Light;  
 uniform vec3 Ambient;     
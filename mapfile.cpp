@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////
+// Read-only memory mapping of a whole file.  Loaders that parse
+// large assets (PLY, glTF, mesh caches) read straight from the mapped
+// pages instead of copying the file through stdio buffers; the OS
+// pages data in on demand and drops it again when the map is closed.
+////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mapfile.h"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+    : data(NULL), size(0), file(INVALID_HANDLE_VALUE), mapping(NULL)
+{
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) return;
+    size = (size_t)length.QuadPart;
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) return;
+    data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+    : data(NULL), size(0), fd(-1)
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) return;
+    size = (size_t)st.st_size;
+
+    void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) return;
+    madvise(p, size, MADV_SEQUENTIAL);
+    data = (const char*)p;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data) munmap((void*)data, size);
+    if (fd >= 0) close(fd);
+}
+
+#endif
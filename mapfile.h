@@ -0,0 +1,37 @@
+////////////////////////////////////////////////////////////////////////
+// Read-only memory mapping of a whole file.  Loaders that parse
+// large assets (PLY, glTF, mesh caches) read straight from the mapped
+// pages instead of copying the file through stdio buffers; the OS
+// pages data in on demand and drops it again when the map is closed.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _MAPFILE_
+#define _MAPFILE_
+
+#include <stddef.h>
+#include <string>
+
+class MappedFile
+{
+ public:
+    const char* data;           // First byte of the file, or NULL on failure
+    size_t size;                // File length in bytes
+
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    bool Valid() const { return data != NULL; }
+
+ private:
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int fd;
+#endif
+
+    MappedFile(const MappedFile&);              // Not copyable
+    MappedFile& operator=(const MappedFile&);
+};
+
+#endif
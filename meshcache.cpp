@@ -0,0 +1,133 @@
+////////////////////////////////////////////////////////////////////////
+// On-disk cache of finished meshes.  A Shape that is expensive to
+// produce (a parsed PLY file, a finely tessellated teapot) is written
+// once, with its vertex streams, indices, bounds, and modelTr, to
+// cache/mesh<key>.bin.  Later runs map that file and send the streams
+// to the graphics card straight from the mapping.
+//
+// File layout (after the filecache header):  a MeshHeader, then the
+// Pnt, Nrm, Tex, Tan, and Tri arrays, each starting on a 16 byte
+// boundary, exactly as they lie in memory.
+////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <string.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "shapes.h"
+#include "meshcache.h"
+#include "filecache.h"
+#include "mapfile.h"
+#include "assetpack.h"
+
+// Bump when the layout (or anything that changes mesh contents) changes.
+const uint32_t meshVersion = 1;
+
+enum { mPnt, mNrm, mTex, mTan, mTri, mStreams };
+
+struct MeshHeader
+{
+    uint64_t count[mStreams];   // Elements in each array
+    uint64_t offset[mStreams];  // Byte offset of each array in the payload
+    float minP[3], maxP[3], center[3], size;
+    float modelTr[16];
+};
+
+static const size_t elementSize[mStreams] = {
+    sizeof(glm::vec4), sizeof(glm::vec3), sizeof(glm::vec2), sizeof(glm::vec3), sizeof(glm::ivec3) };
+
+static size_t Align16(const size_t n) { return (n + 15) & ~(size_t)15; }
+
+static std::string MeshPath(const uint64_t key)
+{
+    return CachePath("mesh" + HashName(key) + ".bin");
+}
+
+MeshMapping::~MeshMapping()
+{
+    delete file;
+}
+
+bool ReadMeshCache(const uint64_t key, Shape* shape, const bool copy)
+{
+    // A copy in the asset pack is used in place; otherwise map the file.
+    size_t packed, length;
+    const char* data = PackedAsset(MeshPath(key), PackRaw, packed);
+    MappedFile* file = NULL;
+    if (!data) {
+        file = new MappedFile(MeshPath(key));
+        data = file->data;
+        packed = file->size; }
+    const char* payload = MappedCache(data, packed, "MESH", meshVersion, length);
+    MeshHeader h;
+    bool valid = payload && length >= sizeof(MeshHeader);
+    if (valid) {
+        memcpy(&h, payload, sizeof(h));
+        for (int s=0;  s<mStreams;  s++)
+            if (h.offset[s] % 16 != 0 || h.offset[s] > length
+                || h.count[s] > (length - h.offset[s])/elementSize[s]) valid = false;
+        if (h.count[mPnt] == 0 || h.count[mTri] == 0) valid = false; }
+    if (!valid) {
+        delete file;
+        return false; }
+
+    MeshArrays a = {
+        (const glm::vec4*)(payload + h.offset[mPnt]), h.count[mPnt],
+        (const glm::vec3*)(payload + h.offset[mNrm]), h.count[mNrm],
+        (const glm::vec2*)(payload + h.offset[mTex]), h.count[mTex],
+        (const glm::vec3*)(payload + h.offset[mTan]), h.count[mTan],
+        (const glm::ivec3*)(payload + h.offset[mTri]), h.count[mTri] };
+
+    if (copy) {
+        shape->Pnt.assign(a.Pnt, a.Pnt + a.nPnt);
+        shape->Nrm.assign(a.Nrm, a.Nrm + a.nNrm);
+        shape->Tex.assign(a.Tex, a.Tex + a.nTex);
+        shape->Tan.assign(a.Tan, a.Tan + a.nTan);
+        shape->Tri.assign(a.Tri, a.Tri + a.nTri);
+        delete file; }
+    else
+        shape->mapping = new MeshMapping{ file, a };
+    shape->MakeVAO();
+
+    shape->minP = glm::vec3(h.minP[0], h.minP[1], h.minP[2]);
+    shape->maxP = glm::vec3(h.maxP[0], h.maxP[1], h.maxP[2]);
+    shape->center = glm::vec3(h.center[0], h.center[1], h.center[2]);
+    shape->size = h.size;
+    memcpy(&shape->modelTr[0][0], h.modelTr, sizeof(h.modelTr));
+    return true;
+}
+
+bool WriteMeshCache(const uint64_t key, const Shape* shape)
+{
+    const void* data[mStreams] = {
+        shape->Pnt.data(), shape->Nrm.data(), shape->Tex.data(), shape->Tan.data(), shape->Tri.data() };
+
+    MeshHeader h;
+    memset(&h, 0, sizeof(h));
+    h.count[mPnt] = shape->Pnt.size();
+    h.count[mNrm] = shape->Nrm.size();
+    h.count[mTex] = shape->Tex.size();
+    h.count[mTan] = shape->Tan.size();
+    h.count[mTri] = shape->Tri.size();
+    size_t length = Align16(sizeof(h));
+    for (int s=0;  s<mStreams;  s++) {
+        h.offset[s] = length;
+        length = Align16(length + h.count[s]*elementSize[s]); }
+    for (int c=0;  c<3;  c++) {
+        h.minP[c] = shape->minP[c];
+        h.maxP[c] = shape->maxP[c];
+        h.center[c] = shape->center[c]; }
+    h.size = shape->size;
+    memcpy(h.modelTr, &shape->modelTr[0][0], sizeof(h.modelTr));
+
+    std::vector<char> payload(length, 0);
+    memcpy(&payload[0], &h, sizeof(h));
+    for (int s=0;  s<mStreams;  s++)
+        if (h.count[s] > 0)
+            memcpy(&payload[h.offset[s]], data[s], h.count[s]*elementSize[s]);
+
+    return WriteCache(MeshPath(key), "MESH", meshVersion, &payload[0], length);
+}
@@ -0,0 +1,41 @@
+////////////////////////////////////////////////////////////////////////
+// On-disk cache of finished meshes.  A Shape that is expensive to
+// produce (a parsed PLY file, a finely tessellated teapot) is written
+// once, with its vertex streams, indices, bounds, and modelTr, to
+// cache/mesh<key>.bin.  Later runs map that file and send the streams
+// to the graphics card straight from the mapping, which the shape
+// keeps (in place of its data arrays) until it is deleted;  so a
+// deferred MakeVAO (see deferVAO) uploads from the mapping too.
+// Callers that read the data arrays ask for a copy in them instead.
+//
+// The key must cover everything the mesh depends on:  a stamp of the
+// source file and/or the generation parameters (see filecache.h).
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _MESHCACHE_
+#define _MESHCACHE_
+
+#include <stdint.h>
+#include "shapes.h"
+
+class MappedFile;
+
+// A mesh cache file held by a Shape:  its arrays point into the file
+// (or the asset pack).
+struct MeshMapping
+{
+    MappedFile* file;           // NULL if in the pack
+    MeshArrays arrays;
+    ~MeshMapping();
+};
+
+// Reads shape's mesh, bounds, and modelTr from the cache and builds
+// its VAO (with MakeVAO).  The mesh stays in the mapped file (as
+// shape->mapping), unless copy asks for it in the data arrays.
+// Returns false (changing nothing) on a miss.
+bool ReadMeshCache(const uint64_t key, Shape* shape, const bool copy=false);
+
+// Stores shape (after ComputeSize) in the cache under key.
+bool WriteMeshCache(const uint64_t key, const Shape* shape);
+
+#endif
@@ -0,0 +1,396 @@
+////////////////////////////////////////////////////////////////////////
+// Mipmap chains built on the CPU, and their cache files.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_SSE2
+#endif
+
+#include "mipchain.h"
+#include "assetpack.h"
+#include "filecache.h"
+#include "mapfile.h"
+#include "workers.h"
+
+MipFilter mipFilter = MipKaiser;
+
+MipKind MipKindFor(const std::string& path)
+{
+    std::string name = path;
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name.find("normal") != std::string::npos) return MipNormal;
+    if (name.size() >= 4 && name.compare(name.size()-4, 4, ".hdr") == 0) return MipLinear;
+    return MipColor;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Texel conversions
+
+static float SRGBToLinear(const float c)
+{
+    return c <= 0.04045f ? c/12.92f : powf((c + 0.055f)/1.055f, 2.4f);
+}
+
+static float LinearToSRGB(const float v)
+{
+    return v <= 0.0031308f ? 12.92f*v : 1.055f*powf(v, 1.0f/2.4f) - 0.055f;
+}
+
+// Linear values of the 256 sRGB byte values.
+struct SRGBTable
+{
+    float linear[256];
+    SRGBTable() { for (int i=0;  i<256;  i++) linear[i] = SRGBToLinear(i/255.0f); }
+};
+
+static const float* SRGBToLinearTable()
+{
+    static const SRGBTable table;
+    return table.linear;
+}
+
+static unsigned char Byte(const float v)
+{
+    return (unsigned char)(std::min(1.0f, std::max(0.0f, v))*255.0f + 0.5f);
+}
+
+void EncodeTexels(const float* rgba, const size_t count, const MipKind kind,
+                  const ImageFormat format, void* out)
+{
+    if (format == ImageR11G11B10F) {
+        uint32_t* words = (uint32_t*)out;
+        for (size_t i=0;  i<count;  i++) {
+            const float* t = rgba + 4*i;
+            words[i] = PackUnsignedFloat(t[0], 6) | (PackUnsignedFloat(t[1], 6) << 11)
+                | (PackUnsignedFloat(t[2], 5) << 22); }
+        return; }
+
+    unsigned char* bytes = (unsigned char*)out;
+    for (size_t i=0;  i<count;  i++) {
+        const float* t = rgba + 4*i;
+        unsigned char* b = bytes + 4*i;
+        for (int c=0;  c<3;  c++)
+            b[c] = kind == MipColor ? Byte(LinearToSRGB(std::max(0.0f, t[c])))
+                : kind == MipNormal ? Byte(0.5f*t[c] + 0.5f) : Byte(t[c]);
+        b[3] = Byte(t[3]); }
+}
+
+// An image to be filtered, in any of the forms BuildMips takes.
+struct MipSource
+{
+    const unsigned char* bytes; // RGBA8 or R11G11B10F
+    const float* rgb;           // or linear RGB floats
+    const float* rgba;          // or linear RGBA floats (the levels built)
+    ImageFormat format;
+    MipKind kind;
+    int width, height;
+};
+
+// Converts row y of s to linear RGBA floats.
+static void FetchRow(const MipSource& s, const int y, float* out)
+{
+    size_t w = s.width, start = (size_t)y*w;
+    if (s.rgba) {
+        memcpy(out, s.rgba + 4*start, 4*w*sizeof(float));
+        return; }
+
+    if (s.rgb || s.format == ImageR11G11B10F) {
+        // RGB triples, spread out to RGBA from the end back (in place)
+        if (s.rgb) memcpy(out, s.rgb + 3*start, 3*w*sizeof(float));
+        else DecodeR11G11B10F((const uint32_t*)s.bytes + start, out, w);
+        for (size_t i=w;  i-- > 0; ) {
+            float r = out[3*i], g = out[3*i+1], b = out[3*i+2];
+            out[4*i] = r;  out[4*i+1] = g;  out[4*i+2] = b;  out[4*i+3] = 1.0f; }
+        return; }
+
+    const unsigned char* row = s.bytes + 4*start;
+    const float* srgb = SRGBToLinearTable();
+    for (size_t i=0;  i<4*w;  i++) {
+        int c = row[i];
+        out[i] = (i & 3) == 3 ? c/255.0f
+            : s.kind == MipColor ? srgb[c]
+            : s.kind == MipNormal ? c*(2.0f/255.0f) - 1.0f : c/255.0f; }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Filtering
+
+// The source texels (clamped at the edges) and weights making up each
+// output texel along one dimension;  size of each per output texel.
+struct MipTaps
+{
+    int size;
+    std::vector<int> index;
+    std::vector<float> weight;
+};
+
+static double BesselI0(const double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k=1;  k<25;  k++) {
+        term *= (x/(2*k))*(x/(2*k));
+        sum += term; }
+    return sum;
+}
+
+// The Kaiser filter's radius (in the larger of output or source texels)
+// and window shape.
+static const double kaiserRadius = 2.0, kaiserAlpha = 4.0;
+static const double pi = 3.14159265358979323846;
+
+static double FilterWeight(const MipFilter filter, const double x)
+{
+    if (filter == MipBox) return fabs(x) < 0.5 ? 1.0 : 0.0;
+    if (fabs(x) >= kaiserRadius) return 0.0;
+    double t = x/kaiserRadius;
+    double sinc = x == 0.0 ? 1.0 : sin(pi*x)/(pi*x);
+    return sinc*BesselI0(kaiserAlpha*sqrt(1.0 - t*t))/BesselI0(kaiserAlpha);
+}
+
+static MipTaps MakeTaps(const int in, const int out, const MipFilter filter)
+{
+    MipTaps taps;
+    if (in == out) {
+        taps.size = 1;
+        for (int d=0;  d<out;  d++) {
+            taps.index.push_back(d);
+            taps.weight.push_back(1.0f); }
+        return taps; }
+
+    // The filter spans output texels when reducing, and source texels
+    // when enlarging.
+    double scale = in/(double)out, span = std::max(1.0, scale);
+    double radius = (filter == MipBox ? 0.5 : kaiserRadius)*span;
+    std::vector<std::vector<std::pair<int, double> > > all(out);
+    taps.size = 1;
+    for (int d=0;  d<out;  d++) {
+        double center = (d + 0.5)*scale, sum = 0.0;
+        for (int s=(int)floor(center - radius - 0.5);  s<=(int)ceil(center + radius);  s++) {
+            double w = FilterWeight(filter, (s + 0.5 - center)/span);
+            if (w == 0.0) continue;
+            all[d].push_back(std::make_pair(std::min(in-1, std::max(0, s)), w));
+            sum += w; }
+        for (size_t i=0;  i<all[d].size();  i++) all[d][i].second /= sum;
+        taps.size = std::max(taps.size, (int)all[d].size()); }
+
+    // Every output texel gets size taps, padded with ones of no weight
+    for (int d=0;  d<out;  d++)
+        for (int i=0;  i<taps.size;  i++) {
+            bool real = i < (int)all[d].size();
+            taps.index.push_back(real ? all[d][i].first : all[d][0].first);
+            taps.weight.push_back(real ? (float)all[d][i].second : 0.0f); }
+    return taps;
+}
+
+// out (4 floats) = the sum of weight[i]*texel[i] over n texels.
+static inline void Weigh(const float* const* texel, const float* weight, const int n, float* out)
+{
+#ifdef MIP_SSE2
+    __m128 sum = _mm_setzero_ps();
+    for (int i=0;  i<n;  i++)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight[i]), _mm_loadu_ps(texel[i])));
+    _mm_storeu_ps(out, sum);
+#else
+    out[0] = out[1] = out[2] = out[3] = 0.0f;
+    for (int i=0;  i<n;  i++)
+        for (int c=0;  c<4;  c++) out[c] += weight[i]*texel[i][c];
+#endif
+}
+
+// Filters s down to width x height linear RGBA floats.  Each band of
+// output rows filters the source rows it needs across, then down.
+static void Reduce(const MipSource& s, const int width, const int height,
+                   const MipFilter filter, float* out)
+{
+    MipTaps tx = MakeTaps(s.width, width, filter), ty = MakeTaps(s.height, height, filter);
+
+    Workers().ParallelFor(height, [&](int begin, int end) {
+            int lo = s.height, hi = 0;
+            for (size_t i=(size_t)begin*ty.size;  i<(size_t)end*ty.size;  i++) {
+                lo = std::min(lo, ty.index[i]);
+                hi = std::max(hi, ty.index[i]); }
+
+            std::vector<float> row(4*(size_t)s.width), across(4*(size_t)width*(hi-lo+1));
+            std::vector<const float*> texel(std::max(tx.size, ty.size));
+            for (int r=lo;  r<=hi;  r++) {
+                FetchRow(s, r, &row[0]);
+                float* a = &across[4*(size_t)width*(r-lo)];
+                for (int x=0;  x<width;  x++) {
+                    for (int i=0;  i<tx.size;  i++)
+                        texel[i] = &row[4*(size_t)tx.index[x*tx.size + i]];
+                    Weigh(&texel[0], &tx.weight[x*tx.size], tx.size, a + 4*x); } }
+
+            for (int y=begin;  y<end;  y++)
+                for (int x=0;  x<width;  x++) {
+                    for (int i=0;  i<ty.size;  i++)
+                        texel[i] = &across[4*((size_t)width*(ty.index[y*ty.size + i]-lo) + x)];
+                    Weigh(&texel[0], &ty.weight[y*ty.size], ty.size, out + 4*((size_t)y*width + x)); } },
+        8);
+}
+
+static void Renormalize(std::vector<float>& rgba)
+{
+    for (size_t i=0;  i<rgba.size();  i+=4) {
+        float* n = &rgba[i];
+        float len = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (len > 1e-6f) { n[0] /= len;  n[1] /= len;  n[2] /= len; }
+        else { n[0] = n[1] = 0.0f;  n[2] = 1.0f; } }
+}
+
+static void Build(MipSource s, const MipKind kind, const MipFilter filter,
+                  const MipLevelFunction& level)
+{
+    std::vector<float> current, next;
+    for (int l=1;  s.width > 1 || s.height > 1;  l++) {
+        int w = std::max(1, s.width/2), h = std::max(1, s.height/2);
+        next.resize(4*(size_t)w*h);
+        Reduce(s, w, h, filter, &next[0]);
+
+        if (kind == MipNormal) Renormalize(next);
+        level(l, w, h, &next[0]);
+
+        current.swap(next);
+        s.bytes = NULL;
+        s.rgb = NULL;
+        s.rgba = &current[0];
+        s.width = w;
+        s.height = h; }
+}
+
+void BuildMips(const unsigned char* image, const ImageFormat format, const int width,
+               const int height, const MipKind kind, const MipFilter filter,
+               const MipLevelFunction& level)
+{
+    MipKind k = format == ImageR11G11B10F ? MipLinear : kind;
+    MipSource s = { image, NULL, NULL, format, k, width, height };
+    Build(s, k, filter, level);
+}
+
+void BuildMips(const float* rgb, const int width, const int height, const MipFilter filter,
+               const MipLevelFunction& level)
+{
+    MipSource s = { NULL, rgb, NULL, ImageRGBA8, MipLinear, width, height };
+    Build(s, MipLinear, filter, level);
+}
+
+void ResizeImage(const unsigned char* image, const ImageFormat format, const int width,
+                 const int height, const MipKind kind, const MipFilter filter,
+                 const int toWidth, const int toHeight, unsigned char* out)
+{
+    MipKind k = format == ImageR11G11B10F ? MipLinear : kind;
+    MipSource s = { image, NULL, NULL, format, k, width, height };
+    std::vector<float> rgba(4*(size_t)toWidth*toHeight);
+    Reduce(s, toWidth, toHeight, filter, &rgba[0]);
+    if (k == MipNormal) Renormalize(rgba);
+    EncodeTexels(&rgba[0], (size_t)toWidth*toHeight, k, format, out);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Whole chains, and their files
+
+static size_t Align16(const size_t n) { return (n + 15) & ~(size_t)15; }
+
+std::string MipChainPath(const std::string& path, const MipFilter filter)
+{
+    const char* salt = filter == MipBox ? "mip chain box" : "mip chain kaiser";
+    return CachePath("mip" + HashName(Hash64(PackName(path), Hash64(salt))) + ".bin");
+}
+
+MipChain::~MipChain()
+{
+    delete file;
+}
+
+MipChain* MakeMipChain(const unsigned char* image, const ImageFormat format, const int width,
+                       const int height, const MipKind kind, const MipFilter filter,
+                       const uint64_t stamp)
+{
+    // Lay out the header and every level, then fill them in
+    MipHeader h;
+    memset(&h, 0, sizeof(h));
+    h.format = format;
+    h.width = width;
+    h.height = height;
+    h.stamp = stamp;
+    size_t offset = Align16(sizeof(h));
+    for (int w=width, ht=height;  h.levels < 16;  w = std::max(1, w/2), ht = std::max(1, ht/2)) {
+        h.offset[h.levels] = offset;
+        h.size[h.levels] = (size_t)w*ht*4;
+        offset = Align16(offset + h.size[h.levels]);
+        h.levels++;
+        if (w == 1 && ht == 1) break; }
+
+    MipChain* chain = new MipChain();
+    chain->payload.resize(offset);
+    char* p = &chain->payload[0];
+    memcpy(p, &h, sizeof(h));
+    memcpy(p + h.offset[0], image, h.size[0]);
+    BuildMips(image, format, width, height, kind, filter,
+              [&](int l, int w, int ht, const float* rgba) {
+                  if (l < (int)h.levels)
+                      EncodeTexels(rgba, (size_t)w*ht, kind, format, p + h.offset[l]); });
+
+    chain->format = format;
+    chain->width = width;
+    chain->height = height;
+    chain->levels = h.levels;
+    for (int l=0;  l<chain->levels;  l++) {
+        chain->level[l] = (const unsigned char*)p + h.offset[l];
+        chain->size[l] = h.size[l]; }
+    return chain;
+}
+
+bool WriteMipChain(const std::string& path, const MipFilter filter, const MipChain* chain)
+{
+    return !chain->payload.empty()
+        && WriteCache(MipChainPath(path, filter), "MIPS", mipVersion,
+                      &chain->payload[0], chain->payload.size());
+}
+
+MipChain* ReadMipChain(const std::string& path, const MipFilter filter)
+{
+    // From the asset pack if it's there, else mapped from the cache
+    std::string name = MipChainPath(path, filter);
+    size_t size, length;
+    const char* data = PackedAsset(name, PackRaw, size);
+    MappedFile* file = NULL;
+    if (!data) {
+        file = new MappedFile(name);
+        data = file->data;
+        size = file->size; }
+
+    const char* payload = MappedCache(data, size, "MIPS", mipVersion, length);
+    MipHeader h;
+    bool ok = payload && length >= sizeof(h);
+    if (ok) {
+        memcpy(&h, payload, sizeof(h));
+        uint64_t stamp = HashFileStamp(PackName(path));
+        ok = (stamp == 0 || stamp == h.stamp) && h.levels >= 1 && h.levels <= 16
+            && (h.format == ImageRGBA8 || h.format == ImageR11G11B10F);
+        size_t w = h.width, ht = h.height;
+        for (uint32_t l=0;  ok && l<h.levels;  l++) {
+            ok = h.offset[l] <= length && h.size[l] <= length - h.offset[l]
+                && h.size[l] == w*ht*4;
+            w = std::max((size_t)1, w/2);
+            ht = std::max((size_t)1, ht/2); } }
+    if (!ok) {
+        delete file;
+        return NULL; }
+
+    MipChain* chain = new MipChain();
+    chain->format = (ImageFormat)h.format;
+    chain->width = h.width;
+    chain->height = h.height;
+    chain->levels = h.levels;
+    for (int l=0;  l<chain->levels;  l++) {
+        chain->level[l] = (const unsigned char*)payload + h.offset[l];
+        chain->size[l] = h.size[l]; }
+    chain->file = file;
+    return chain;
+}
@@ -0,0 +1,122 @@
+////////////////////////////////////////////////////////////////////////
+// Mipmap chains built on the CPU, instead of by glGenerateMipmap at
+// every startup.  Each level is filtered from the one above it in
+// linear light:  ordinary images are sRGB (the shaders gamma encode
+// their output), so their colors are converted to linear before
+// filtering and back after, while HDR images are linear already.
+// Normal maps are filtered as vectors and renormalized at each level.
+//
+// Two filters are offered:  a 2x2 box (as drivers use), and a Kaiser
+// windowed sinc, which keeps the smaller levels sharper without
+// aliasing.  Levels are filtered row bands at a time on the worker
+// pool, four channels to an SSE2 register where available.
+//
+// Texture keeps each image's chain (the top level included) in
+// cache/mip<name hash>.bin, so a later run maps it and uploads it
+// without decoding the image at all;  the chain is rebuilt once the
+// image changes.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _MIPCHAIN_
+#define _MIPCHAIN_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "imageformat.h"
+
+class MappedFile;
+
+enum MipFilter
+{
+    MipBox = 0,
+    MipKaiser = 1
+};
+
+// How an image's texels are to be filtered.
+enum MipKind
+{
+    MipColor = 0,               // sRGB color (and linear alpha)
+    MipLinear = 1,              // Linear values:  HDR images, masks
+    MipNormal = 2               // Unit vectors, stored as RGB*0.5+0.5
+};
+
+// The filter Texture builds its chains with.
+extern MipFilter mipFilter;
+
+// The kind suiting the image at path:  normal maps are the files with
+// "normal" in their names, and HDR ones are linear.
+MipKind MipKindFor(const std::string& path);
+
+// Filters every level below the top of an image (of format, or linear
+// RGB floats) down to 1x1, calling level(l, width, height, rgba) with
+// the linear RGBA floats of each level l from 1 on.
+typedef std::function<void(int, int, int, const float*)> MipLevelFunction;
+void BuildMips(const unsigned char* image, const ImageFormat format, const int width,
+               const int height, const MipKind kind, const MipFilter filter,
+               const MipLevelFunction& level);
+void BuildMips(const float* rgb, const int width, const int height, const MipFilter filter,
+               const MipLevelFunction& level);
+
+// Converts count linear RGBA float texels (as BuildMips produces) to
+// format, undoing what BuildMips did for kind.
+void EncodeTexels(const float* rgba, const size_t count, const MipKind kind,
+                  const ImageFormat format, void* out);
+
+// Resamples an image (of format, 4 bytes a texel) to toWidth x
+// toHeight texels of the same format, filtered in linear light as the
+// levels are.  Either way works:  enlarging interpolates with the
+// filter.
+void ResizeImage(const unsigned char* image, const ImageFormat format, const int width,
+                 const int height, const MipKind kind, const MipFilter filter,
+                 const int toWidth, const int toHeight, unsigned char* out);
+
+// A chain as stored in cache/mip<hash>.bin (a filecache file with
+// magic "MIPS").
+struct MipHeader
+{
+    uint32_t format;            // An ImageFormat
+    uint32_t width, height;
+    uint32_t levels;
+    uint64_t stamp;             // HashFileStamp of the source image
+    uint64_t offset[16];        // Of each level, from the start of the payload
+    uint64_t size[16];
+};
+
+const uint32_t mipVersion = 1;
+
+// Where the chain of the image at path is kept.
+std::string MipChainPath(const std::string& path, const MipFilter filter);
+
+// A whole chain, either read (in place) from its file or the asset
+// pack, or just built.
+struct MipChain
+{
+    ImageFormat format;
+    int width, height, levels;
+    const unsigned char* level[16];
+    size_t size[16];
+    MappedFile* file;           // Holds the mapping (NULL if in the pack, or built)
+    std::vector<char> payload;  // A built chain, laid out as in the file
+
+    MipChain() : file(NULL) {}
+    ~MipChain();
+};
+
+// Builds the chain of an image (of format, 4 bytes a texel).  stamp
+// is recorded for WriteMipChain.
+MipChain* MakeMipChain(const unsigned char* image, const ImageFormat format, const int width,
+                       const int height, const MipKind kind, const MipFilter filter,
+                       const uint64_t stamp=0);
+
+// Saves a built chain as the one for path.
+bool WriteMipChain(const std::string& path, const MipFilter filter, const MipChain* chain);
+
+// Returns the saved chain of the image at path, or NULL if there is
+// none or it's older than the image.
+MipChain* ReadMipChain(const std::string& path, const MipFilter filter);
+
+#endif
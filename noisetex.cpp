@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////
+// Baking, caching, and sampling tileable noise textures.
+////////////////////////////////////////////////////////////////////////
+
+#include "math.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#include "noisetex.h"
+#include "simplexnoise.h"
+#include "filecache.h"
+#include "workers.h"
+
+const float PI = 3.14159265f;
+const uint32_t noiseVersion = 1;
+
+NoiseTexture::NoiseTexture(const int _dims, const int _size, const float _octaves,
+                           const float _persistence, const float _scale, const float _period,
+                           const bool upload)
+    : textureId(0), dims(_dims), size(_size), octaves(_octaves),
+      persistence(_persistence), scale(_scale), period(_period)
+{
+    // The cache file is named by every parameter that affects the values.
+    float params[5] = {(float)dims, (float)size, octaves, persistence, scale};
+    uint64_t hash = Hash64(params, sizeof(params));
+    hash = Hash64(&period, sizeof(period), hash);
+    std::string path = CachePath("noise" + HashName(hash) + ".bin");
+
+    size_t count = (dims == 3) ? size_t(size)*size*size : size_t(size)*size;
+    std::vector<char> payload;
+    if (ReadCache(path, "NOIS", noiseVersion, payload) && payload.size() == count*sizeof(float)) {
+        data.resize(count);
+        memcpy(&data[0], &payload[0], payload.size()); }
+    else {
+        Bake();
+        WriteCache(path, "NOIS", noiseVersion, &data[0], data.size()*sizeof(float)); }
+
+    if (upload)
+        Upload();
+}
+
+// Fills data with one noise value per texel, one row (2D) or one
+// slice (3D) per parallel work item.
+//
+// In 2D the texel's two coordinates are mapped onto a torus in 4D
+// noise space, which wraps exactly.  Simplex noise stops at 4D, so
+// in 3D each value is instead a trilinear blend of the 8 samples
+// offset by one period along each axis.  That also wraps exactly, at
+// the cost of slightly lower contrast mid-tile.
+void NoiseTexture::Bake()
+{
+    printf("Baking %dD noise %d^%d\n", dims, size, dims);
+    if (dims == 2) {
+        data.resize(size_t(size)*size);
+        float R = period/(2.0f*PI);
+        Workers().ParallelFor(size, [&](int j0, int j1) {
+            for (int j=j0;  j<j1;  j++) {
+                float b = 2.0f*PI*j/size;
+                for (int i=0;  i<size;  i++) {
+                    float a = 2.0f*PI*i/size;
+                    data[size_t(j)*size + i] =
+                        octave_noise_4d(octaves, persistence, scale,
+                                        R*cos(a), R*sin(a), R*cos(b), R*sin(b)); } } });
+    }
+    else {
+        data.resize(size_t(size)*size*size);
+        float P = period;
+        Workers().ParallelFor(size, [&](int k0, int k1) {
+            for (int k=k0;  k<k1;  k++) {
+                float z = P*k/size;
+                for (int j=0;  j<size;  j++) {
+                    float y = P*j/size;
+                    for (int i=0;  i<size;  i++) {
+                        float x = P*i/size;
+                        float fx = x/P, fy = y/P, fz = z/P;
+                        float sum = 0.0f;
+                        for (int c=0;  c<8;  c++) {
+                            float wx = (c&1) ? fx : 1.0f-fx;
+                            float wy = (c&2) ? fy : 1.0f-fy;
+                            float wz = (c&4) ? fz : 1.0f-fz;
+                            sum += wx*wy*wz*octave_noise_3d(octaves, persistence, scale,
+                                                            (c&1) ? x-P : x,
+                                                            (c&2) ? y-P : y,
+                                                            (c&4) ? z-P : z); }
+                        data[(size_t(k)*size + j)*size + i] = sum; } } } });
+    }
+}
+
+void NoiseTexture::Upload()
+{
+    GLenum target = (dims == 3) ? GL_TEXTURE_3D : GL_TEXTURE_2D;
+    glGenTextures(1, &textureId);
+    glBindTexture(target, textureId);
+    if (dims == 3)
+        glTexImage3D(GL_TEXTURE_3D, 0, (GLint)GL_R32F, size, size, size, 0, GL_RED, GL_FLOAT, &data[0]);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, (GLint)GL_R32F, size, size, 0, GL_RED, GL_FLOAT, &data[0]);
+    glGenerateMipmap(target);
+
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, (int)GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, (int)GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, (int)GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(target, 0);
+}
+
+float NoiseTexture::Texel(int i, int j, int k) const
+{
+    i = ((i % size) + size) % size;
+    j = ((j % size) + size) % size;
+    k = (dims == 3) ? ((k % size) + size) % size : 0;
+    return data[(size_t(k)*size + j)*size + i];
+}
+
+float NoiseTexture::Sample(const float u, const float v) const
+{
+    float x = u*size - 0.5f, y = v*size - 0.5f;
+    float fx = floorf(x), fy = floorf(y);
+    int i = (int)fx, j = (int)fy;
+    float s = x - fx, t = y - fy;
+    float a = Texel(i, j)   + s*(Texel(i+1, j)   - Texel(i, j));
+    float b = Texel(i, j+1) + s*(Texel(i+1, j+1) - Texel(i, j+1));
+    return a + t*(b - a);
+}
+
+float NoiseTexture::Sample(const float u, const float v, const float w) const
+{
+    float z = w*size - 0.5f;
+    float fz = floorf(z);
+    int k = (int)fz;
+    float r = z - fz;
+
+    float x = u*size - 0.5f, y = v*size - 0.5f;
+    float fx = floorf(x), fy = floorf(y);
+    int i = (int)fx, j = (int)fy;
+    float s = x - fx, t = y - fy;
+
+    float c[2];
+    for (int d=0;  d<2;  d++) {
+        float a = Texel(i, j, k+d)   + s*(Texel(i+1, j, k+d)   - Texel(i, j, k+d));
+        float b = Texel(i, j+1, k+d) + s*(Texel(i+1, j+1, k+d) - Texel(i, j+1, k+d));
+        c[d] = a + t*(b - a); }
+    return c[0] + r*(c[1] - c[0]);
+}
+
+// Make the noise availabe to a shader program as a sampler2D or
+// sampler3D (depending on dims) in the given texture unit.
+void NoiseTexture::Bind(const int unit, const int programId, const std::string& name)
+{
+    glActiveTexture((gl::GLenum)((int)GL_TEXTURE0 + unit));
+    glBindTexture(dims == 3 ? GL_TEXTURE_3D : GL_TEXTURE_2D, textureId);
+    int loc = glGetUniformLocation(programId, name.c_str());
+    glUniform1i(loc, unit);
+}
+
+void NoiseTexture::Unbind()
+{
+    glBindTexture(dims == 3 ? GL_TEXTURE_3D : GL_TEXTURE_2D, 0);
+}
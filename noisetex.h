@@ -0,0 +1,45 @@
+///////////////////////////////////////////////////////////////////////
+// Tileable simplex noise baked into a float texture (2D or 3D).  The
+// bake evaluates octave_noise once per texel (in parallel), caches
+// the result on disk, and keeps a CPU copy.  Shaders then sample the
+// noise with a single texture fetch, and CPU code can query the same
+// table through Sample.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _NOISETEX_
+#define _NOISETEX_
+
+#include <string>
+#include <vector>
+
+class NoiseTexture
+{
+ public:
+    unsigned int textureId;
+    int dims;                   // 2 or 3
+    int size;                   // Texels along each axis
+    float octaves, persistence, scale, period;
+    std::vector<float> data;    // size^dims values in (-1,1); x varies fastest
+
+    // The noise is evaluated over [0,period) along each axis (in the
+    // same units octave_noise_2d/3d takes) and wraps seamlessly at
+    // the edges.  Set upload=false for a CPU-only table.
+    NoiseTexture(const int dims, const int size, const float octaves,
+                 const float persistence, const float scale, const float period,
+                 const bool upload=true);
+
+    float Texel(int i, int j, int k=0) const;
+
+    // Filtered, wrapping lookups in texture coordinates (1.0 == one period).
+    float Sample(const float u, const float v) const;
+    float Sample(const float u, const float v, const float w) const;
+
+    void Bind(const int unit, const int programId, const std::string& name);
+    void Unbind();
+
+ private:
+    void Bake();
+    void Upload();
+};
+
+#endif
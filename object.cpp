@@ -24,6 +24,8 @@ using namespace gl;
 #include "framework.h"
 #include "shapes.h"
 #include "transform.h"
+#include "texstream.h"
+#include "texarray.h"
 
 #include <glu.h>                // For gluErrorString
 #define CHECKERROR {GLenum err = glGetError(); if (err != GL_NO_ERROR) { fprintf(stderr, "OpenGL error (at line object.cpp:%d): %s\n", __LINE__, gluErrorString(err)); exit(-1);} }
@@ -32,7 +34,8 @@ using namespace gl;
 Object::Object(Shape* _shape, const int _objectId,
                const glm::vec3 _diffuseColor, const glm::vec3 _specularColor, const float _shininess)
     : diffuseColor(_diffuseColor), specularColor(_specularColor), shininess(_shininess),
-      shape(_shape), objectId(_objectId), objTexture(nullptr), normalTexture(nullptr)
+      shape(_shape), objectId(_objectId), objTexture(nullptr), normalTexture(nullptr),
+      texLayer(nullptr), normalLayer(nullptr)
      
 {
     if (objectId == teapotId) {
@@ -77,7 +80,21 @@ void Object::Draw(ShaderProgram* program, glm::mat4& objectTr)
 
         // @@ Textures, being uniform sampler2d variables in the shader,
         // are also set here.  Call texture->Bind in texture.cpp to do so.
-        if (objTexture) {
+        // (A texture still being loaded has textureId 0 and is skipped.)
+        // Each asks for the mip level it needs at this size on screen.
+        // A texture in an array is just a layer index, its array being
+        // bound already unless the last object used another one.
+        Streamer().Request(objTexture, shape, objectTr);
+        Streamer().Request(normalTexture, shape, objectTr);
+        bool texArray = Arrays().Use(texLayer, colorArrayUnit, program->programId,
+                                     "texArray", "texLayer", "texScale");
+        bool normalArray = Arrays().Use(normalLayer, normalArrayUnit, program->programId,
+                                        "normalArray", "normalLayer", "normalScale");
+        if (texArray) {
+            loc = glGetUniformLocation(program->programId, "useTexture");
+            glUniform1i(loc, 1);
+        }
+        else if (objTexture && objTexture->textureId) {
             objTexture->Bind(0, program->programId, "texMap");
             loc = glGetUniformLocation(program->programId, "useTexture");
             glUniform1i(loc, 1);
@@ -86,7 +103,11 @@ void Object::Draw(ShaderProgram* program, glm::mat4& objectTr)
             loc = glGetUniformLocation(program->programId, "useTexture");
             glUniform1i(loc, 0);
         }
-        if (normalTexture) {
+        if (normalArray) {
+            loc = glGetUniformLocation(program->programId, "useNormal");
+            glUniform1i(loc, 1);
+        }
+        else if (normalTexture && normalTexture->textureId) {
             normalTexture->Bind(1, program->programId, "normalMap");
             loc = glGetUniformLocation(program->programId, "useNormal");
             glUniform1i(loc, 1);
@@ -95,6 +116,9 @@ void Object::Draw(ShaderProgram* program, glm::mat4& objectTr)
             loc = glGetUniformLocation(program->programId, "useNormal");
             glUniform1i(loc, 0);
         }
+        // Array layers hold all three components (see TextureArrays::Prepare).
+        loc = glGetUniformLocation(program->programId, "normalXY");
+        glUniform1i(loc, !normalArray && normalTexture && normalTexture->normalXY ? 1 : 0);
 
         loc = glGetUniformLocation(program->programId, "reflectiveObject");
         if (isReflective) {
@@ -140,10 +164,10 @@ void Object::DrawWithoutTeapot(ShaderProgram* program, glm::mat4& objectTr)
 
     // @@ Textures, being uniform sampler2d variables in the shader,
     // are also set here.  Call texture->Bind in texture.cpp to do so.
-    if (objTexture) {
+    if (objTexture && objTexture->textureId) {
         objTexture->Bind(0, program->programId, "tex");
     }
-    if (normalTexture) {
+    if (normalTexture && normalTexture->textureId) {
         normalTexture->Bind(1, program->programId, "normalMap");
     }
 
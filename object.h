@@ -18,6 +18,7 @@
 
 class Shader;
 class Object;
+struct ArrayLayer;
 
 typedef std::pair<Object*,glm::mat4> INSTANCE;
 
@@ -34,6 +35,8 @@ class Object
     float shininess;            // Surface roughness value
     Texture* objTexture;
     Texture* normalTexture;
+    ArrayLayer* texLayer;       // Or the layers of a texture array holding them (see texarray.h)
+    ArrayLayer* normalLayer;
 
     std::vector<INSTANCE> instances; // Pairs of sub-objects and transformations 
     
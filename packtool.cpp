@@ -0,0 +1,157 @@
+////////////////////////////////////////////////////////////////////////
+// Builds an asset pack (see assetpack.h) from a list of files.
+//
+// Usage:  packtool out.pack files...
+// Images (.png .jpg .jpeg .bmp .tga .hdr) are stored decoded and
+// flipped, exactly as Texture would load them (HDR ones packed as
+// R11F_G11F_B10F);  everything else is stored as is.  Files in cache/
+// are keyed by their contents already, so they are stored without a
+// stamp and are never considered stale.
+//
+// Build and run with "make pack".
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "assetpack.h"
+#include "filecache.h"
+#include "mapfile.h"
+#include "imageformat.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_FAILURE_USERMSG
+#include "stb_image.h"
+
+struct Source
+{
+    std::string path, name;
+    PackKind kind;
+    PackEntry entry;
+};
+
+static size_t Align16(const size_t n) { return (n + 15) & ~(size_t)15; }
+
+static bool IsImage(const std::string& name)
+{
+    static const char* extensions[] = { ".png", ".jpg", ".jpeg", ".bmp", ".tga", ".hdr" };
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos) return false;
+    std::string ext = name.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    for (const char* e : extensions)
+        if (ext == e) return true;
+    return false;
+}
+
+static bool Before(const Source& a, const Source& b)
+{
+    int c = strcmp(a.name.c_str(), b.name.c_str());
+    return c < 0 || (c == 0 && a.kind < b.kind);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        printf("Usage: packtool out.pack files...\n");
+        return -1; }
+
+    // Size every entry without reading it
+    std::vector<Source> sources;
+    for (int a=2;  a<argc;  a++) {
+        Source s;
+        s.path = argv[a];
+        s.name = PackName(s.path);
+        s.kind = IsImage(s.name) ? PackImage : PackRaw;
+        memset(&s.entry, 0, sizeof(s.entry));
+        s.entry.kind = s.kind;
+        s.entry.stamp = s.name.compare(0, 6, "cache/") == 0 ? 0 : HashFileStamp(s.name);
+
+        int width, height, n;
+        if (s.kind == PackImage) {
+            if (!stbi_info(s.path.c_str(), &width, &height, &n)) {
+                printf("Skipping %s: %s\n", s.path.c_str(), stbi_failure_reason());
+                continue; }
+            s.entry.size = sizeof(PackedImage) + (uint64_t)width*height*4; }
+        else {
+            MappedFile file(s.path);
+            if (!file.Valid()) {
+                printf("Skipping %s: can't read it\n", s.path.c_str());
+                continue; }
+            s.entry.size = file.size; }
+        sources.push_back(s); }
+
+    std::sort(sources.begin(), sources.end(), Before);
+    for (size_t i=1;  i<sources.size();  i++)
+        if (!Before(sources[i-1], sources[i])) {
+            printf("%s is listed twice\n", sources[i].name.c_str());
+            return -1; }
+
+    // Lay out the header, table, names, and data
+    PackHeader h;
+    memset(&h, 0, sizeof(h));
+    h.entries = sources.size();
+    h.names = sizeof(h) + sources.size()*sizeof(PackEntry);
+    std::vector<char> names;
+    for (Source& s : sources) {
+        s.entry.name = names.size();
+        names.insert(names.end(), s.name.begin(), s.name.end());
+        names.push_back(0); }
+    uint64_t length = Align16(h.names + names.size());
+    for (Source& s : sources) {
+        s.entry.offset = length;
+        length = Align16(length + s.entry.size); }
+
+    CacheWriter writer;
+    if (!writer.Open(argv[1], length)) {
+        printf("Can't write %s\n", argv[1]);
+        return -1; }
+    writer.Write(0, &h, sizeof(h));
+    for (size_t i=0;  i<sources.size();  i++)
+        writer.Write(sizeof(h) + i*sizeof(PackEntry), &sources[i].entry, sizeof(PackEntry));
+    if (!names.empty())
+        writer.Write(h.names, &names[0], names.size());
+
+    // Then the data, one file at a time
+    stbi_set_flip_vertically_on_load(true);
+    for (const Source& s : sources) {
+        if (s.kind == PackImage) {
+            PackedImage p;
+            memset(&p, 0, sizeof(p));
+            int width, height, n;
+            unsigned char* image;
+            if (stbi_is_hdr(s.path.c_str())) {
+                float* rgb = stbi_loadf(s.path.c_str(), &width, &height, &n, 3);
+                if (rgb) EncodeR11G11B10F(rgb, (uint32_t*)rgb, (size_t)width*height);
+                image = (unsigned char*)rgb;
+                p.format = ImageR11G11B10F; }
+            else {
+                image = stbi_load(s.path.c_str(), &width, &height, &n, 4);
+                p.format = ImageRGBA8; }
+            if (!image || sizeof(p) + (uint64_t)width*height*4 != s.entry.size) {
+                printf("Read error on %s\n", s.path.c_str());
+                return -1; }
+            p.width = width;
+            p.height = height;
+            writer.Write(s.entry.offset, &p, sizeof(p));
+            writer.Write(s.entry.offset + sizeof(p), image, s.entry.size - sizeof(p));
+            stbi_image_free(image); }
+        else {
+            MappedFile file(s.path);
+            if (file.size != s.entry.size) {
+                printf("%s changed while packing\n", s.path.c_str());
+                return -1; }
+            writer.Write(s.entry.offset, file.data, file.size); }
+        printf("  %-40s %10lld bytes%s\n", s.name.c_str(), (long long)s.entry.size,
+               s.kind == PackImage ? " (decoded)" : ""); }
+
+    if (!writer.Close("PACK", packVersion)) {
+        printf("Can't write %s\n", argv[1]);
+        return -1; }
+    printf("Wrote %s: %d entries, %lld bytes\n", argv[1], (int)sources.size(), (long long)length);
+    return 0;
+}
@@ -0,0 +1,120 @@
+////////////////////////////////////////////////////////////////////////
+// A persistently mapped ring of pixel buffer memory for uploads.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#include "pixelring.h"
+
+// Spans start on this boundary, which suits every texel and block size.
+static const size_t spanAlign = 256;
+
+PixelRing::PixelRing() : capacity((size_t)64 << 20), buffer(0), mapped(NULL), head(0), reserved(0)
+{
+}
+
+bool PixelRing::Create()
+{
+    int count = 0, major = 0, minor = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    bool storage = major > 4 || (major == 4 && minor >= 4);
+    for (int i=0;  !storage && i<count;  i++) {
+        const char* e = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        storage = e && !strcmp(e, "GL_ARB_buffer_storage"); }
+    if (!storage || capacity == 0) {
+        printf("No persistently mapped buffers;  textures upload from client memory\n");
+        return false; }
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)capacity, NULL,
+                    GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    void* p = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)capacity,
+                               GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!p) {
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        return false; }
+
+    std::lock_guard<std::mutex> guard(lock);
+    mapped = (unsigned char*)p;
+    return true;
+}
+
+bool PixelRing::Reserve(const size_t size, PixelSpan& span)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    size_t n = (size + spanAlign - 1) & ~(spanAlign - 1);
+    if (!mapped || n == 0 || n >= capacity) return false;
+
+    // The spans in use run from the oldest one's start up to head,
+    // perhaps wrapping around the end.  (Strict comparisons keep head
+    // off the oldest's start, where an empty and a full ring look alike.)
+    size_t at;
+    if (spans.empty())
+        at = head = 0;
+    else {
+        size_t tail = spans.front().offset;
+        if (head > tail && head + n <= capacity) at = head;
+        else if (head > tail && n < tail) at = 0;
+        else if (head < tail && head + n < tail) at = head;
+        else return false; }
+
+    Span s = { at, n, NULL, false };
+    spans.push_back(s);
+    head = at + n;
+    reserved += n;
+    span.offset = at;
+    span.size = size;
+    span.data = mapped + at;
+    return true;
+}
+
+void PixelRing::Bind()
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+}
+
+void PixelRing::Unbind()
+{
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void PixelRing::Release(PixelSpan& span)
+{
+    if (!span.data) return;
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT);
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i=0;  i<spans.size();  i++)
+        if (spans[i].offset == span.offset && !spans[i].released) {
+            spans[i].fence = (void*)fence;
+            spans[i].released = true;
+            break; }
+    span = PixelSpan();
+}
+
+void PixelRing::Update()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    while (!spans.empty() && spans.front().released) {
+        GLsync fence = (GLsync)spans.front().fence;
+        GLenum state = glClientWaitSync(fence, GL_NONE_BIT, 0);
+        if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(fence);
+        reserved -= spans.front().size;
+        spans.pop_front(); }
+}
+
+PixelRing& Uploads()
+{
+    static PixelRing ring;
+    return ring;
+}
@@ -0,0 +1,88 @@
+////////////////////////////////////////////////////////////////////////
+// Texture uploads through pixel buffer objects.  glTexImage2D from
+// client memory makes the driver copy every texel before it returns,
+// on the render thread, and for a mapped mip chain that copy is where
+// the pages are read from disk.  Instead, one pixel unpack buffer is
+// mapped persistently (GL_ARB_buffer_storage, core in 4.4) and used as
+// a ring:  a span of it is reserved for an upload, its texels are
+// written there (by a worker, usually), and the glTexImage2D that
+// reads them is issued with the buffer bound, so the driver copies
+// from buffer memory at its own pace.  Each span is fenced once the
+// commands reading it are issued, and reused only when the fence has
+// passed.
+//
+// Reserving may happen on any thread;  everything else is for the
+// render thread.  Reserve fails if there's no room (or the driver
+// lacks buffer storage), and the caller then uploads from client
+// memory as before.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _PIXELRING_
+#define _PIXELRING_
+
+#include <stddef.h>
+#include <deque>
+#include <mutex>
+
+// A reserved span of the ring.
+struct PixelSpan
+{
+    size_t offset, size;
+    unsigned char* data;        // Where its texels go;  NULL if nothing is reserved
+    PixelSpan() : offset(0), size(0), data(NULL) {}
+};
+
+class PixelRing
+{
+ public:
+    PixelRing();
+
+    size_t capacity;            // Bytes in the ring;  set before Create
+
+    // Creates and maps the buffer.  Returns false (and Reserve always
+    // fails) if the driver can't map it persistently.
+    bool Create();
+
+    // Reserves size bytes, returning false if they don't fit now.
+    bool Reserve(const size_t size, PixelSpan& span);
+
+    // Binds the ring as GL_PIXEL_UNPACK_BUFFER, for glTexImage* calls
+    // taking Pixels(span) in place of a pointer;  Unbind restores
+    // client memory uploads.
+    void Bind();
+    void Unbind();
+    static const void* Pixels(const PixelSpan& span, const size_t at=0)
+    {
+        return (const void*)(span.offset + at);
+    }
+
+    // Hands a span back once the commands reading it are issued (or
+    // if it won't be used after all).  span is left empty.
+    void Release(PixelSpan& span);
+
+    // Frees the spans the graphics card is done with.  Call once per
+    // frame.
+    void Update();
+
+    size_t Reserved() const { return reserved; }
+
+ private:
+    struct Span
+    {
+        size_t offset, size;
+        void* fence;            // A GLsync, once released
+        bool released;
+    };
+
+    unsigned int buffer;
+    unsigned char* mapped;
+    std::mutex lock;            // Guards the fields below
+    std::deque<Span> spans;     // In the order reserved
+    size_t head;                // Where the next span starts
+    size_t reserved;
+};
+
+// The single ring shared by the whole program, created on first use.
+PixelRing& Uploads();
+
+#endif
@@ -0,0 +1,106 @@
+////////////////////////////////////////////////////////////////////////
+// Benchmark for the PLY loaders:  times ReadPlyFast against the rply
+// callback path (Ply::ReadRply) on the same file, checks that both
+// produce identical data arrays, and reports throughput.
+//
+// Usage:  plybench [file.ply [megabytes]]
+// If the file doesn't exist, an ASCII grid mesh of about the given
+// size (default 100 MB) is written there first.  The default file is
+// cache/bench-ascii.ply.
+//
+// Build with "make plybench".
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "shapes.h"
+#include "plyload.h"
+#include "filecache.h"
+#include "workers.h"
+
+// Writes an n by n grid of quads (as triangles) in ASCII PLY, with a
+// gently rolling height, normals, and texture coordinates.
+void WriteGrid(const std::string& path, const int n)
+{
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) { printf("Can't write %s\n", path.c_str());  exit(-1); }
+    fprintf(f, "ply\nformat ascii 1.0\ncomment plybench grid\n");
+    fprintf(f, "element vertex %d\n", (n+1)*(n+1));
+    fprintf(f, "property float x\nproperty float y\nproperty float z\n");
+    fprintf(f, "property float nx\nproperty float ny\nproperty float nz\n");
+    fprintf(f, "property float s\nproperty float t\n");
+    fprintf(f, "element face %d\n", 2*n*n);
+    fprintf(f, "property list uchar int vertex_indices\nend_header\n");
+    for (int i=0;  i<=n;  i++) {
+        for (int j=0;  j<=n;  j++) {
+            float s = i/float(n), t = j/float(n);
+            float x = 200.0f*s - 100.0f, y = 200.0f*t - 100.0f;
+            float z = 3.0f*sinf(0.1f*x)*cosf(0.13f*y);
+            glm::vec3 N = glm::normalize(glm::vec3(-0.3f*cosf(0.1f*x)*cosf(0.13f*y),
+                                                   0.39f*sinf(0.1f*x)*sinf(0.13f*y), 1.0f));
+            fprintf(f, "%f %f %f %f %f %f %f %f\n", x, y, z, N.x, N.y, N.z, s, t); } }
+    for (int i=1;  i<=n;  i++) {
+        for (int j=1;  j<=n;  j++) {
+            int a = (i-1)*(n+1) + (j-1), b = (i-1)*(n+1) + j;
+            int c = i*(n+1) + j,         d = i*(n+1) + (j-1);
+            fprintf(f, "3 %d %d %d\n3 %d %d %d\n", a, b, c, a, c, d); } }
+    fclose(f);
+}
+
+template <class T>
+bool Same(const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp(&a[0], &b[0], a.size()*sizeof(T)) == 0);
+}
+
+double Seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : CachePath("bench-ascii.ply");
+    double megabytes = argc > 2 ? atof(argv[2]) : 100.0;
+
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        // About 122 bytes per grid cell (one vertex line and two faces)
+        int n = (int)sqrt(megabytes*1.0e6/122.0);
+        printf("Writing %s (%d x %d grid) ...\n", path.c_str(), n, n);
+        WriteGrid(path, n);
+        f = fopen(path.c_str(), "rb"); }
+    fseek(f, 0, SEEK_END);
+    double size = ftell(f)/1.0e6;
+    fclose(f);
+
+    printf("%s: %.1f MB, %d worker threads\n", path.c_str(), size, Workers().Size());
+
+    Shape fast;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool handled = ReadPlyFast(path, &fast);
+    double fastTime = Seconds(start);
+    if (!handled) { printf("ReadPlyFast does not handle this file\n");  return 1; }
+    printf("ReadPlyFast:  %8.3f s  %8.1f MB/s  (%zu vertices, %zu triangles)\n",
+           fastTime, size/fastTime, fast.Pnt.size(), fast.Tri.size());
+
+    Shape slow;
+    start = std::chrono::steady_clock::now();
+    Ply::ReadRply(path.c_str(), &slow);
+    double slowTime = Seconds(start);
+    printf("rply:         %8.3f s  %8.1f MB/s\n", slowTime, size/slowTime);
+
+    bool same = Same(fast.Pnt, slow.Pnt) && Same(fast.Nrm, slow.Nrm) && Same(fast.Tex, slow.Tex)
+        && Same(fast.Tan, slow.Tan) && Same(fast.Tri, slow.Tri);
+    printf("Speedup %.1fx;  output %s\n", slowTime/fastTime, same ? "identical" : "DIFFERS");
+    return same ? 0 : 1;
+}
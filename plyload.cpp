@@ -0,0 +1,706 @@
+////////////////////////////////////////////////////////////////////////
+// Fast PLY loading.  rply hands every scalar of every vertex to a
+// callback, which is fine for small models but slow for scanned
+// meshes with millions of vertices.  ReadPlyFast memory-maps the file,
+// parses the header itself, and decodes the vertex and face elements
+// in bulk straight into a Shape's preallocated data arrays.
+//
+// Vertices have a fixed record size, so they are decoded in parallel
+// bands;  when x,y,z (or nx,ny,nz or s,t) are adjacent 32 bit floats
+// each is a single memcpy per vertex.  Faces are variable length in
+// general, but nearly every file stores only triangles, which is
+// checked with a cheap strided scan and then also decoded in parallel.
+//
+// ASCII files are split into line-aligned chunks which are parsed in
+// parallel with a fast decimal parser (exact, so the values match
+// rply's strtod bit for bit), then the chunks' faces are stitched
+// together in file order.
+//
+// ReadPlyPoints serves point clouds too large to hold:  it streams the
+// vertex element in fixed-size batches to a callback.
+////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "shapes.h"
+#include "plyload.h"
+#include "mapfile.h"
+#include "workers.h"
+
+enum PlyType { PlyNone, PlyInt8, PlyUint8, PlyInt16, PlyUint16,
+               PlyInt32, PlyUint32, PlyFloat32, PlyFloat64 };
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;               // Scalar type (of the items, for a list)
+    PlyType countType;          // PlyNone unless this is a list
+    int offset;                 // Byte offset in the record (-1 after a list)
+};
+
+struct PlyElement
+{
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> props;
+    int stride;                 // Record size in bytes, or -1 if it has lists
+
+    int Find(const char* prop) const {
+        for (size_t i=0;  i<props.size();  i++)
+            if (props[i].name == prop) return i;
+        return -1; }
+};
+
+enum PlyFormat { PlyAscii, PlyBinaryLE, PlyBinaryBE };
+
+struct PlyHeader
+{
+    PlyFormat format;
+    std::vector<PlyElement> elements;
+    size_t body;                // Byte offset of the first element record
+
+    bool Parse(const char* data, const size_t size);
+};
+
+static PlyType ParseType(const std::string& s)
+{
+    if (s == "char"   || s == "int8")    return PlyInt8;
+    if (s == "uchar"  || s == "uint8")   return PlyUint8;
+    if (s == "short"  || s == "int16")   return PlyInt16;
+    if (s == "ushort" || s == "uint16")  return PlyUint16;
+    if (s == "int"    || s == "int32")   return PlyInt32;
+    if (s == "uint"   || s == "uint32")  return PlyUint32;
+    if (s == "float"  || s == "float32") return PlyFloat32;
+    if (s == "double" || s == "float64") return PlyFloat64;
+    return PlyNone;
+}
+
+static int TypeSize(const PlyType t)
+{
+    static const int sizes[] = {0, 1, 1, 2, 2, 4, 4, 4, 8};
+    return sizes[t];
+}
+
+// Reads one little-endian scalar of type t at p.
+static double ReadScalar(const char* p, const PlyType t)
+{
+    switch (t) {
+    case PlyInt8:    { int8_t v;   memcpy(&v, p, 1);  return v; }
+    case PlyUint8:   { uint8_t v;  memcpy(&v, p, 1);  return v; }
+    case PlyInt16:   { int16_t v;  memcpy(&v, p, 2);  return v; }
+    case PlyUint16:  { uint16_t v; memcpy(&v, p, 2);  return v; }
+    case PlyInt32:   { int32_t v;  memcpy(&v, p, 4);  return v; }
+    case PlyUint32:  { uint32_t v; memcpy(&v, p, 4);  return v; }
+    case PlyFloat32: { float v;    memcpy(&v, p, 4);  return v; }
+    case PlyFloat64: { double v;   memcpy(&v, p, 8);  return v; }
+    default: return 0.0; }
+}
+
+// Reads a list count or index, which are integers of any width.
+static int ReadInt(const char* p, const PlyType t)
+{
+    switch (t) {
+    case PlyInt8:    { int8_t v;   memcpy(&v, p, 1);  return v; }
+    case PlyUint8:   { uint8_t v;  memcpy(&v, p, 1);  return v; }
+    case PlyInt16:   { int16_t v;  memcpy(&v, p, 2);  return v; }
+    case PlyUint16:  { uint16_t v; memcpy(&v, p, 2);  return v; }
+    case PlyInt32:   { int32_t v;  memcpy(&v, p, 4);  return v; }
+    case PlyUint32:  { uint32_t v; memcpy(&v, p, 4);  return (int)v; }
+    default: return (int)ReadScalar(p, t); }
+}
+
+bool PlyHeader::Parse(const char* data, const size_t size)
+{
+    // Find the end of the header without running off the mapping.
+    const char* tag = "end_header";
+    const char* end = NULL;
+    for (size_t i=0;  i+10<=size && i<65536;  i++)
+        if (data[i] == 'e' && memcmp(data+i, tag, 10) == 0) { end = data+i+10;  break; }
+    if (size < 4 || memcmp(data, "ply", 3) != 0 || !end) return false;
+    while (end < data+size && *end != '\n') end++;
+    if (end == data+size) return false;
+    body = end+1 - data;
+
+    std::istringstream in(std::string(data, end));
+    std::string line;
+    bool haveFormat = false;
+    while (std::getline(in, line)) {
+        std::istringstream words(line);
+        std::string word;
+        words >> word;
+        if (word == "format") {
+            std::string f;
+            words >> f;
+            if      (f == "ascii")                format = PlyAscii;
+            else if (f == "binary_little_endian") format = PlyBinaryLE;
+            else if (f == "binary_big_endian")    format = PlyBinaryBE;
+            else return false;
+            haveFormat = true; }
+        else if (word == "element") {
+            PlyElement e;
+            words >> e.name >> e.count;
+            if (words.fail()) return false;
+            e.stride = 0;
+            elements.push_back(e); }
+        else if (word == "property") {
+            if (elements.empty()) return false;
+            PlyElement& e = elements.back();
+            PlyProperty p;
+            std::string type;
+            words >> type;
+            if (type == "list") {
+                std::string countType, itemType;
+                words >> countType >> itemType;
+                p.countType = ParseType(countType);
+                p.type = ParseType(itemType);
+                if (p.countType == PlyNone) return false; }
+            else {
+                p.countType = PlyNone;
+                p.type = ParseType(type); }
+            words >> p.name;
+            if (p.type == PlyNone || words.fail()) return false;
+            p.offset = e.stride;
+            if (e.stride >= 0)
+                e.stride = p.countType == PlyNone ? e.stride + TypeSize(p.type) : -1;
+            e.props.push_back(p); } }
+    return haveFormat;
+}
+
+// Finds the vertex properties holding x,y,z, nx,ny,nz, and s,t (or
+// u,v), as property indices (-1 if missing).  False if there's no x,y,z.
+static bool VertexSlots(const PlyElement& e, int slots[8])
+{
+    const char* names[8] = {"x", "y", "z", "nx", "ny", "nz", "s", "t"};
+    for (int i=0;  i<8;  i++) {
+        slots[i] = e.Find(names[i]);
+        if (slots[i] < 0 && i >= 6) slots[i] = e.Find(i==6 ? "u" : "v"); }
+    return slots[0] >= 0 && slots[1] >= 0 && slots[2] >= 0;
+}
+
+// Sizes the data arrays for n vertices with the given attributes.
+static void VertexResize(Shape* shape, const size_t n, const bool hasN, const bool hasT)
+{
+    shape->Pnt.resize(n);
+    shape->Tan.assign(n, glm::vec3());
+    if (hasN) shape->Nrm.resize(n);
+    if (hasT) shape->Tex.resize(n);
+}
+
+// Appends the triangles of an n sided face with indices v (only the
+// first four are used), split the same way as Ply::face_cb.
+static void PushFace(std::vector<glm::ivec3>& Tri, const int v[4], const int n)
+{
+    if (n >= 3) Tri.push_back(glm::ivec3(v[0], v[1], v[2]));
+    if (n >= 4) Tri.push_back(glm::ivec3(v[0], v[2], v[3]));
+}
+
+// Decodes a fixed-size vertex record array.
+static bool DecodeVertices(const PlyElement& e, const char* base, const char* end, Shape* shape)
+{
+    if (e.stride <= 0 || (size_t)(end-base) < e.count*e.stride) return false;
+    int slots[8];
+    if (!VertexSlots(e, slots)) return false;
+    const PlyProperty* P[8];
+    for (int i=0;  i<8;  i++)
+        P[i] = slots[i] >= 0 ? &e.props[slots[i]] : NULL;
+    bool hasN = P[3] && P[4] && P[5];
+    bool hasT = P[6] && P[7];
+
+    // Runs of adjacent 32 bit floats can be copied whole.
+    bool packedP = P[0]->type==PlyFloat32 && P[1]->type==PlyFloat32 && P[2]->type==PlyFloat32
+                   && P[1]->offset==P[0]->offset+4 && P[2]->offset==P[0]->offset+8;
+    bool packedN = hasN && P[3]->type==PlyFloat32 && P[4]->type==PlyFloat32 && P[5]->type==PlyFloat32
+                   && P[4]->offset==P[3]->offset+4 && P[5]->offset==P[3]->offset+8;
+    bool packedT = hasT && P[6]->type==PlyFloat32 && P[7]->type==PlyFloat32
+                   && P[7]->offset==P[6]->offset+4;
+
+    size_t n = e.count;
+    int stride = e.stride;
+    VertexResize(shape, n, hasN, hasT);
+
+    Workers().ParallelFor((int)n, [&](int i0, int i1) {
+        for (int i=i0;  i<i1;  i++) {
+            const char* r = base + (size_t)i*stride;
+            glm::vec4& p = shape->Pnt[i];
+            if (packedP)
+                memcpy(&p[0], r+P[0]->offset, 12);
+            else
+                for (int c=0;  c<3;  c++) p[c] = ReadScalar(r+P[c]->offset, P[c]->type);
+            p[3] = 1.0f;
+            if (hasN) {
+                glm::vec3& q = shape->Nrm[i];
+                if (packedN)
+                    memcpy(&q[0], r+P[3]->offset, 12);
+                else
+                    for (int c=0;  c<3;  c++) q[c] = ReadScalar(r+P[3+c]->offset, P[3+c]->type); }
+            if (hasT) {
+                glm::vec2& t = shape->Tex[i];
+                if (packedT)
+                    memcpy(&t[0], r+P[6]->offset, 8);
+                else
+                    for (int c=0;  c<2;  c++) t[c] = ReadScalar(r+P[6+c]->offset, P[6+c]->type); } } },
+        4096);
+    return true;
+}
+
+// Byte size of one record of e starting at r (lists make it vary), or
+// -1 if it would run past end.
+static long RecordSize(const PlyElement& e, const char* r, const char* end)
+{
+    if (e.stride >= 0) return e.stride;
+    const char* p = r;
+    for (size_t k=0;  k<e.props.size();  k++) {
+        const PlyProperty& prop = e.props[k];
+        if (prop.countType == PlyNone) {
+            p += TypeSize(prop.type);
+            continue; }
+        if (p + TypeSize(prop.countType) > end) return -1;
+        int n = ReadInt(p, prop.countType);
+        if (n < 0) return -1;
+        p += TypeSize(prop.countType) + (size_t)n*TypeSize(prop.type); }
+    return p > end ? -1 : p - r;
+}
+
+// Decodes the face element, splitting polygons into fans exactly as
+// Ply::face_cb does for triangles and quads.  Returns the end of the
+// element's records, or NULL on a malformed file.
+static const char* DecodeFaces(const PlyElement& e, const char* base, const char* end, Shape* shape)
+{
+    int k = e.Find("vertex_indices");
+    if (k < 0) k = e.Find("vertex_index");
+    if (k < 0 || e.props[k].countType == PlyNone) return NULL;
+    const PlyProperty& list = e.props[k];
+    int countSize = TypeSize(list.countType);
+    int indexSize = TypeSize(list.type);
+
+    // Triangle-only files have a fixed record size when the index list
+    // is the only list.  Verify every count, then decode in parallel.
+    int fixed = 0, lists = 0, listAt = 0;
+    for (size_t j=0;  j<e.props.size();  j++) {
+        if (e.props[j].countType == PlyNone) fixed += TypeSize(e.props[j].type);
+        else { lists++;  listAt = fixed; } }
+    size_t stride = fixed + countSize + 3*indexSize;
+    bool triangles = lists == 1 && (size_t)(end-base) >= e.count*stride;
+    for (size_t f=0;  triangles && f<e.count;  f++)
+        triangles = ReadInt(base + f*stride + listAt, list.countType) == 3;
+
+    if (triangles) {
+        shape->Tri.resize(e.count);
+        Workers().ParallelFor((int)e.count, [&](int f0, int f1) {
+            for (int f=f0;  f<f1;  f++) {
+                const char* r = base + (size_t)f*stride + listAt + countSize;
+                glm::ivec3& t = shape->Tri[f];
+                if (list.type == PlyInt32 || list.type == PlyUint32)
+                    memcpy(&t[0], r, 12);
+                else
+                    for (int c=0;  c<3;  c++) t[c] = ReadInt(r + c*indexSize, list.type); } },
+            8192);
+        return base + e.count*stride; }
+
+    // General polygons: walk the records serially.
+    const char* r = base;
+    shape->Tri.reserve(e.count);
+    for (size_t f=0;  f<e.count;  f++) {
+        long size = RecordSize(e, r, end);
+        if (size < 0) return NULL;
+        const char* p = r;
+        for (int j=0;  j<k;  j++)
+            p += e.props[j].countType == PlyNone ? TypeSize(e.props[j].type)
+                : countSize + (size_t)ReadInt(p, e.props[j].countType)*TypeSize(e.props[j].type);
+        int n = ReadInt(p, list.countType);
+        p += countSize;
+        int v[4];
+        for (int i=0;  i<n && i<4;  i++)
+            v[i] = ReadInt(p + i*indexSize, list.type);
+        PushFace(shape->Tri, v, n);
+        r += size; }
+    return r;
+}
+
+static bool ReadBinary(const PlyHeader& header, const char* p, const char* end, Shape* shape)
+{
+    bool haveVertices = false;
+    for (size_t i=0;  i<header.elements.size();  i++) {
+        const PlyElement& e = header.elements[i];
+        if (e.name == "vertex") {
+            if (!DecodeVertices(e, p, end, shape)) return false;
+            haveVertices = true;
+            p += e.count*e.stride; }
+        else if (e.name == "face") {
+            p = DecodeFaces(e, p, end, shape);
+            if (!p) return false; }
+        else {
+            // Skip elements we don't use
+            for (size_t r=0;  r<e.count;  r++) {
+                long size = RecordSize(e, p, end);
+                if (size < 0) return false;
+                p += size; } } }
+    return haveVertices;
+}
+
+////////////////////////////////////////////////////////////////////////
+// ASCII
+
+// Powers of ten that are exact in a double.
+static const double exact10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+static inline bool IsSpace(const char c) { return c == ' ' || c == '\t' || c == '\r'; }
+static inline bool IsDigit(const char c) { return c >= '0' && c <= '9'; }
+
+static inline void SkipSpace(const char*& p, const char* end)
+{
+    while (p < end && IsSpace(*p)) p++;
+}
+
+// Parses a decimal number at p, which must be followed by white space
+// or the end of the line, and advances p past it.  A significand of at
+// most 19 digits below 2^53 with a power of ten within 22 gives a
+// correctly rounded result from one multiply or divide (Clinger's fast
+// path), so this matches strtod exactly;  anything else (long
+// significands, huge exponents, inf, nan) is handed to strtod.
+static bool ParseDouble(const char*& p, const char* end, double& value)
+{
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    uint64_t m = 0;
+    int digits = 0, exp10 = 0;
+    bool any = false, exact = true;
+    for (;  p < end && IsDigit(*p);  p++) {
+        any = true;
+        if (m == 0 && *p == '0') continue;
+        if (++digits > 19) exact = false;
+        else m = m*10 + (*p - '0'); }
+    if (p < end && *p == '.') {
+        for (p++;  p < end && IsDigit(*p);  p++) {
+            any = true;
+            if (m == 0 && *p == '0') { exp10--;  continue; }
+            if (++digits > 19) exact = false;
+            else { m = m*10 + (*p - '0');  exp10--; } } }
+    if (any && p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negExp = false;
+        if (p < end && (*p == '-' || *p == '+')) negExp = *p++ == '-';
+        if (p == end || !IsDigit(*p)) exact = false;
+        int e = 0;
+        for (;  p < end && IsDigit(*p);  p++)
+            if (e < 10000) e = e*10 + (*p - '0');
+        exp10 += negExp ? -e : e; }
+
+    if (any && exact && (p == end || IsSpace(*p) || *p == '\n')
+        && m < (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+        double v = (double)m;
+        v = exp10 < 0 ? v/exact10[-exp10] : v*exact10[exp10];
+        value = negative ? -v : v;
+        return true; }
+
+    // Slow path: strtod on a terminated copy of the token
+    p = start;
+    while (p < end && !IsSpace(*p) && *p != '\n') p++;
+    char word[128];
+    size_t length = p - start;
+    if (length == 0 || length >= sizeof(word)) return false;
+    memcpy(word, start, length);
+    word[length] = 0;
+    char* stop;
+    value = strtod(word, &stop);
+    return *stop == 0;
+}
+
+// Parses an integer token (as strtol would) and advances p past it.
+static bool ParseInt(const char*& p, const char* end, long& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p == end || !IsDigit(*p)) return false;
+    long v = 0;
+    for (;  p < end && IsDigit(*p);  p++)
+        v = v*10 + (*p - '0');
+    value = negative ? -v : v;
+    return p == end || IsSpace(*p) || *p == '\n';
+}
+
+// Parses one property value of the given type.
+static bool ParseValue(const char*& p, const char* end, const PlyType type, double& value)
+{
+    SkipSpace(p, end);
+    if (type == PlyFloat32 || type == PlyFloat64)
+        return ParseDouble(p, end, value);
+    long v;
+    if (!ParseInt(p, end, v)) return false;
+    value = (double)v;
+    return true;
+}
+
+// Returns the end of the line starting at p (its '\n', or end), and
+// whether it holds anything but white space.
+static const char* LineEnd(const char* p, const char* end, bool& blank)
+{
+    const char* e = (const char*)memchr(p, '\n', end-p);
+    if (!e) e = end;
+    while (p < e && IsSpace(*p)) p++;
+    blank = p == e;
+    return e;
+}
+
+// Parses one vertex line into vertex i.
+static bool ParseVertex(const PlyElement& e, const int slots[8], const char* p, const char* end,
+                        const size_t i, Shape* shape)
+{
+    double values[8] = {0.0};
+    for (size_t k=0;  k<e.props.size();  k++) {
+        const PlyProperty& prop = e.props[k];
+        double v;
+        int n = 1;
+        if (prop.countType != PlyNone) {
+            if (!ParseValue(p, end, prop.countType, v)) return false;
+            n = (int)v; }
+        for (int j=0;  j<n;  j++)
+            if (!ParseValue(p, end, prop.type, v)) return false;
+        for (int s=0;  s<8;  s++)
+            if (slots[s] == (int)k) values[s] = v; }
+    SkipSpace(p, end);
+    if (p != end) return false;
+
+    shape->Pnt[i] = glm::vec4(values[0], values[1], values[2], 1.0);
+    if (!shape->Nrm.empty()) shape->Nrm[i] = glm::vec3(values[3], values[4], values[5]);
+    if (!shape->Tex.empty()) shape->Tex[i] = glm::vec2(values[6], values[7]);
+    return true;
+}
+
+// Parses one face line, appending its triangles to Tri.
+static bool ParseFace(const PlyElement& e, const int list, const char* p, const char* end,
+                      std::vector<glm::ivec3>& Tri)
+{
+    int v[4];
+    int count = 0;
+    for (size_t k=0;  k<e.props.size();  k++) {
+        const PlyProperty& prop = e.props[k];
+        double value;
+        int n = 1;
+        if (prop.countType != PlyNone) {
+            if (!ParseValue(p, end, prop.countType, value)) return false;
+            n = (int)value; }
+        for (int j=0;  j<n;  j++) {
+            if (!ParseValue(p, end, prop.type, value)) return false;
+            if ((int)k == list && j < 4) v[j] = (int)value; }
+        if ((int)k == list) count = n; }
+    SkipSpace(p, end);
+    if (p != end) return false;
+    PushFace(Tri, v, count);
+    return true;
+}
+
+static bool ReadAscii(const PlyHeader& header, const char* body, const char* end, Shape* shape)
+{
+    // Each element's records are consecutive non-blank lines.
+    int vertex = -1, face = -1, faceList = -1;
+    int slots[8];
+    std::vector<size_t> firstLine(header.elements.size()+1, 0);
+    for (size_t i=0;  i<header.elements.size();  i++) {
+        const PlyElement& e = header.elements[i];
+        if (e.name == "vertex") vertex = i;
+        if (e.name == "face") face = i;
+        firstLine[i+1] = firstLine[i] + e.count; }
+    if (vertex < 0 || !VertexSlots(header.elements[vertex], slots)) return false;
+    if (face >= 0) {
+        faceList = header.elements[face].Find("vertex_indices");
+        if (faceList < 0) faceList = header.elements[face].Find("vertex_index");
+        if (faceList < 0) return false; }
+
+    // Split the body into line-aligned chunks of about a megabyte.
+    std::vector<const char*> chunk(1, body);
+    while (chunk.back() < end) {
+        const char* c = std::min(chunk.back() + (1<<20), end);
+        const char* nl = c < end ? (const char*)memchr(c, '\n', end-c) : NULL;
+        chunk.push_back(nl ? nl+1 : end); }
+    int chunks = chunk.size() - 1;
+
+    // Pass 1: count records per chunk to find each chunk's first line.
+    std::vector<size_t> lines(chunks+1, 0);
+    Workers().ParallelFor(chunks, [&](int c0, int c1) {
+        for (int c=c0;  c<c1;  c++) {
+            size_t count = 0;
+            for (const char* p=chunk[c];  p<chunk[c+1];  ) {
+                bool blank;
+                const char* e = LineEnd(p, chunk[c+1], blank);
+                if (!blank) count++;
+                p = e+1; }
+            lines[c+1] = count; } });
+    for (int c=0;  c<chunks;  c++)
+        lines[c+1] += lines[c];
+    if (lines[chunks] < firstLine.back()) return false;
+
+    // Pass 2: parse.  Vertices go straight to their slot;  faces are
+    // collected per chunk and concatenated in order afterwards.
+    const PlyElement& ve = header.elements[vertex];
+    VertexResize(shape, ve.count, slots[3]>=0 && slots[4]>=0 && slots[5]>=0,
+                 slots[6]>=0 && slots[7]>=0);
+    std::vector<std::vector<glm::ivec3> > tris(chunks);
+    std::atomic<bool> ok(true);
+    Workers().ParallelFor(chunks, [&](int c0, int c1) {
+        for (int c=c0;  c<c1 && ok;  c++) {
+            size_t line = lines[c];
+            for (const char* p=chunk[c];  p<chunk[c+1] && line<firstLine.back();  ) {
+                bool blank;
+                const char* e = LineEnd(p, chunk[c+1], blank);
+                if (!blank) {
+                    bool good = true;
+                    if (line >= firstLine[vertex] && line < firstLine[vertex+1])
+                        good = ParseVertex(ve, slots, p, e, line - firstLine[vertex], shape);
+                    else if (face >= 0 && line >= firstLine[face] && line < firstLine[face+1])
+                        good = ParseFace(header.elements[face], faceList, p, e, tris[c]);
+                    if (!good) { ok = false;  return; }
+                    line++; }
+                p = e+1; } } });
+    if (!ok) return false;
+
+    size_t total = 0;
+    for (int c=0;  c<chunks;  c++) total += tris[c].size();
+    shape->Tri.reserve(total);
+    for (int c=0;  c<chunks;  c++)
+        shape->Tri.insert(shape->Tri.end(), tris[c].begin(), tris[c].end());
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+bool ReadPlyFast(const std::string& path, Shape* shape)
+{
+    MappedFile file(path);
+    if (!file.Valid()) return false;
+
+    PlyHeader header;
+    if (!header.Parse(file.data, file.size)) return false;
+
+    const char* body = file.data + header.body;
+    const char* end = file.data + file.size;
+    bool ok = false;
+    if (header.format == PlyBinaryLE)
+        ok = ReadBinary(header, body, end, shape);
+    else if (header.format == PlyAscii)
+        ok = ReadAscii(header, body, end, shape);
+
+    for (size_t t=0;  ok && t<shape->Tri.size();  t++)
+        for (int c=0;  c<3;  c++)
+            if (shape->Tri[t][c] < 0 || shape->Tri[t][c] >= (int)shape->Pnt.size()) ok = false;
+
+    if (!ok) {
+        shape->Pnt.clear();  shape->Nrm.clear();  shape->Tex.clear();
+        shape->Tan.clear();  shape->Tri.clear();
+        return false; }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Point streaming
+
+// Finds the color properties (red,green,blue or r,g,b), -1 if missing.
+static void ColorSlots(const PlyElement& e, int slots[3])
+{
+    const char* names[3] = {"red", "green", "blue"};
+    const char* shortNames[3] = {"r", "g", "b"};
+    for (int i=0;  i<3;  i++) {
+        slots[i] = e.Find(names[i]);
+        if (slots[i] < 0) slots[i] = e.Find(shortNames[i]); }
+}
+
+// Fills a PlyPoint from the values of the properties in slots (x,y,z,
+// nx,ny,nz, then red,green,blue), scaling float colors from [0,1].
+static void MakePoint(const double v[9], const bool hasN, const bool hasC, const bool floatC,
+                      PlyPoint& point)
+{
+    for (int c=0;  c<3;  c++) {
+        point.P[c] = v[c];
+        point.N[c] = hasN ? (float)v[3+c] : 0.0f;
+        double k = floatC ? 255.0*v[6+c] : v[6+c];
+        point.C[c] = hasC ? (unsigned char)std::min(std::max(k + (floatC ? 0.5 : 0.0), 0.0), 255.0) : 255; }
+}
+
+bool ReadPlyPoints(const std::string& path,
+                   const std::function<void(const PlyPoint* points, const size_t n)>& visit,
+                   const size_t batch)
+{
+    MappedFile file(path);
+    if (!file.Valid()) return false;
+    PlyHeader header;
+    if (!header.Parse(file.data, file.size)) return false;
+    if (header.format == PlyBinaryBE) return false;
+
+    const char* p = file.data + header.body;
+    const char* end = file.data + file.size;
+    size_t line = 0;
+    int vertex = -1;
+    for (size_t i=0;  i<header.elements.size() && vertex < 0;  i++) {
+        const PlyElement& e = header.elements[i];
+        if (e.name == "vertex") { vertex = i;  break; }
+        if (header.format == PlyAscii) { line += e.count;  continue; }
+        for (size_t r=0;  r<e.count;  r++) {
+            long size = RecordSize(e, p, end);
+            if (size < 0) return false;
+            p += size; } }
+    if (vertex < 0) return false;
+
+    const PlyElement& e = header.elements[vertex];
+    int slots[9];
+    if (!VertexSlots(e, slots)) return false;
+    ColorSlots(e, slots+6);     // Colors replace s,t, which points don't use
+    bool hasN = slots[3] >= 0 && slots[4] >= 0 && slots[5] >= 0;
+    bool hasC = slots[6] >= 0 && slots[7] >= 0 && slots[8] >= 0;
+    bool floatC = hasC && (e.props[slots[6]].type == PlyFloat32 || e.props[slots[6]].type == PlyFloat64);
+
+    std::vector<PlyPoint> points(batch);
+    if (header.format == PlyBinaryLE) {
+        if (e.stride <= 0 || (size_t)(end-p)/e.stride < e.count) return false;
+        for (size_t first=0;  first<e.count;  first+=batch) {
+            int n = (int)std::min(batch, e.count-first);
+            Workers().ParallelFor(n, [&](int i0, int i1) {
+                for (int i=i0;  i<i1;  i++) {
+                    const char* r = p + (first+i)*e.stride;
+                    double v[9] = {0.0};
+                    for (int s=0;  s<9;  s++)
+                        if (slots[s] >= 0) v[s] = ReadScalar(r + e.props[slots[s]].offset, e.props[slots[s]].type);
+                    MakePoint(v, hasN, hasC, floatC, points[i]); } }, 4096);
+            visit(&points[0], n); }
+        return true; }
+
+    // ASCII:  skip to the vertex lines, then parse them serially.
+    size_t n = 0, done = 0;
+    while (p < end && done < e.count) {
+        bool blank;
+        const char* eol = LineEnd(p, end, blank);
+        if (!blank && line > 0) line--;
+        else if (!blank) {
+            double v[9] = {0.0};
+            const char* q = p;
+            for (size_t k=0;  k<e.props.size();  k++) {
+                const PlyProperty& prop = e.props[k];
+                double value;
+                int count = 1;
+                if (prop.countType != PlyNone) {
+                    if (!ParseValue(q, eol, prop.countType, value)) return false;
+                    count = (int)value; }
+                for (int j=0;  j<count;  j++)
+                    if (!ParseValue(q, eol, prop.type, value)) return false;
+                for (int s=0;  s<9;  s++)
+                    if (slots[s] == (int)k) v[s] = value; }
+            MakePoint(v, hasN, hasC, floatC, points[n++]);
+            done++;
+            if (n == batch) { visit(&points[0], n);  n = 0; } }
+        p = eol+1; }
+    if (n > 0) visit(&points[0], n);
+    return done == e.count;
+}
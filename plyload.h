@@ -0,0 +1,42 @@
+////////////////////////////////////////////////////////////////////////
+// Fast PLY loading.  rply hands every scalar of every vertex to a
+// callback, which is fine for small models but slow for scanned
+// meshes with millions of vertices.  ReadPlyFast memory-maps the file,
+// parses the header itself, and decodes the vertex and face elements
+// in bulk straight into a Shape's preallocated data arrays.
+//
+// ASCII and binary_little_endian files are handled here;  for
+// anything else (or records split across lines in an ASCII file)
+// ReadPlyFast returns false and the caller falls back to rply.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _PLYLOAD_
+#define _PLYLOAD_
+
+#include <string>
+#include <functional>
+
+class Shape;
+
+// Fills shape->Pnt/Nrm/Tex/Tan/Tri from the PLY file at path, exactly
+// as the rply callbacks in Ply would.  Returns false (leaving the
+// arrays empty) if the file's format is not one handled here.
+bool ReadPlyFast(const std::string& path, Shape* shape);
+
+// One vertex of a point cloud, as streamed by ReadPlyPoints.
+struct PlyPoint
+{
+    double P[3];                // Scans often use large (geographic) coordinates
+    float N[3];                 // Normal, or zero if the file has none
+    unsigned char C[3];         // Color, or white if the file has none
+};
+
+// Streams the vertex element of an ASCII or binary_little_endian file
+// to visit, in file order, in batches of at most batch points.  Only
+// one batch is held in memory, whatever the size of the file.  Faces
+// are ignored.  Returns false if the file can't be read this way.
+bool ReadPlyPoints(const std::string& path,
+                   const std::function<void(const PlyPoint* points, const size_t n)>& visit,
+                   const size_t batch=65536);
+
+#endif
@@ -0,0 +1,457 @@
+////////////////////////////////////////////////////////////////////////
+// Out-of-core point clouds:  octree preprocessing and chunk streaming.
+//
+// The octree is built in four streaming passes over the PLY file:
+// bounds, an occupancy count on a fixed 128^3 grid, a count of the
+// points each node receives, and finally the points themselves
+// written to their nodes' places in the output.  The grid decides the
+// octree's shape (a node splits while its subtree holds more than
+// nodePoints points).  Each point then goes to the shallowest node on
+// its path for which a per-point random number falls below nodePoints
+// divided by that node's subtree count, so every node keeps an even
+// subsample of about nodePoints of the points below it.
+////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <thread>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <float.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "math.h"
+#include "pointcloud.h"
+#include "plyload.h"
+#include "mapfile.h"
+#include "filecache.h"
+#include "workers.h"
+
+#include <glu.h>                // For gluErrorString
+#define CHECKERROR {GLenum err = glGetError(); if (err != GL_NO_ERROR) { fprintf(stderr, "OpenGL error (at line pointcloud.cpp:%d): %s\n", __LINE__, gluErrorString(err)); exit(-1);} }
+
+static const char cloudMagic[4] = {'P', 'N', 'T', 'S'};
+static const uint32_t cloudVersion = 1;
+static const int gridDepth = 7;             // Occupancy grid of 128^3 cells
+static const uint32_t nodePoints = 65536;   // Target points per node
+static const size_t writeBuffer = 256;      // Points buffered per node while writing
+
+// Start of the octree file's payload, followed by the nodes (in
+// breadth first order) and then the points of each node in turn.
+struct CloudHeader
+{
+    double origin[3];           // Center of the scan's bounds
+    float minP[3], maxP[3];     // Bounds relative to origin
+    uint64_t points;
+    uint32_t nodes;
+    uint32_t nodePoints;
+};
+
+// A point's random number in [0,1), from its index in the file.
+static double Uniform(uint64_t i)
+{
+    i += 0x9E3779B97F4A7C15ULL;
+    i = (i ^ (i >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    i = (i ^ (i >> 27)) * 0x94D049BB133111EBULL;
+    i ^= i >> 31;
+    return (i >> 11) * (1.0/9007199254740992.0);
+}
+
+struct OctreeBuilder
+{
+    CloudHeader header;
+    double half;                                // Root cube half edge
+    std::vector<std::vector<uint64_t> > levels; // Occupancy per level, (2^d)^3 cells each
+    std::vector<PointNode> nodes;
+    std::vector<uint64_t> subtree;              // Points in each node's subtree
+
+    void Cell(const double P[3], int cell[3]) const {
+        int g = 1 << gridDepth;
+        for (int c=0;  c<3;  c++) {
+            int i = (int)floor((P[c] - header.origin[c] + half)/(2.0*half)*g);
+            cell[c] = std::min(std::max(i, 0), g-1); } }
+
+    size_t Index(const int d, const int x, const int y, const int z) const {
+        size_t g = (size_t)1 << d;
+        return (x*g + y)*g + z; }
+
+    // The node a point in the given grid cell (with index i) belongs to.
+    int Assign(const int cell[3], const uint64_t i) const {
+        double u = Uniform(i);
+        int n = 0;
+        for (int d=0;  ;  d++) {
+            const PointNode& node = nodes[n];
+            if (node.children[0] == -2 || u*subtree[n] < nodePoints) return n;
+            int b = gridDepth-1-d;
+            int k = ((cell[0]>>b)&1) | ((cell[1]>>b)&1)<<1 | ((cell[2]>>b)&1)<<2;
+            n = node.children[k]; } }
+
+    void BuildNodes();
+};
+
+// Lays out the octree breadth first from the occupancy levels.  Leaves
+// are marked with children[0] == -2 until the end.
+void OctreeBuilder::BuildNodes()
+{
+    struct Pending { int d, x, y, z; };
+    std::vector<Pending> cells;
+    cells.push_back(Pending{0, 0, 0, 0});
+    for (size_t n=0;  n<cells.size();  n++) {
+        Pending c = cells[n];
+        PointNode node;
+        float h = (float)(half/(1 << c.d));
+        node.center[0] = (float)(-half + (2*c.x+1)*h);
+        node.center[1] = (float)(-half + (2*c.y+1)*h);
+        node.center[2] = (float)(-half + (2*c.z+1)*h);
+        node.half = h;
+        node.depth = c.d;
+        node.count = 0;
+        node.first = 0;
+        uint64_t count = levels[c.d][Index(c.d, c.x, c.y, c.z)];
+        bool split = count > nodePoints && c.d < gridDepth;
+        for (int k=0;  k<8;  k++) {
+            node.children[k] = split ? -1 : -2;
+            if (!split) continue;
+            int x = 2*c.x + (k&1), y = 2*c.y + ((k>>1)&1), z = 2*c.z + ((k>>2)&1);
+            if (levels[c.d+1][Index(c.d+1, x, y, z)] == 0) continue;
+            node.children[k] = (int)cells.size();
+            cells.push_back(Pending{c.d+1, x, y, z}); }
+        nodes.push_back(node);
+        subtree.push_back(count); }
+}
+
+bool BuildPointOctree(const std::string& path, const std::string& out)
+{
+    OctreeBuilder b;
+    CloudHeader& h = b.header;
+    printf("Building point octree for %s\n", path.c_str());
+
+    // Pass 1:  bounds
+    double lo[3] = {DBL_MAX, DBL_MAX, DBL_MAX}, hi[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+    uint64_t total = 0;
+    bool ok = ReadPlyPoints(path, [&](const PlyPoint* p, const size_t n) {
+            for (size_t i=0;  i<n;  i++)
+                for (int c=0;  c<3;  c++) {
+                    lo[c] = std::min(lo[c], p[i].P[c]);
+                    hi[c] = std::max(hi[c], p[i].P[c]); }
+            total += n; });
+    if (!ok || total == 0) { printf("  can't read points from %s\n", path.c_str());  return false; }
+    b.half = 0.0;
+    for (int c=0;  c<3;  c++) {
+        h.origin[c] = (lo[c] + hi[c])/2.0;
+        h.minP[c] = (float)(lo[c] - h.origin[c]);
+        h.maxP[c] = (float)(hi[c] - h.origin[c]);
+        b.half = std::max(b.half, (hi[c] - lo[c])/2.0); }
+    b.half = std::max(b.half*1.0001, 1e-6);
+    h.points = total;
+    h.nodePoints = nodePoints;
+    printf("  %llu points\n", (unsigned long long)total);
+
+    // Pass 2:  occupancy on the finest grid, then summed up the levels.
+    b.levels.resize(gridDepth+1);
+    for (int d=0;  d<=gridDepth;  d++)
+        b.levels[d].assign((size_t)1 << (3*d), 0);
+    ReadPlyPoints(path, [&](const PlyPoint* p, const size_t n) {
+            int cell[3];
+            for (size_t i=0;  i<n;  i++) {
+                b.Cell(p[i].P, cell);
+                b.levels[gridDepth][b.Index(gridDepth, cell[0], cell[1], cell[2])]++; } });
+    for (int d=gridDepth-1;  d>=0;  d--) {
+        int g = 1 << d;
+        for (int x=0;  x<g;  x++)
+            for (int y=0;  y<g;  y++)
+                for (int z=0;  z<g;  z++) {
+                    uint64_t sum = 0;
+                    for (int k=0;  k<8;  k++)
+                        sum += b.levels[d+1][b.Index(d+1, 2*x+(k&1), 2*y+((k>>1)&1), 2*z+((k>>2)&1))];
+                    b.levels[d][b.Index(d, x, y, z)] = sum; } }
+    b.BuildNodes();
+    std::vector<std::vector<uint64_t> >().swap(b.levels);
+    h.nodes = b.nodes.size();
+    printf("  %d octree nodes\n", (int)h.nodes);
+
+    // Pass 3:  points per node, which places each node's points in the file.
+    uint64_t index = 0;
+    ReadPlyPoints(path, [&](const PlyPoint* p, const size_t n) {
+            int cell[3];
+            for (size_t i=0;  i<n;  i++, index++) {
+                b.Cell(p[i].P, cell);
+                b.nodes[b.Assign(cell, index)].count++; } });
+    uint64_t first = 0;
+    for (size_t n=0;  n<b.nodes.size();  n++) {
+        b.nodes[n].first = first;
+        first += b.nodes[n].count; }
+
+    // Pass 4:  the points, through small per-node buffers.
+    uint64_t pointsAt = sizeof(CloudHeader) + b.nodes.size()*sizeof(PointNode);
+    CacheWriter writer;
+    if (!writer.Open(out, pointsAt + total*sizeof(PointRecord))) return false;
+    std::vector<std::vector<PointRecord> > buffers(b.nodes.size());
+    std::vector<uint64_t> written(b.nodes.size(), 0);
+    index = 0;
+    ok = true;
+    ReadPlyPoints(path, [&](const PlyPoint* p, const size_t n) {
+            int cell[3];
+            for (size_t i=0;  i<n;  i++, index++) {
+                b.Cell(p[i].P, cell);
+                int k = b.Assign(cell, index);
+                PointRecord r;
+                for (int c=0;  c<3;  c++) {
+                    r.P[c] = (float)(p[i].P[c] - h.origin[c]);
+                    r.C[c] = p[i].C[c];
+                    r.N[c] = (signed char)floor(std::min(std::max(p[i].N[c], -1.0f), 1.0f)*127.0f + 0.5f); }
+                r.C[3] = 255;
+                r.N[3] = 0;
+                std::vector<PointRecord>& buffer = buffers[k];
+                buffer.push_back(r);
+                if (buffer.size() == writeBuffer) {
+                    uint64_t at = pointsAt + (b.nodes[k].first + written[k])*sizeof(PointRecord);
+                    ok = writer.Write(at, &buffer[0], buffer.size()*sizeof(PointRecord)) && ok;
+                    written[k] += buffer.size();
+                    buffer.clear(); } } });
+    for (size_t k=0;  k<b.nodes.size();  k++) {
+        if (buffers[k].empty()) continue;
+        uint64_t at = pointsAt + (b.nodes[k].first + written[k])*sizeof(PointRecord);
+        ok = writer.Write(at, &buffers[k][0], buffers[k].size()*sizeof(PointRecord)) && ok; }
+
+    for (size_t n=0;  n<b.nodes.size();  n++)
+        if (b.nodes[n].children[0] == -2)
+            for (int k=0;  k<8;  k++) b.nodes[n].children[k] = -1;
+    ok = ok && writer.Write(0, &h, sizeof(h));
+    ok = ok && writer.Write(sizeof(h), &b.nodes[0], b.nodes.size()*sizeof(PointNode));
+    return writer.Close(cloudMagic, cloudVersion) && ok;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Streaming
+
+PointCloud::PointCloud(const std::string& path, const size_t _budget, const float _pointSize,
+                       const int _uploadsPerFrame)
+    : budget(_budget), pointSize(_pointSize), uploadsPerFrame(_uploadsPerFrame),
+      file(NULL), nodes(NULL), points(NULL), nodeCount(0), residentBytes(0),
+      frame(0), inFlight(0), jobs(0)
+{
+    diffuseColor = glm::vec3(1.0, 1.0, 1.0);
+    specularColor = glm::vec3(0.0, 0.0, 0.0);
+    shininess = 1.0;
+    maxInFlight = 2*(Workers().Size()+1);
+    modelTr = glm::mat4();
+    count = 0;
+    for (int c=0;  c<3;  c++) origin[c] = 0.0;
+    minP = maxP = center = glm::vec3(0.0f);
+    size = 1.0f;
+
+    // The octree is cached, keyed by the scan's size and date.
+    uint64_t key = HashFileStamp(path, Hash64("point octree"));
+    std::string out = CachePath("points" + HashName(key) + ".bin");
+    for (int attempt=0;  attempt<2 && !nodes;  attempt++) {
+        if (attempt == 1 && !BuildPointOctree(path, out)) break;
+        delete file;
+        file = new MappedFile(out);
+        size_t length;
+        const char* payload = MappedCache(*file, cloudMagic, cloudVersion, length);
+        if (!payload || length < sizeof(CloudHeader)) continue;
+        CloudHeader h;
+        memcpy(&h, payload, sizeof(h));
+        size_t pointsAt = sizeof(h) + (size_t)h.nodes*sizeof(PointNode);
+        if (h.nodes == 0 || length < pointsAt || (length - pointsAt)/sizeof(PointRecord) < h.points)
+            continue;
+        nodes = (const PointNode*)(payload + sizeof(h));
+        points = (const PointRecord*)(payload + pointsAt);
+        nodeCount = h.nodes;
+        for (int c=0;  c<3;  c++) origin[c] = h.origin[c];
+        minP = glm::vec3(h.minP[0], h.minP[1], h.minP[2]);
+        maxP = glm::vec3(h.maxP[0], h.maxP[1], h.maxP[2]);
+        center = (minP + maxP)/2.0f;
+        size = std::max(nodes[0].half, 1e-6f); }
+
+    if (!nodes) printf("PointCloud: can't load %s\n", path.c_str());
+    chunks.resize(nodeCount);
+    for (int n=0;  n<nodeCount;  n++) {
+        chunks[n].vaoID = chunks[n].bufferID = 0;
+        chunks[n].loading = false;
+        chunks[n].lastUsed = -1; }
+}
+
+PointCloud::~PointCloud()
+{
+    // Reads still running write into chunks owned here, so wait them out.
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(doneLock);
+            if (jobs == 0) break;
+        }
+        std::this_thread::yield(); }
+
+    for (int n=0;  n<nodeCount;  n++)
+        Release(n);
+    delete file;
+}
+
+// Runs on a worker thread:  copies a node's points out of the mapping,
+// so any disk reads happen here rather than in the frame.
+void PointCloud::Load(const int node)
+{
+    const PointRecord* p = points + nodes[node].first;
+    chunks[node].staged.assign(p, p + nodes[node].count);
+
+    std::unique_lock<std::mutex> guard(doneLock);
+    done.push_back(node);
+    jobs--;
+}
+
+void PointCloud::Release(const int node)
+{
+    Chunk& chunk = chunks[node];
+    if (!chunk.vaoID) return;
+    glDeleteVertexArrays(1, &chunk.vaoID);
+    glDeleteBuffers(1, &chunk.bufferID);
+    chunk.vaoID = chunk.bufferID = 0;
+    residentBytes -= (size_t)nodes[node].count*sizeof(PointRecord);
+}
+
+// Sends a staged chunk to the graphics card, first evicting chunks not
+// wanted this frame (least recently used first) to stay in budget.
+bool PointCloud::Upload(const int node, const std::vector<int>& wanted)
+{
+    Chunk& chunk = chunks[node];
+    size_t bytes = chunk.staged.size()*sizeof(PointRecord);
+    if (residentBytes + bytes > budget) {
+        std::vector<bool> keep(nodeCount, false);
+        for (size_t i=0;  i<wanted.size();  i++) keep[wanted[i]] = true;
+        std::vector<std::pair<int,int> > old;      // (lastUsed, node)
+        for (int n=0;  n<nodeCount;  n++)
+            if (chunks[n].vaoID && !keep[n]) old.push_back(std::make_pair(chunks[n].lastUsed, n));
+        std::sort(old.begin(), old.end());
+        for (size_t i=0;  i<old.size() && residentBytes + bytes > budget;  i++)
+            Release(old[i].second);
+        if (residentBytes + bytes > budget) return false; }
+
+    glGenVertexArrays(1, &chunk.vaoID);
+    glBindVertexArray(chunk.vaoID);
+    glGenBuffers(1, &chunk.bufferID);
+    glBindBuffer(GL_ARRAY_BUFFER, chunk.bufferID);
+    glBufferData(GL_ARRAY_BUFFER, bytes, &chunk.staged[0], GL_STATIC_DRAW);
+    int stride = sizeof(PointRecord);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(PointRecord, P));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_BYTE, GL_TRUE, stride, (void*)offsetof(PointRecord, N));
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 3, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*)offsetof(PointRecord, C));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    CHECKERROR;
+
+    residentBytes += bytes;
+    std::vector<PointRecord>().swap(chunk.staged);
+    return true;
+}
+
+// Called once per frame.  Walks the octree from the root, most
+// visible error first, choosing nodes until their points fill the
+// budget.  A node's error is how far apart (in pixels) the points
+// drawn there would be without its children.
+void PointCloud::Update(const glm::mat4& WorldProj, const glm::mat4& ModelView, const int viewHeight)
+{
+    if (!nodeCount) return;
+    frame++;
+
+    // Collect chunks read by the workers.
+    {
+        std::unique_lock<std::mutex> guard(doneLock);
+        for (size_t i=0;  i<done.size();  i++) {
+            chunks[done[i]].loading = false;
+            inFlight--; }
+        done.clear();
+    }
+
+    // Frustum planes in the cloud's own coordinates.
+    glm::mat4 M = WorldProj*ModelView;
+    glm::vec4 planes[6];
+    for (int i=0;  i<3;  i++) {
+        glm::vec4 row(M[0][i], M[1][i], M[2][i], M[3][i]);
+        glm::vec4 w(M[0][3], M[1][3], M[2][3], M[3][3]);
+        planes[2*i] = w + row;
+        planes[2*i+1] = w - row; }
+    float scale = glm::length(glm::vec3(ModelView[0]));
+    float pixels = WorldProj[1][1]*viewHeight/2.0f;     // Per unit length at unit distance
+
+    std::priority_queue<std::pair<float,int> > open;
+    open.push(std::make_pair(FLT_MAX, 0));
+    std::vector<int> wanted;
+    size_t bytes = 0;
+    while (!open.empty()) {
+        int n = open.top().second;
+        open.pop();
+        const PointNode& node = nodes[n];
+        size_t b = (size_t)node.count*sizeof(PointRecord);
+        if (bytes + b > budget) continue;
+        bytes += b;
+        wanted.push_back(n);
+
+        // Spacing of the points this node adds, as seen from its children.
+        float spacing = scale*2.0f*node.half/sqrtf((float)std::max(node.count, 1u));
+        for (int k=0;  k<8;  k++) {
+            int c = node.children[k];
+            if (c < 0) continue;
+            glm::vec4 C(nodes[c].center[0], nodes[c].center[1], nodes[c].center[2], 1.0f);
+            float radius = 1.7321f*nodes[c].half;
+            bool inside = true;
+            for (int p=0;  p<6 && inside;  p++)
+                inside = glm::dot(planes[p], C) > -radius*glm::length(glm::vec3(planes[p]));
+            if (!inside) continue;
+            float distance = std::max(glm::length((ModelView*C).xyz()) - scale*radius, 1e-3f);
+            float error = spacing*pixels/distance;
+            if (error > pointSize)
+                open.push(std::make_pair(error, c)); } }
+
+    // Draw what's resident, read what's missing (most important first),
+    // and upload a few of the chunks already read.
+    visible.clear();
+    std::vector<bool> want(nodeCount, false);
+    int uploads = 0;
+    for (size_t i=0;  i<wanted.size();  i++) {
+        int n = wanted[i];
+        Chunk& chunk = chunks[n];
+        want[n] = true;
+        if (nodes[n].count == 0) continue;
+        if (!chunk.vaoID && !chunk.loading && !chunk.staged.empty() && uploads < uploadsPerFrame)
+            if (Upload(n, wanted)) uploads++;
+        if (chunk.vaoID) {
+            chunk.lastUsed = frame;
+            visible.push_back(n); }
+        else if (!chunk.loading && chunk.staged.empty() && inFlight < maxInFlight) {
+            chunk.loading = true;
+            inFlight++;
+            {
+                std::unique_lock<std::mutex> guard(doneLock);
+                jobs++;
+            }
+            Workers().Submit([this, n]() { Load(n); }); } }
+
+    // Chunks read but no longer wanted aren't kept in CPU memory.
+    for (int n=0;  n<nodeCount;  n++)
+        if (!want[n] && !chunks[n].loading && !chunks[n].staged.empty())
+            std::vector<PointRecord>().swap(chunks[n].staged);
+}
+
+void PointCloud::DrawVAO()
+{
+    CHECKERROR;
+    glPointSize(pointSize);
+    for (size_t i=0;  i<visible.size();  i++) {
+        glBindVertexArray(chunks[visible[i]].vaoID);
+        glDrawArrays(GL_POINTS, 0, nodes[visible[i]].count); }
+    glBindVertexArray(0);
+    CHECKERROR;
+}
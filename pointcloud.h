@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////
+// Out-of-core point clouds.  A scan with hundreds of millions of
+// points (a PLY file with vertices and no faces) is never held in
+// memory.  It is preprocessed once into an octree of point chunks in
+// the cache directory, and the chunks are then streamed to the
+// graphics card as the view needs them, under a fixed memory budget.
+//
+// Octree nodes are nested:  each point is stored once, in one node,
+// and every interior node holds an even subsample of its subtree.
+// Drawing a node together with its ancestors gives the full density
+// of that region.  Each frame, Update refines the octree wherever a
+// node's point spacing would cover more than pointSize pixels on the
+// screen, most visible error first, until the budget is spent.
+// Chunks are read from the mapped file on the worker threads.  A
+// few are uploaded per frame, and out-of-view chunks are evicted,
+// least recently used first.
+//
+// The cloud is a Shape, placed in the scene like any other with
+// new Object(cloud, pointsId, ...), and drawn as GL_POINTS by the
+// usual shaders:  position in attribute 0, normal in 1, and color in
+// attribute 6 (vertexColor).  Points are stored relative to origin
+// (the center of the scan, in its own coordinates), so the cloud is
+// centered at zero with size in Shape::size.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _POINTCLOUD_
+#define _POINTCLOUD_
+
+#include "shapes.h"
+
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+class MappedFile;
+
+// A point as stored in the octree file and in the GPU buffers.
+struct PointRecord
+{
+    float P[3];                 // Relative to the cloud's origin
+    unsigned char C[4];         // Color (alpha unused)
+    signed char N[4];           // Normal, scaled to 127 (zero if unknown)
+};
+
+// An octree node as stored in the octree file.
+struct PointNode
+{
+    float center[3];            // Relative to the cloud's origin
+    float half;                 // Half the node's edge length
+    int32_t children[8];        // Node indices, or -1
+    uint64_t first;             // Index of the node's first point
+    uint32_t count;             // Points stored in this node (not its subtree)
+    uint32_t depth;
+};
+
+class PointCloud: public Shape
+{
+ public:
+    double origin[3];           // Scan coordinates of the cloud's (0,0,0)
+    size_t budget;              // GPU bytes allowed for resident chunks
+    float pointSize;            // Point size (and target spacing) in pixels
+    int uploadsPerFrame;        // GPU upload budget
+    int maxInFlight;            // Chunk reads queued at once
+
+    PointCloud(const std::string& path, const size_t _budget, const float _pointSize=2.0f,
+               const int _uploadsPerFrame=4);
+    virtual ~PointCloud();
+
+    // Chooses and streams the chunks for this view.  ModelView is the
+    // cloud's full transformation into eye space.  Call once per frame.
+    void Update(const glm::mat4& WorldProj, const glm::mat4& ModelView, const int viewHeight);
+    virtual void DrawVAO();
+
+    size_t Resident() const { return residentBytes; }
+
+ private:
+    struct Chunk
+    {
+        unsigned int vaoID, bufferID; // GPU copy, 0 if not resident
+        bool loading;                 // Being read by a worker
+        std::vector<PointRecord> staged; // Read, waiting for upload
+        int lastUsed;                 // Frame last drawn
+    };
+
+    MappedFile* file;
+    const PointNode* nodes;
+    const PointRecord* points;
+    int nodeCount;
+    std::vector<Chunk> chunks;
+    std::vector<int> visible;         // Resident chunks drawn this frame
+    size_t residentBytes;
+    int frame, inFlight;
+
+    std::mutex doneLock;              // Guards done and jobs
+    std::vector<int> done;            // Read by workers, not yet collected
+    int jobs;
+
+    void Load(const int node);
+    bool Upload(const int node, const std::vector<int>& wanted);
+    void Release(const int node);
+};
+
+// Preprocesses the PLY point file at path into an octree file at
+// out, reading the input a few times in a streaming fashion.  Memory
+// use is bounded (a fixed occupancy grid and small per-node write
+// buffers), whatever the size of the scan.
+bool BuildPointOctree(const std::string& path, const std::string& out);
+
+#endif
@@ -0,0 +1,220 @@
+////////////////////////////////////////////////////////////////////////
+// Dense instanced scatter (grass, rocks, ...) over a ProceduralGround.
+// Instances are placed once, deterministically per terrain tile, and
+// live in a GPU buffer.  Each frame a compute pass (scatter.compute)
+// frustum- and distance-culls them and compacts the survivors into
+// the instance stream of a single indirect instanced draw per view,
+// so the CPU never touches individual instances after placement.
+////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <stdlib.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "math.h"
+#include "scatter.h"
+#include "shader.h"
+#include "transform.h"
+#include "workers.h"
+
+#include <glu.h>                // For gluErrorString
+#define CHECKERROR {GLenum err = glGetError(); if (err != GL_NO_ERROR) { fprintf(stderr, "OpenGL error (at line scatter.cpp:%d): %s\n", __LINE__, gluErrorString(err)); exit(-1);} }
+
+const float PI = 3.14159f;
+
+// Layout of the indirect draw command read by glDrawElementsIndirect
+struct DrawCommand {
+    unsigned int count, instanceCount, firstIndex, baseVertex, baseInstance;
+};
+
+// A small hash-based random number stream, so placement in a tile
+// depends only on the tile and the seed (not on thread timing).
+struct TileRandom {
+    unsigned int state;
+    TileRandom(int tx, int ty, unsigned int seed) {
+        state = seed*0x9E3779B9u ^ (unsigned int)tx*0x85EBCA6Bu ^ (unsigned int)ty*0xC2B2AE35u;
+        Next(); Next(); }
+    unsigned int Next() {
+        state ^= state << 13;  state ^= state >> 17;  state ^= state << 5;
+        return state; }
+    float Uniform() { return (Next() >> 8)*(1.0f/16777216.0f); }
+};
+
+Scatter::Scatter(ProceduralGround* _ground, Shape* _mesh, const float extent,
+                 const float _tileSize, const int _perTile, const float _maxSlope,
+                 const float _minScale, const float _maxScale, const float _maxDistance,
+                 const unsigned int _seed)
+    : ground(_ground), mesh(_mesh), tileSize(_tileSize), perTile(_perTile),
+      maxSlope(_maxSlope), minScale(_minScale), maxScale(_maxScale),
+      maxDistance(_maxDistance), seed(_seed)
+{
+    diffuseColor = mesh->diffuseColor;
+    specularColor = mesh->specularColor;
+    shininess = mesh->shininess;
+    modelTr = glm::mat4();
+
+    MeshArrays a = mesh->Data();
+    radius = 0.0f;
+    for (size_t i=0;  i<a.nPnt;  i++)
+        radius = std::max(radius, glm::length(a.Pnt[i].xyz()));
+
+    // Place instances tile by tile in parallel, then concatenate in
+    // tile order so the result never depends on scheduling.
+    int tiles = std::max(1, (int)ceilf(2.0f*extent/tileSize));
+    int first = -tiles/2;
+    std::vector<std::vector<ScatterInstance> > perTileOut(tiles*tiles);
+    Workers().ParallelFor(tiles*tiles, [&](int t0, int t1) {
+        for (int t=t0;  t<t1;  t++)
+            PlaceTile(first + t%tiles, first + t/tiles, perTileOut[t]); });
+
+    std::vector<ScatterInstance> all;
+    for (size_t t=0;  t<perTileOut.size();  t++)
+        all.insert(all.end(), perTileOut[t].begin(), perTileOut[t].end());
+    total = all.size();
+    printf("Scatter: %u instances over %d tiles\n", total, tiles*tiles);
+
+    // All instances, read by the cull pass
+    glGenBuffers(1, &allBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, allBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(1, total)*sizeof(ScatterInstance),
+                 total ? &all[0] : NULL, GL_STATIC_DRAW);
+
+    // Visible instances, written by the cull pass and read as vertex
+    // attributes:  total slots for each view
+    glGenBuffers(1, &visibleBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, ScatterViews*std::max<size_t>(1, total)*sizeof(ScatterInstance),
+                 NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // A draw command per view, whose instances start at its slots
+    glGenBuffers(1, &commandBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    DrawCommand cmd[ScatterViews];
+    for (int v=0;  v<ScatterViews;  v++) {
+        DrawCommand c = {3*(unsigned int)a.nTri, 0, 0, 0, v*total};
+        cmd[v] = c; }
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(cmd), cmd, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // A private copy of the mesh's VAO with the instance stream added
+    // as attributes 4 and 5, advancing once per instance.
+    vaoID = VaoFromArrays(a.Pnt, a.nPnt, a.Nrm, a.nNrm, a.Tex, a.nTex, a.Tan, a.nTan, a.Tri, a.nTri);
+    count = a.nTri;
+    glBindVertexArray(vaoID);
+    glBindBuffer(GL_ARRAY_BUFFER, visibleBuffer);
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(ScatterInstance), 0);
+    glVertexAttribDivisor(4, 1);
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(ScatterInstance), (void*)sizeof(glm::vec4));
+    glVertexAttribDivisor(5, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    cullProgram = new ShaderProgram();
+    cullProgram->AddShader("scatter.compute", GL_COMPUTE_SHADER);
+    cullProgram->LinkProgram();
+    CHECKERROR;
+}
+
+// Candidate positions are jittered uniformly over the tile, then
+// rejected under water or on slopes too steep to hold them.
+void Scatter::PlaceTile(const int tx, const int ty, std::vector<ScatterInstance>& out)
+{
+    TileRandom rnd(tx, ty, seed);
+    for (int i=0;  i<perTile;  i++) {
+        float x = (tx + rnd.Uniform())*tileSize;
+        float y = (ty + rnd.Uniform())*tileSize;
+        float s = minScale + rnd.Uniform()*(maxScale-minScale);
+        float a = 2.0f*PI*rnd.Uniform();
+
+        float z = ground->HeightAt(x, y);
+        if (z < 0.0f) continue;
+        glm::vec3 N = ground->NormalAt(x, y, z);
+        if (1.0f - N.z > maxSlope) continue;
+
+        ScatterInstance inst;
+        inst.offset = glm::vec4(x, y, z, s);
+        inst.spin = glm::vec4(a, 0.0f, 0.0f, 1.0f);
+        out.push_back(inst); }
+}
+
+// Runs the cull pass for a view:  resets its draw command's instance
+// count, tests every instance against the view frustum planes and the
+// distance limit on the GPU, and appends survivors to the view's
+// slots of the visible buffer.  The CPU cost is independent of the
+// instance count.
+void Scatter::Cull(const glm::mat4& Proj, const glm::mat4& View, const glm::vec3& eye,
+                   const ScatterView view)
+{
+    if (total == 0) return;
+
+    // Frustum planes (Gribb/Hartmann) from the rows of Proj*View,
+    // normalized so the plane distance is in world units.
+    glm::mat4 M = Proj*View;
+    glm::vec4 row[4];
+    for (int r=0;  r<4;  r++)
+        row[r] = glm::vec4(M[0][r], M[1][r], M[2][r], M[3][r]);
+    glm::vec4 planes[6] = { row[3]+row[0], row[3]-row[0],
+                            row[3]+row[1], row[3]-row[1],
+                            row[3]+row[2], row[3]-row[2] };
+    for (int p=0;  p<6;  p++)
+        planes[p] /= glm::length(planes[p].xyz());
+
+    unsigned int zero = 0;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, view*sizeof(DrawCommand) + sizeof(unsigned int),
+                    sizeof(zero), &zero);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    cullProgram->Use();
+    int programId = cullProgram->programId;
+    int loc = glGetUniformLocation(programId, "planes");
+    glUniform4fv(loc, 6, &planes[0][0]);
+    loc = glGetUniformLocation(programId, "eyePos");
+    glUniform3fv(loc, 1, &eye[0]);
+    loc = glGetUniformLocation(programId, "maxDistance");
+    glUniform1f(loc, maxDistance);
+    loc = glGetUniformLocation(programId, "radius");
+    glUniform1f(loc, radius);
+    loc = glGetUniformLocation(programId, "total");
+    glUniform1ui(loc, total);
+    loc = glGetUniformLocation(programId, "view");
+    glUniform1ui(loc, view);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, allBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+    glDispatchCompute((total+255)/256, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    cullProgram->Unuse();
+    CHECKERROR;
+}
+
+// One indirect instanced draw for the instances visible in the
+// current program's view.  Programs not listed in programs (whose
+// vertex shaders don't read the instance attributes) skip the draw.
+void Scatter::DrawVAO()
+{
+    if (total == 0) return;
+    int current = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+    std::map<int, ScatterView>::iterator listed = programs.find(current);
+    if (listed == programs.end()) return;
+
+    CHECKERROR;
+    glBindVertexArray(vaoID);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(listed->second*sizeof(DrawCommand)));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    CHECKERROR;
+}
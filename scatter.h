@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////////
+// Dense instanced scatter (grass, rocks, ...) over a ProceduralGround.
+// Instances are placed once, deterministically per terrain tile, and
+// live in a GPU buffer.  Each frame a compute pass (scatter.compute)
+// frustum- and distance-culls them and compacts the survivors into
+// the instance stream of a single indirect instanced draw, so the CPU
+// never touches individual instances after placement.
+//
+// Instances are culled separately for each view that draws them (the
+// camera's, and the light's for the shadow pass, so rocks outside the
+// camera's view still cast shadows into it), each into its own part
+// of the instance stream with its own draw command.
+//
+// The scatter is a Shape, placed in the scene like any other with
+// new Object(scatter, scatterId, ...).  Call Cull once per frame for
+// each view, before the passes that draw it.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SCATTER_
+#define _SCATTER_
+
+#include "shapes.h"
+#include <map>
+
+class ShaderProgram;
+
+// The views instances are culled for
+enum ScatterView { ScatterCamera, ScatterShadow, ScatterViews };
+
+// Per-instance data as stored on the GPU (and read as vertex
+// attributes 4 and 5 by the shaders that support instancing).
+struct ScatterInstance
+{
+    glm::vec4 offset;           // World position (xyz) and scale (w)
+    glm::vec4 spin;             // Rotation about Z in radians (x);  yzw unused (0,0,1)
+};
+
+class Scatter: public Shape
+{
+ public:
+    ProceduralGround* ground;
+    Shape* mesh;                // The geometry drawn for each instance
+    float tileSize;             // Placement tile edge in world units
+    int perTile;                // Candidate positions per tile
+    float maxSlope;             // Reject where 1-normal.z exceeds this
+    float minScale, maxScale;
+    float maxDistance;          // Cull instances farther than this from the eye
+    unsigned int seed;
+    unsigned int total;         // Instances placed
+    std::map<int, ScatterView> programs; // Shader programs that draw instances, and the view
+                                         // each draws (others skip them)
+
+    Scatter(ProceduralGround* _ground, Shape* _mesh, const float extent,
+            const float _tileSize, const int _perTile, const float _maxSlope,
+            const float _minScale, const float _maxScale, const float _maxDistance,
+            const unsigned int _seed=1);
+
+    // Culls the instances for view to the frustum of Proj*View, and to
+    // maxDistance from the eye.
+    void Cull(const glm::mat4& Proj, const glm::mat4& View, const glm::vec3& eye,
+              const ScatterView view=ScatterCamera);
+    virtual void DrawVAO();
+
+ private:
+    ShaderProgram* cullProgram;
+    unsigned int allBuffer, visibleBuffer, commandBuffer; // visibleBuffer has total slots per view
+    float radius;               // Bounding radius of the mesh at scale 1
+
+    void PlaceTile(const int tx, const int ty, std::vector<ScatterInstance>& out);
+};
+
+#endif
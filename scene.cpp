@@ -18,6 +18,15 @@ const bool showSpheres = true;  // Use true for shadows and reflections test sce
 #else
 const bool showSpheres = true;  // Use true for shadows and reflections test scenes
 #endif
+const bool streamTerrain = false; // Unbounded tiled ground around the eye instead of the island
+const char* const pointCloudFile = 0; // PLY scan (vertices only) to stream as a point cloud, or 0
+const int pointCloudMB = 256;           // GPU memory for its resident chunks
+const double loadBudget = 4.0;  // Milliseconds per frame for uploading newly loaded assets
+const double streamBudget = 2.0; // Milliseconds per frame for uploading streamed mip levels
+const int textureStreamMB = 256;  // GPU memory for streamed texture levels
+const int arrayLayerSize = 1024;  // Texels across a texture array layer (see texarray.h)
+const int pixelRingMB = 64;       // Pixel buffer memory texture uploads are staged in
+const char* const iblFile = "./skys/Tropical_Beach_3k.hdr"; // Environment for image based lighting
 
 #include "math.h"
 #include <iostream>
@@ -39,6 +48,18 @@ using namespace gl;
 #include "object.h"
 #include "texture.h"
 #include "transform.h"
+#include "terrain.h"
+#include "scatter.h"
+#include "fog.h"
+#include "pointcloud.h"
+#include "assetpack.h"
+#include "assetloader.h"
+#include "texstream.h"
+#include "texarray.h"
+#include "pixelring.h"
+#include "cubemap.h"
+#include "iblbake.h"
+#include "shirradiance.h"
 
 const float PI = 3.141592653589793f;
 const float rad = PI/180.0f;    // Convert degrees to radians
@@ -154,6 +175,10 @@ struct {
 // number of other parameters.
 void Scene::InitializeScene()
 {
+    // Shaders, images, and cached meshes come from the asset pack when
+    // there is one ("make pack"), and from loose files otherwise.
+    OpenAssetPack("assets.pack");
+
     glEnable(GL_DEPTH_TEST);
     CHECKERROR;
     // @@ Initialize interactive viewing variables here. (spin, tilt, ry, front back, ...)
@@ -267,6 +292,8 @@ void Scene::InitializeScene()
     shadowProgram->AddShader("shadow.frag", GL_FRAGMENT_SHADER);
 
     glBindAttribLocation(shadowProgram->programId, 0, "vertex");
+    glBindAttribLocation(shadowProgram->programId, 4, "instanceOffset");
+    glBindAttribLocation(shadowProgram->programId, 5, "instanceSpin");
     shadowProgram->LinkProgram();
 
     //reflectionProgram = new ShaderProgram();
@@ -289,6 +316,9 @@ void Scene::InitializeScene()
     glBindAttribLocation(gBufferProgram->programId, 1, "vertexNormal");
     glBindAttribLocation(gBufferProgram->programId, 2, "vertexTexture");
     glBindAttribLocation(gBufferProgram->programId, 3, "vertexTangent");
+    glBindAttribLocation(gBufferProgram->programId, 4, "instanceOffset");
+    glBindAttribLocation(gBufferProgram->programId, 5, "instanceSpin");
+    glBindAttribLocation(gBufferProgram->programId, 6, "vertexColor");
     gBufferProgram->LinkProgram();
 
     localLightProgram = new ShaderProgram();
@@ -317,18 +347,37 @@ void Scene::InitializeScene()
     AOProgramH->AddShader("aoh.compute", GL_COMPUTE_SHADER);
     AOProgramH->LinkProgram();
     
-    // Create all the Polygon shapes
-    Shape* TeapotPolygons =  new Teapot(fullPolyCount?12:2);
-    Shape* BoxPolygons = new Box();
-    Shape* SpherePolygons = new Sphere(32);
-    Shape* RoomPolygons = new Ply("room.ply");
-    Shape* FloorPolygons = new Plane(10.0, 10);
-    Shape* QuadPolygons = new Quad();
-    Shape* SeaPolygons = new Plane(2000.0, 50);
+    // Create all the Polygon shapes, shared through the loader's
+    // registry (named by what determines their contents).  The
+    // expensive ones (tessellated or read from files) are built in the
+    // background and put into the scene when they arrive;  see below.
+    Shape* BoxPolygons = Loader().MakeShape("box", []() { return new Box(); });
+    Shape* SpherePolygons = Loader().MakeShape("sphere 32", []() { return new Sphere(32); });
+    Shape* FloorPolygons = Loader().MakeShape("plane 10 10", []() { return new Plane(10.0, 10); });
+    Shape* QuadPolygons = Loader().MakeShape("quad 1", []() { return new Quad(); });
+    Shape* SeaPolygons = Loader().MakeShape("plane 2000 50", []() { return new Plane(2000.0, 50); });
     ground = new ProceduralGround(grndSize, 400,
                                      grndOctaves, grndFreq, grndPersistence,
                                      grndLow, grndHigh);
     Shape* GroundPolygons = ground;
+    if (streamTerrain) {
+        ground->island = false;
+        terrain = new TerrainStreamer(ground, 50.0, 64, 4, 48);
+        terrain->Update(eye); }
+
+    // Rocks scattered over the ground, culled and drawn on the GPU.
+    Shape* RockPolygons = Loader().MakeShape("sphere 6", []() { return new Sphere(6); });
+    rocks = new Scatter(ground, RockPolygons, grndSize, 10.0, 500, 0.15, 0.05, 0.3, 150.0);
+    rocks->programs[gBufferProgram->programId] = ScatterCamera;
+    rocks->programs[shadowProgram->programId] = ScatterShadow;
+
+    // A large scan, streamed from an octree built on first use, scaled
+    // to 50m across and set on the ground beside the start.
+    points = NULL;
+    if (pointCloudFile) {
+        points = new PointCloud(pointCloudFile, (size_t)pointCloudMB<<20);
+        float s = 25.0f/points->size;
+        pointsTr = Translate(40.0, 0.0, ground->HeightAt(40.0, 0.0) - s*points->minP.z)*Scale(s, s, s); }
 
     // Various colors used in the subsequent models
     glm::vec3 woodColor(87.0/255.0, 51.0/255.0, 35.0/255.0);
@@ -337,6 +386,7 @@ void Scene::InitializeScene()
     glm::vec3 brassColor(0.5, 0.5, 0.1);
     glm::vec3 grassColor(62.0/255.0, 102.0/255.0, 38.0/255.0);
     glm::vec3 waterColor(0.3, 0.3, 1.0);
+    glm::vec3 rockColor(0.35, 0.33, 0.3);
 
     glm::vec3 black(0.0, 0.0, 0.0);
     glm::vec3 brightSpec(0.03, 0.03, 0.03);
@@ -358,7 +408,7 @@ void Scene::InitializeScene()
     Object* anim       = new Object(NULL, nullId);
     //Object* room       = new Object(RoomPolygons, roomId, brickColor, black, 1);
     //Object* floor      = new Object(FloorPolygons, floorId, floorColor, black, 1);
-    Object* teapot     = new Object(TeapotPolygons, teapotId, brassColor, glm::vec3(1.0, 1.0, 1.0), 2000);
+    Object* teapot     = new Object(NULL, teapotId, brassColor, glm::vec3(1.0, 1.0, 1.0), 2000);
     //Object* podium     = new Object(BoxPolygons, boxId, glm::vec3(woodColor), polishedSpec, 10); 
     Object* sky        = new Object(SpherePolygons, skyId, black, black, 0);
     //Object* ground     = new Object(GroundPolygons, groundId, grassColor, black, 1);
@@ -377,7 +427,12 @@ void Scene::InitializeScene()
     if (fullPolyCount) {
         objectRoot->add(sky, Scale(2000.0, 2000.0, 2000.0));
         //objectRoot->add(sea); 
-        /*objectRoot->add(ground);*/ }
+        /*objectRoot->add(ground);*/
+        if (streamTerrain)
+            objectRoot->add(new Object(terrain, groundId, grassColor, black, 1));
+        objectRoot->add(new Object(rocks, scatterId, rockColor, black, 1)); }
+    if (points)
+        objectRoot->add(new Object(points, pointsId, glm::vec3(1.0), black, 1), pointsTr);
     objectRoot->add(central);
 #ifndef REFL
      //objectRoot->add(room,  Translate(0.0, 0.0, 0.02));
@@ -390,7 +445,12 @@ void Scene::InitializeScene()
     // Central contains a teapot on a podium and an external sphere of spheres
     //central->add(podium, Translate(0.0, 0,0));
     central->add(anim, Translate(0.0, 0,0));
-    anim->add(teapot, Translate(0.1, 0.0, 1.5)*TeapotPolygons->modelTr);
+    Loader().LoadShape(fullPolyCount ? "teapot 12" : "teapot 2",
+                       []() { return new Teapot(fullPolyCount?12:2); },
+                       [anim, teapot](Shape* s) {
+                           teapot->shape = s;
+                           anim->add(teapot, Translate(0.1, 0.0, 1.5)*s->modelTr); });
+    Loader().LoadShape("ply room.ply", []() { return new Ply("room.ply"); }); // For the (disabled) room
     if (showSpheres && fullPolyCount)
         anim->add(spheres, Translate(0.0, 0.0, 0.0)*Scale(30.0, 30.0, 30.0));
     
@@ -402,23 +462,49 @@ void Scene::InitializeScene()
 
     CHECKERROR;
 
-    //floor->objTexture = new Texture("./textures/6670-diffuse.jpg");
-    //floor->normalTexture = new Texture("./textures/6670-normal.jpg");
-    sky->objTexture = new Texture("./skys/Tropical_Beach_3k.hdr");
+    // Textures are decoded in the background, and copied into mapped
+    // pixel buffers there, for uploads that don't block;  objects are
+    // drawn with just their colors until theirs arrive, and then with
+    // only the mip levels they need.  Those of ordinary objects go in
+    // texture arrays (resized to a common size), so drawing them
+    // binds no textures.
+    Streamer().budget = (size_t)textureStreamMB<<20;
+    Uploads().capacity = (size_t)pixelRingMB<<20;
+    Uploads().Create();
+    Arrays().fit = ArrayResize;
+    Arrays().layerSize = arrayLayerSize;
+    //floor->texLayer = Arrays().Add("./textures/6670-diffuse.jpg");
+    //floor->normalLayer = Arrays().Add("./textures/6670-normal.jpg");
+    sky->objTexture = Loader().LoadTexture("./skys/Tropical_Beach_3k.hdr");
     skybox = sky->objTexture;
-    //sea->objTexture = new Texture("./skys/Tropical_Beach_3k.hdr");
-    //sea->normalTexture = new Texture("./textures/ripples_normalmap.png");
-    //room->objTexture = new Texture("./textures/Standard_red_pxr128.png");
-    //room->normalTexture = new Texture("./textures/Standard_red_pxr128_normal.png");
-    //podium->objTexture = new Texture("./textures/Brazilian_rosewood_pxr128.png");
-    //podium->normalTexture = new Texture("./textures/Brazilian_rosewood_pxr128_normal.png");
-    teapot->objTexture = new Texture("./textures/cracks.png");
-    //ground->objTexture = new Texture("./textures/grass.jpg");
-    //rightFrame->objTexture = new Texture("./textures/my-house-01.png");
-
-    Texture* clouds = new Texture("./skys/Tropical_Beach_3k.hdr");
-    cloudsIBL = new Texture("./skys/Tropical_Beach_3k.hdr");
-    cloudsIRRIBL = new Texture("./skys/Tropical_Beach_3k.irr.hdr");
+    //sea->objTexture = Loader().LoadTexture("./skys/Tropical_Beach_3k.hdr");
+    //sea->normalTexture = Loader().LoadTexture("./textures/ripples_normalmap.png");
+    //room->texLayer = Arrays().Add("./textures/Standard_red_pxr128.png");
+    //room->normalLayer = Arrays().Add("./textures/Standard_red_pxr128_normal.png");
+    //podium->texLayer = Arrays().Add("./textures/Brazilian_rosewood_pxr128.png");
+    //podium->normalLayer = Arrays().Add("./textures/Brazilian_rosewood_pxr128_normal.png");
+    teapot->texLayer = Arrays().Add("./textures/cracks.png");
+    //ground->texLayer = Arrays().Add("./textures/grass.jpg");
+    //rightFrame->texLayer = Arrays().Add("./textures/my-house-01.png");
+
+    cloudsIBL = Loader().LoadTexture(iblFile);
+
+    // It's converted to a cube map (see cubemap.h) for the sky and the
+    // IBL once loaded.  Its specular is prefiltered (see iblbake.h) from
+    // the cache, or baked from the cube, and its irradiance projected
+    // to SH (see shirradiance.h).
+    envCube = new CubeMap();
+    specularIBL = new SpecularIBL();
+    specularIBL->Load(iblFile);
+    irradianceSH = new IrradianceSH();
+    Arrays().Build();
+
+    // Tileable noise used by the G-buffer shader for surface detail
+    // (one fetch instead of evaluating octave noise per pixel).
+    detailNoise = new NoiseTexture(2, 512, 4.0, 0.5, 1.0, 16.0);
+
+    // Froxel volumetric fog, lit by the sun and the local lights
+    fog = new VolumetricFog();
 
     quad = QuadObject(QuadPolygons);
     sphere = SphereObject(SpherePolygons);
@@ -491,6 +577,23 @@ void Scene::DrawScene()
     }
 
     eye.z = ground->HeightAt(eye.x, eye.y) + 2.0;
+    if (streamTerrain)
+        terrain->Update(eye);
+
+    // Send this frame's share of newly loaded textures and meshes to
+    // the graphics card.
+    Uploads().Update();
+    Loader().Update(loadBudget);
+    Streamer().Update(streamBudget);
+    Arrays().Update();
+    envCube->Update(iblFile, cloudsIBL);
+
+    // Once it's a cube map and its irradiance is projected, nothing
+    // reads the IBL's equirectangular texture;  it's freed unless the
+    // sky still shares it.
+    if (cloudsIBL && envCube->Ready() && irradianceSH->Ready()) {
+        Loader().Release(cloudsIBL);
+        cloudsIBL = NULL; }
     
     // Set the viewport
     glfwGetFramebufferSize(window, &width, &height);
@@ -520,6 +623,11 @@ void Scene::DrawScene()
         (*m)->animTr = Rotate(2, atime);
 
     BuildTransforms();
+    Streamer().SetView(WorldProj, WorldView, height);
+    rocks->Cull(WorldProj, WorldView, eye, ScatterCamera);
+    rocks->Cull(pL, vL, eye, ScatterShadow);
+    if (points)
+        points->Update(WorldProj, WorldView*pointsTr, height);
     
 
     ////////////////////////////////////////////////////////////////////////////////
@@ -583,7 +691,14 @@ void Scene::DrawScene()
     glUniformMatrix4fv(loc, 1, GL_FALSE, Pntr(ShadowMatrix));
     CHECKERROR;
 
+    detailNoise->Bind(2, programId, "noiseMap");
+    Arrays().Begin(programId);
+    envCube->Bind(5, programId, "skyMap");
+    loc = glGetUniformLocation(programId, "useSkyMap");
+    glUniform1i(loc, envCube->Ready());
+
     objectRoot->Draw(gBufferProgram, Identity);
+    detailNoise->Unbind();
 
     // Turn off the shader
     gBufferMap->Unbind();
@@ -989,6 +1104,13 @@ void Scene::DrawScene()
     //// End of Reflection pass #2
     //////////////////////////////////////////////////////////////////////////////////
 
+    ////////////////////////////////////////////////////////////////////////////////
+    // Volumetric fog: inject and integrate the froxel grid for this view
+    ////////////////////////////////////////////////////////////////////////////////
+    fog->Compute(WorldInverse, rx, ry, eye, lightPos, Light,
+                 localLightPositions, localLightColors, localLightRadii, glfwGetTime());
+    CHECKERROR;
+
     ////////////////////////////////////////////////////////////////////////////////
     // Lighting pass
     ////////////////////////////////////////////////////////////////////////////////
@@ -1068,15 +1190,18 @@ void Scene::DrawScene()
     loc = glGetUniformLocation(programId, "AOMap");
     glUniform1i(loc, unit + 6);
 
-    cloudsIBL->Bind(unit + 7, programId, "IBL");
-    cloudsIRRIBL->Bind(unit + 8, programId, "IRRIBL");
-
+    if (!envCube->Ready())
+        Streamer().Request(cloudsIBL, 0);   // Converted from every level
+    envCube->Bind(unit + 7, programId, "IBL");
+    fog->Bind(unit + 9, programId, "fogVolume");
+    specularIBL->Update(iblFile, envCube);
+    specularIBL->Bind(unit + 10, unit + 11, programId);
+    irradianceSH->Update(iblFile, cloudsIBL);
+    irradianceSH->Bind(programId);
 
-    loc = glGetUniformLocation(programId, "iblWidth");
-    glUniform1i(loc, cloudsIBL->width);
 
-    loc = glGetUniformLocation(programId, "iblHeight");
-    glUniform1i(loc, cloudsIBL->height);
+    loc = glGetUniformLocation(programId, "iblSize");
+    glUniform1i(loc, envCube->size);
 
     CHECKERROR;
 
@@ -16,6 +16,7 @@
 #include "object.h"
 #include "texture.h"
 #include "fbo.h"
+#include "noisetex.h"
 
 enum ObjectIds {
     nullId	= 0,
@@ -30,10 +31,19 @@ enum ObjectIds {
     teapotId	= 9,
     spheresId	= 10,
     floorId     = 11,
-    other       = 12
+    other       = 12,
+    scatterId   = 13,
+    pointsId    = 14
 };
 
 class Shader;
+class TerrainStreamer;
+class Scatter;
+class VolumetricFog;
+class CubeMap;
+class SpecularIBL;
+class IrradianceSH;
+class PointCloud;
 
 
 class Scene
@@ -56,6 +66,10 @@ public:
     glm::vec3 Light, Ambient;
     
     ProceduralGround* ground;
+    TerrainStreamer* terrain;   // Tiled ground streamed around the eye
+    Scatter* rocks;             // GPU-culled instanced scatter on the ground
+    PointCloud* points;         // Streamed out-of-core scan, or NULL
+    glm::mat4 pointsTr;         // Its placement in the world
 
 
     int mode; // Extra mode indicator hooked up to number keys and sent to shader
@@ -113,8 +127,16 @@ public:
     Texture* skybox;
 
     // IBL Textures
-    Texture* cloudsIBL;
-    Texture* cloudsIRRIBL;
+    Texture* cloudsIBL;         // Released (and NULL) once converted and projected
+    CubeMap* envCube;           // cloudsIBL as a cube map, for the sky and the lighting pass
+    SpecularIBL* specularIBL;   // cloudsIBL prefiltered for the lighting pass
+    IrradianceSH* irradianceSH; // and its irradiance, in spherical harmonics
+
+    // Baked tileable noise for procedural surface detail
+    NoiseTexture* detailNoise;
+
+    // Froxel volumetric fog applied in the lighting pass
+    VolumetricFog* fog;
 
     void InitializeScene();
     void BuildTransforms();
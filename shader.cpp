@@ -14,6 +14,7 @@
 using namespace gl;
 
 #include "shader.h"
+#include "assetpack.h"
 
 // Reads a specified file into a string and returns the string.  The
 // file is examined first to determine the needed string size.
@@ -56,14 +57,17 @@ void ShaderProgram::Unuse()
 // string.
 void ShaderProgram::AddShader(const char* fileName, GLenum type)
 {
-    // Read the source from the named file
-    char* src = ReadFile(fileName);
-    const char* psrc[1] = {src};
+    // Take the source from the asset pack, or read it from the named file
+    size_t size;
+    const char* packed = PackedAsset(fileName, PackRaw, size);
+    char* src = packed ? NULL : ReadFile(fileName);
+    const char* psrc[1] = {packed ? packed : src};
+    const GLint lengths[1] = {packed ? (GLint)size : -1};
 
     // Create a shader and attach, hand it the source, and compile it.
     int shader = glCreateShader(type);
     glAttachShader(programId, shader);
-    glShaderSource(shader, 1, psrc, NULL);
+    glShaderSource(shader, 1, psrc, lengths);
     glCompileShader(shader);
     delete src;
 
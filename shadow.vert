@@ -8,13 +8,19 @@
 uniform mat4 WorldView, WorldProj, ModelTr;
 
 in vec4 vertex;
+in vec4 instanceOffset;         // Instanced scatter placement; (0,0,0,1) when unused
+in vec4 instanceSpin;
 
 out vec4 position;
 
 
 void main()
 {      
-    gl_Position = WorldProj*WorldView*ModelTr*vertex;
+    float c = cos(instanceSpin.x), s = sin(instanceSpin.x);
+    mat3 spin = mat3(c, s, 0, -s, c, 0, 0, 0, 1);
+    vec4 P = vec4(instanceOffset.xyz + instanceOffset.w*(spin*vertex.xyz), vertex.w);
+
+    gl_Position = WorldProj*WorldView*ModelTr*P;
     
     position = gl_Position;
 }
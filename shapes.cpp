@@ -40,6 +40,11 @@ using namespace gl;
 #include "shapes.h"
 #include "rply.h"
 #include "simplexnoise.h"
+#include "workers.h"
+#include "plyload.h"
+#include "meshcache.h"
+#include "filecache.h"
+#include "weld.h"
 
 const float PI = 3.14159f;
 const float rad = PI/180.0f;
@@ -50,16 +55,43 @@ void pushquad(std::vector<glm::ivec3> &Tri, int i, int j, int k, int l)
     Tri.push_back(glm::ivec3(i,k,l));
 }
 
+// Fills in the two triangles of each quad in row i (i>0) of an
+// (n+1) by (n+1) vertex grid, in the same order pushquad would have
+// appended them.  Tri must already be sized to 2*n*n.
+void gridquads(std::vector<glm::ivec3> &Tri, const int i, const int n)
+{
+    for (int j=1;  j<=n;  j++) {
+        int q = 2*((i-1)*n + (j-1));
+        int a = (i-1)*(n+1) + (j-1);
+        int b = (i-1)*(n+1) + (j);
+        int c = (i  )*(n+1) + (j);
+        int d = (i  )*(n+1) + (j-1);
+        Tri[q  ] = glm::ivec3(a,b,c);
+        Tri[q+1] = glm::ivec3(a,c,d); }
+}
+
+// Sizes the data arrays for an (n+1) by (n+1) grid of vertices.
+void gridresize(Shape* shape, const int n)
+{
+    shape->Pnt.resize((n+1)*(n+1));
+    shape->Nrm.resize((n+1)*(n+1));
+    shape->Tex.resize((n+1)*(n+1));
+    shape->Tan.resize((n+1)*(n+1));
+    shape->Tri.resize(2*n*n);
+}
+
 // Batch up all the data defining a shape to be drawn (example: the
 // teapot) as a Vertex Array object (VAO) and send it to the graphics
-// card.  Return an OpenGL identifier for the created VAO.
-unsigned int VaoFromTris(std::vector<glm::vec4> Pnt,
-                         std::vector<glm::vec3> Nrm,
-                         std::vector<glm::vec2> Tex,
-                         std::vector<glm::vec3> Tan,
-                         std::vector<glm::ivec3> Tri)
+// card.  Return an OpenGL identifier for the created VAO.  The arrays
+// may point anywhere (vectors, a memory-mapped cache file, ...);  any
+// of Nrm, Tex, and Tan may be empty.
+unsigned int VaoFromArrays(const glm::vec4* Pnt, const size_t nPnt,
+                           const glm::vec3* Nrm, const size_t nNrm,
+                           const glm::vec2* Tex, const size_t nTex,
+                           const glm::vec3* Tan, const size_t nTan,
+                           const glm::ivec3* Tri, const size_t nTri)
 {
-    printf("VaoFromTris %ld %ld\n", Pnt.size(), Tri.size());
+    printf("VaoFromTris %ld %ld\n", (long)nPnt, (long)nTri);
     unsigned int vaoID;
     glGenVertexArrays(1, &vaoID);
     glBindVertexArray(vaoID);
@@ -67,38 +99,38 @@ unsigned int VaoFromTris(std::vector<glm::vec4> Pnt,
     GLuint Pbuff;
     glGenBuffers(1, &Pbuff);
     glBindBuffer(GL_ARRAY_BUFFER, Pbuff);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*4*Pnt.size(),
-                 &Pnt[0][0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*4*nPnt,
+                 Pnt, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    if (Nrm.size() > 0) {
+    if (nNrm > 0) {
         GLuint Nbuff;
         glGenBuffers(1, &Nbuff);
         glBindBuffer(GL_ARRAY_BUFFER, Nbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*Nrm.size(),
-                     &Nrm[0][0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*nNrm,
+                     Nrm, GL_STATIC_DRAW);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
         glBindBuffer(GL_ARRAY_BUFFER, 0); }
 
-    if (Tex.size() > 0) {
+    if (nTex > 0) {
         GLuint Tbuff;
         glGenBuffers(1, &Tbuff);
         glBindBuffer(GL_ARRAY_BUFFER, Tbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*2*Tex.size(),
-                     &Tex[0][0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*2*nTex,
+                     Tex, GL_STATIC_DRAW);
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
         glBindBuffer(GL_ARRAY_BUFFER, 0); }
 
-    if (Tan.size() > 0) {
+    if (nTan > 0) {
         GLuint Dbuff;
         glGenBuffers(1, &Dbuff);
         glBindBuffer(GL_ARRAY_BUFFER, Dbuff);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*Tan.size(),
-                     &Tan[0][0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(float)*3*nTan,
+                     Tan, GL_STATIC_DRAW);
         glEnableVertexAttribArray(3);
         glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
         glBindBuffer(GL_ARRAY_BUFFER, 0); }
@@ -106,14 +138,25 @@ unsigned int VaoFromTris(std::vector<glm::vec4> Pnt,
     GLuint Ibuff;
     glGenBuffers(1, &Ibuff);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Ibuff);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int)*3*Tri.size(),
-                 &Tri[0][0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int)*3*nTri,
+                 Tri, GL_STATIC_DRAW);
 
     glBindVertexArray(0);
 
     return vaoID;
 }
 
+unsigned int VaoFromTris(const std::vector<glm::vec4>& Pnt,
+                         const std::vector<glm::vec3>& Nrm,
+                         const std::vector<glm::vec2>& Tex,
+                         const std::vector<glm::vec3>& Tan,
+                         const std::vector<glm::ivec3>& Tri)
+{
+    return VaoFromArrays(Pnt.data(), Pnt.size(), Nrm.data(), Nrm.size(),
+                         Tex.data(), Tex.size(), Tan.data(), Tan.size(),
+                         Tri.data(), Tri.size());
+}
+
 void Shape::ComputeSize()
 {
     // Compute min/max
@@ -133,10 +176,59 @@ void Shape::ComputeSize()
     modelTr = Scale(s,s,s)*Translate(-center[0], -center[1], -center[2]);
 }
 
+// Returns the bounding sphere (false if the shape has no points).
+bool Shape::Bound(glm::vec3& c, float& radius)
+{
+    MeshArrays a = Data();
+    if (boundRadius < 0.0f) {
+        glm::vec3 lo(0.0f), hi(0.0f);
+        for (size_t i=0;  i<a.nPnt;  i++) {
+            lo = i ? glm::min(lo, a.Pnt[i].xyz()) : a.Pnt[i].xyz();
+            hi = i ? glm::max(hi, a.Pnt[i].xyz()) : a.Pnt[i].xyz(); }
+        boundCenter = (lo + hi)/2.0f;
+        boundRadius = 0.0f;
+        for (size_t i=0;  i<a.nPnt;  i++)
+            boundRadius = std::max(boundRadius, glm::length(a.Pnt[i].xyz() - boundCenter)); }
+    c = boundCenter;
+    radius = boundRadius;
+    return a.nPnt > 0;
+}
+
+void DeleteVao(const unsigned int vaoID)
+{
+    if (!vaoID) return;
+    glBindVertexArray(vaoID);
+    GLuint buffers[5] = {0, 0, 0, 0, 0};
+    for (int a=0;  a<4;  a++)
+        glGetVertexAttribiv(a, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, (GLint*)&buffers[a]);
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, (GLint*)&buffers[4]);
+    glBindVertexArray(0);
+    for (int b=0;  b<5;  b++)
+        if (buffers[b]) glDeleteBuffers(1, &buffers[b]);
+    glDeleteVertexArrays(1, &vaoID);
+}
+
+thread_local bool deferVAO = false;
+
+Shape::~Shape()
+{
+    delete mapping;
+}
+
+MeshArrays Shape::Data() const
+{
+    if (mapping) return mapping->arrays;
+    MeshArrays a = { Pnt.data(), Pnt.size(), Nrm.data(), Nrm.size(), Tex.data(), Tex.size(),
+                     Tan.data(), Tan.size(), Tri.data(), Tri.size() };
+    return a;
+}
+
 void Shape::MakeVAO()
 {
-    vaoID = VaoFromTris(Pnt, Nrm, Tex, Tan, Tri);
-    count = Tri.size();
+    MeshArrays a = Data();
+    count = a.nTri;
+    if (!deferVAO)
+        vaoID = VaoFromArrays(a.Pnt, a.nPnt, a.Nrm, a.nNrm, a.Tex, a.nTex, a.Tan, a.nTan, a.Tri, a.nTri);
 }
 
 void Shape::DrawVAO()
@@ -311,6 +403,10 @@ Teapot::Teapot(const int n)
     shininess = 120.0;
     animate = true;
 
+    // The tessellation depends only on n, so it is cached.
+    uint64_t key = Hash64(&n, sizeof(n), Hash64("teapot"));
+    if (ReadMeshCache(key, this)) return;
+
     int npatches = sizeof(TeapotIndex)/sizeof(TeapotIndex[0]); // Should be 32 patches for the teapot
     const int nv = npatches*(n+1)*(n+1);
     int nq = npatches*n*n;
@@ -401,6 +497,7 @@ Teapot::Teapot(const int n)
                              p*(n+1)*(n+1) + (i  )*(n+1) + (j-1)); } } }
     ComputeSize();
     MakeVAO();
+    WriteMeshCache(key, this);
 }
 
 
@@ -540,49 +637,76 @@ Cylinder::Cylinder(const int n)
 // Generates a plane with normals, texture coords, and tangent vectors
 // from an n by n grid of small quads.  A single quad might have been
 // sufficient, but that works poorly with the reflection map.
-Ply::Ply(const char* name, const bool reverse)
+Ply::Ply(const char* name, const bool reverse, const bool weld)
 {
     diffuseColor = glm::vec3(0.8, 0.8, 0.5);
     specularColor = glm::vec3(1.0, 1.0, 1.0);
     shininess = 120.0;
 
+    // The finished (welded or not, with tangents) mesh is cached, keyed
+    // by the file's size and date.
+    uint64_t key = HashFileStamp(name, Hash64(weld ? "ply welded, vertex tangents"
+                                                   : "ply unwelded, vertex tangents"));
+    if (ReadMeshCache(key, this)) return;
+
+    // Common PLY layouts are decoded in bulk;  anything else goes through rply.
+    if (!ReadPlyFast(name, this))
+        ReadRply(name, this);
+
+    // Exporters often write every triangle's corners separately.
+    if (weld) WeldVertices(this);
+    ComputeTangents(this);
+    ComputeSize();
+    MakeVAO();
+    WriteMeshCache(key, this);
+}
+ 
+
+// Reads a PLY file through rply's per-scalar callbacks into shape's
+// data arrays.  (Also the reference that ReadPlyFast must agree with.)
+void Ply::ReadRply(const char* name, Shape* shape)
+{
     // Open PLY file and read header;  Exit on any failure.
     p_ply ply = ply_open(name, NULL, 0, NULL);
     if (!ply) { throw std::exception(); }
     if (!ply_read_header(ply)) { throw std::exception(); }
 
     // Setup callback for vertices
-    ply_set_read_cb(ply, "vertex", "x", vertex_cb, this, 0);
-    ply_set_read_cb(ply, "vertex", "y", vertex_cb, this, 1);
-    ply_set_read_cb(ply, "vertex", "z", vertex_cb, this, 2);
+    ply_set_read_cb(ply, "vertex", "x", vertex_cb, shape, 0);
+    ply_set_read_cb(ply, "vertex", "y", vertex_cb, shape, 1);
+    ply_set_read_cb(ply, "vertex", "z", vertex_cb, shape, 2);
 
-    ply_set_read_cb(ply, "vertex", "nx", normal_cb, this, 0);
-    ply_set_read_cb(ply, "vertex", "ny", normal_cb, this, 1);
-    ply_set_read_cb(ply, "vertex", "nz", normal_cb, this, 2);
+    ply_set_read_cb(ply, "vertex", "nx", normal_cb, shape, 0);
+    ply_set_read_cb(ply, "vertex", "ny", normal_cb, shape, 1);
+    ply_set_read_cb(ply, "vertex", "nz", normal_cb, shape, 2);
 
-    ply_set_read_cb(ply, "vertex", "s", texture_cb, this, 0);
-    ply_set_read_cb(ply, "vertex", "t", texture_cb, this, 1);
+    // Texture coordinates and face indices go by either name, as in
+    // ReadPlyFast;  the usual one wins if a file has both.
+    if (!ply_set_read_cb(ply, "vertex", "s", texture_cb, shape, 0))
+        ply_set_read_cb(ply, "vertex", "u", texture_cb, shape, 0);
+    if (!ply_set_read_cb(ply, "vertex", "t", texture_cb, shape, 1))
+        ply_set_read_cb(ply, "vertex", "v", texture_cb, shape, 1);
 
     // Setup callback for faces
-    ply_set_read_cb(ply, "face", "vertex_indices", face_cb, this, 0);
+    if (!ply_set_read_cb(ply, "face", "vertex_indices", face_cb, shape, 0))
+        ply_set_read_cb(ply, "face", "vertex_index", face_cb, shape, 0);
 
     // Read the PLY file filling the arrays via the callbacks.
     if (!ply_read(ply)) {printf("Failure in ply_read\n"); exit(-1); }
-
-    ComputeSize();
-    MakeVAO();
+    ply_close(ply);
 }
- 
 
-glm::vec4 staticPnt;
-glm::vec3 staticNrm;
-glm::vec2 staticTex;
-glm::ivec3 staticTri;
+// The element being assembled by the callbacks.  Per thread, since
+// models load on the worker pool, several at a time.
+static thread_local glm::vec4 staticPnt;
+static thread_local glm::vec3 staticNrm;
+static thread_local glm::vec2 staticTex;
+static thread_local glm::ivec3 staticTri;
 
 // Vertex callback;  Must be static (stupid C++)
 int Ply::vertex_cb(p_ply_argument argument) {
     long index;
-    Ply *ply;
+    Shape *ply;
     ply_get_argument_user_data(argument, (void**)&ply, &index);
     double c = ply_get_argument_value(argument);
     staticPnt[index] = c;
@@ -595,7 +719,7 @@ int Ply::vertex_cb(p_ply_argument argument) {
 // Normal callback;  Must be static (stupid C++)
 int Ply::normal_cb(p_ply_argument argument) {
     long index;
-    Ply *ply;
+    Shape *ply;
     ply_get_argument_user_data(argument, (void**)&ply, &index);
     double c = ply_get_argument_value(argument);
     staticNrm[index] = c;
@@ -606,7 +730,7 @@ int Ply::normal_cb(p_ply_argument argument) {
 // Texture callback;  Must be static (stupid C++)
 int Ply::texture_cb(p_ply_argument argument) {
     long index;
-    Ply *ply;
+    Shape *ply;
     ply_get_argument_user_data(argument, (void**)&ply, &index);
     double c = ply_get_argument_value(argument);
     staticTex[index] = c;
@@ -615,27 +739,73 @@ int Ply::texture_cb(p_ply_argument argument) {
     return 1;
 }
 
-void ComputeTangent(Ply* ply)
+// Sets every vertex's tangent from the texture coordinates of the
+// triangles around it.  Each triangle's tangent and bitangent (the
+// directions of increasing s and t), weighted by its area, are found
+// in parallel by bands of triangles;  then each vertex, also in
+// parallel, sums those of its own triangles (in triangle order) and
+// orthonormalizes the sum against its normal.  No two threads write
+// the same element, so no atomics are needed.  Without texture
+// coordinates the tangents are left zero.
+void ComputeTangents(Shape* shape)
 {
-    int t = ply->Tri.size() - 1;
-    int i = ply->Tri[t][0];
-    int j = ply->Tri[t][1];
-    int k = ply->Tri[t][2];
-    glm::vec2 A = ply->Tex[i] - ply->Tex[k]; 
-    glm::vec2 B = ply->Tex[j] - ply->Tex[k];
-    float d = A[0]*B[1] - A[1]*B[0];
-    float a =  B[1]/d;
-    float b = -A[1]/d;
-    glm::vec4 Tan = a*ply->Pnt[i] + b*ply->Pnt[j] + (1.0f-a-b)*ply->Pnt[k];
-    ply->Tan[i] = ply->Tan[j] = ply->Tan[k] = glm::normalize(Tan.xyz());
-    
+    int nv = shape->Pnt.size();
+    int nt = shape->Tri.size();
+    shape->Tan.assign(nv, glm::vec3(0.0f));
+    if ((int)shape->Tex.size() != nv) return;
+    bool hasNrm = (int)shape->Nrm.size() == nv;
+    const int grain = 4096;
+
+    std::vector<glm::vec3> faceT(nt), faceB(nt), faceN(nt);
+    Workers().ParallelFor(nt, [&](int begin, int end) {
+            for (int t=begin;  t<end;  t++) {
+                glm::ivec3 T = shape->Tri[t];
+                glm::vec3 E1 = (shape->Pnt[T[1]] - shape->Pnt[T[0]]).xyz();
+                glm::vec3 E2 = (shape->Pnt[T[2]] - shape->Pnt[T[0]]).xyz();
+                glm::vec2 A = shape->Tex[T[1]] - shape->Tex[T[0]];
+                glm::vec2 B = shape->Tex[T[2]] - shape->Tex[T[0]];
+                float d = A[0]*B[1] - A[1]*B[0];
+                glm::vec3 S = (d < 0.0f ? -1.0f : 1.0f)*(E1*B[1] - E2*A[1]);
+                glm::vec3 U = (d < 0.0f ? -1.0f : 1.0f)*(E2*A[0] - E1*B[0]);
+                faceN[t] = glm::cross(E1, E2);
+                float area = glm::length(faceN[t]);
+                faceT[t] = glm::length(S) > 0.0f ? area*glm::normalize(S) : glm::vec3(0.0f);
+                faceB[t] = glm::length(U) > 0.0f ? area*glm::normalize(U) : glm::vec3(0.0f); } }, grain);
+
+    // The triangles around each vertex, in triangle order.
+    std::vector<int> start(nv+1, 0), around(3*nt);
+    for (int t=0;  t<nt;  t++)
+        for (int c=0;  c<3;  c++) start[shape->Tri[t][c]+1]++;
+    for (int v=0;  v<nv;  v++) start[v+1] += start[v];
+    std::vector<int> fill(start.begin(), start.end()-1);
+    for (int t=0;  t<nt;  t++)
+        for (int c=0;  c<3;  c++) around[fill[shape->Tri[t][c]]++] = t;
+
+    Workers().ParallelFor(nv, [&](int begin, int end) {
+            for (int v=begin;  v<end;  v++) {
+                glm::vec3 T(0.0f), B(0.0f), N(0.0f);
+                for (int k=start[v];  k<start[v+1];  k++) {
+                    T += faceT[around[k]];
+                    B += faceB[around[k]];
+                    N += faceN[around[k]]; }
+                if (hasNrm) N = shape->Nrm[v];
+                if (glm::length(N) == 0.0f) continue;
+                N = glm::normalize(N);
+
+                // Gram-Schmidt;  fall back on the bitangent, then on any
+                // direction perpendicular to N.
+                glm::vec3 Tan = T - N*glm::dot(N, T);
+                if (glm::length(Tan) < 1e-6f*glm::length(T) || glm::length(T) == 0.0f)
+                    Tan = glm::cross(B, N);
+                if (glm::length(Tan) == 0.0f)
+                    Tan = glm::cross(fabs(N.x) < 0.9f ? glm::vec3(1,0,0) : glm::vec3(0,1,0), N);
+                shape->Tan[v] = glm::normalize(Tan); } }, grain);
 }
 
-// Face callback;  Must be static (stupid C++)
 int Ply::face_cb(p_ply_argument argument) {
     long length, value_index;
     long index;
-    Ply *ply;
+    Shape *ply;
     ply_get_argument_user_data(argument, (void**)&ply, &index);
     ply_get_argument_property(argument, NULL, &length, &value_index);
 
@@ -646,13 +816,11 @@ int Ply::face_cb(p_ply_argument argument) {
             staticTri[value_index] = (int)ply_get_argument_value(argument); }
         else if (value_index==2) {
             staticTri[2] = (int)ply_get_argument_value(argument);
-            ply->Tri.push_back(staticTri);
-            ComputeTangent(ply); }
+            ply->Tri.push_back(staticTri); }
         else if (value_index==3) {
             staticTri[1] = staticTri[2];
             staticTri[2] = (int)ply_get_argument_value(argument);
-            ply->Tri.push_back(staticTri);
-            ComputeTangent(ply); } }
+            ply->Tri.push_back(staticTri); } }
 
     return 1;
 }
@@ -667,22 +835,23 @@ Plane::Plane(const float r, const int n)
     specularColor = glm::vec3(1.0, 1.0, 1.0);
     shininess = 120.0;
 
-    for (int i=0;  i<=n;  i++) {
-        float s = i/float(n);
-        for (int j=0;  j<=n;  j++) {
-            float t = j/float(n);
-            Pnt.push_back(glm::vec4(s*2.0*r-r, t*2.0*r-r, 0.0, 1.0));
-            Nrm.push_back(glm::vec3(0.0, 0.0, 1.0));
-            Tex.push_back(glm::vec2(s, t));
-            Tan.push_back(glm::vec3(1.0, 0.0, 0.0));
-            if (i>0 && j>0) {
-                pushquad(Tri, (i-1)*(n+1) + (j-1),
-                                      (i-1)*(n+1) + (j),
-                                      (i  )*(n+1) + (j),
-                                      (i  )*(n+1) + (j-1)); } } }
+    // Rows are independent, so they are filled in parallel bands
+    // directly into the preallocated arrays.
+    gridresize(this, n);
+    Workers().ParallelFor(n+1, [&](int i0, int i1) {
+        for (int i=i0;  i<i1;  i++) {
+            float s = i/float(n);
+            for (int j=0;  j<=n;  j++) {
+                float t = j/float(n);
+                int v = i*(n+1) + j;
+                Pnt[v] = glm::vec4(s*2.0*r-r, t*2.0*r-r, 0.0, 1.0);
+                Nrm[v] = glm::vec3(0.0, 0.0, 1.0);
+                Tex[v] = glm::vec2(s, t);
+                Tan[v] = glm::vec3(1.0, 0.0, 0.0); }
+            if (i>0)
+                gridquads(Tri, i, n); } }, 16);
 
-    vaoID = VaoFromTris(Pnt, Nrm, Tex, Tan, Tri);
-    count = Tri.size();
+    MakeVAO();
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -693,7 +862,7 @@ ProceduralGround::ProceduralGround(const float _range, const int n,
                      const float _octaves, const float _persistence, const float _scale,
                      const float _low, const float _high)
     :range(_range), octaves(_octaves), persistence(_persistence), scale(_scale), 
-     low(_low), high(_high)
+     low(_low), high(_high), island(true)
 {
     diffuseColor = glm::vec3(0.3, 0.2, 0.1);
     specularColor = glm::vec3(1.0, 1.0, 1.0);
@@ -701,38 +870,35 @@ ProceduralGround::ProceduralGround(const float _range, const int n,
     specularColor = glm::vec3(0.0, 0.0, 0.0);
     xoff = range*( time(NULL)%1000 );
 
-    float h = 0.001;
-    for (int i=0;  i<=n;  i++) {
-        float s = i/float(n);
-        for (int j=0;  j<=n;  j++) {
-            float t = j/float(n);
-            float x = s*2.0*range-range;
-            float y = t*2.0*range-range;
-            float z = HeightAt(x, y);
-            float zu = HeightAt(x+h, y);
-            float zv = HeightAt(x, y+h);
-            Pnt.push_back(glm::vec4(x, y, z, 1.0));
-            glm::vec3 du(1.0, 0.0, (zu-z)/h);
-            glm::vec3 dv(0.0, 1.0, (zv-z)/h);
-            Nrm.push_back(glm::normalize(glm::cross(du,dv)));
-            Tex.push_back(glm::vec2(s, t));
-            Tan.push_back(glm::vec3(1.0, 0.0, 0.0));
-            if (i>0 && j>0) {
-                pushquad(Tri,
-                         (i-1)*(n+1) + (j-1),
-                         (i-1)*(n+1) + (j),
-                         (i  )*(n+1) + (j),
-                         (i  )*(n+1) + (j-1)); } } }
-
-    vaoID = VaoFromTris(Pnt, Nrm, Tex, Tan, Tri);
-    count = Tri.size();
+    // Each vertex costs three noise evaluations, and rows are
+    // independent, so rows are computed in parallel bands directly
+    // into the preallocated arrays.  The result is identical to
+    // filling them serially.
+    gridresize(this, n);
+    Workers().ParallelFor(n+1, [&](int i0, int i1) {
+        for (int i=i0;  i<i1;  i++) {
+            float s = i/float(n);
+            for (int j=0;  j<=n;  j++) {
+                float t = j/float(n);
+                float x = s*2.0*range-range;
+                float y = t*2.0*range-range;
+                float z = HeightAt(x, y);
+                int v = i*(n+1) + j;
+                Pnt[v] = glm::vec4(x, y, z, 1.0);
+                Nrm[v] = NormalAt(x, y, z);
+                Tex[v] = glm::vec2(s, t);
+                Tan[v] = glm::vec3(1.0, 0.0, 0.0); }
+            if (i>0)
+                gridquads(Tri, i, n); } }, 4);
+
+    MakeVAO();
 }
 
 float ProceduralGround::HeightAt(const float x, const float y)
 {
     glm::vec3 highPoint = glm::vec3(0.0, 0.0, 0.01);
 
-    float rs = glm::smoothstep(range-20.0f, range, sqrtf(x*x+y*y));
+    float rs = island ? glm::smoothstep(range-20.0f, range, sqrtf(x*x+y*y)) : 0.0f;
     float noise = scaled_octave_noise_2d(octaves, persistence, scale, low, high, x+xoff, y);
     float z = (1-rs)*noise + rs*low;
     
@@ -741,6 +907,17 @@ float ProceduralGround::HeightAt(const float x, const float y)
     return (1-hs)*highPoint.z + hs*z;
 }
 
+// Surface normal from forward differences of HeightAt; z must be HeightAt(x,y).
+glm::vec3 ProceduralGround::NormalAt(const float x, const float y, const float z)
+{
+    float h = 0.001;
+    float zu = HeightAt(x+h, y);
+    float zv = HeightAt(x, y+h);
+    glm::vec3 du(1.0, 0.0, (zu-z)/h);
+    glm::vec3 dv(0.0, 1.0, (zv-z)/h);
+    return glm::normalize(glm::cross(du,dv));
+}
+
 ////////////////////////////////////////////////////////////////////////
 // Generates a square divided into nxn quads;  +-1 in X and Y at Z=0
 Quad::Quad(const int n)
@@ -750,21 +927,21 @@ Quad::Quad(const int n)
     shininess = 120.0;
 
     float r = 1.0;
-    for (int i=0;  i<=n;  i++) {
-        float s = i/float(n);
-        for (int j=0;  j<=n;  j++) {
-            float t = j/float(n);
-            Pnt.push_back(glm::vec4(s*2.0*r-r, t*2.0*r-r, 0.0, 1.0));
-            Nrm.push_back(glm::vec3(0.0, 0.0, 1.0));
-            Tex.push_back(glm::vec2(s, t));
-            Tan.push_back(glm::vec3(1.0, 0.0, 0.0));
-            if (i>0 && j>0) {
-                pushquad(Tri,
-                         (i-1)*(n+1) + (j-1),
-                         (i-1)*(n+1) + (j),
-                         (i  )*(n+1) + (j),
-                         (i  )*(n+1) + (j-1)); } } }
-
-    vaoID = VaoFromTris(Pnt, Nrm, Tex, Tan, Tri);
-    count = Tri.size();
+    // Rows are independent, so they are filled in parallel bands
+    // directly into the preallocated arrays.
+    gridresize(this, n);
+    Workers().ParallelFor(n+1, [&](int i0, int i1) {
+        for (int i=i0;  i<i1;  i++) {
+            float s = i/float(n);
+            for (int j=0;  j<=n;  j++) {
+                float t = j/float(n);
+                int v = i*(n+1) + j;
+                Pnt[v] = glm::vec4(s*2.0*r-r, t*2.0*r-r, 0.0, 1.0);
+                Nrm[v] = glm::vec3(0.0, 0.0, 1.0);
+                Tex[v] = glm::vec2(s, t);
+                Tan[v] = glm::vec3(1.0, 0.0, 0.0); }
+            if (i>0)
+                gridquads(Tri, i, n); } }, 16);
+
+    MakeVAO();
 }
@@ -28,6 +28,18 @@
 
 #include <vector>
 
+struct MeshMapping;
+
+// A shape's data arrays as pointers and counts (see Shape::Data).
+struct MeshArrays
+{
+    const glm::vec4* Pnt;  size_t nPnt;
+    const glm::vec3* Nrm;  size_t nNrm;
+    const glm::vec2* Tex;  size_t nTex;
+    const glm::vec3* Tan;  size_t nTan;
+    const glm::ivec3* Tri; size_t nTri;
+};
+
 class Shape
 {
 public:
@@ -56,15 +68,53 @@ public:
     glm::mat4 modelTr;
     bool animate;
 
+    // Bounding sphere in the shape's own coordinates (found on first
+    // use by Bound;  boundRadius is negative until then)
+    glm::vec3 boundCenter;
+    float boundRadius;
+
+    // A mesh cache file the shape was read from without copying it
+    // into the data arrays (see meshcache.h), kept mapped for as long
+    // as the shape lives;  NULL otherwise.
+    MeshMapping* mapping;
+
     // Constructor and destructor
-    Shape() :animate(false) {}
-    virtual ~Shape() {}
+    Shape() :vaoID(0), count(0), animate(false), boundRadius(-1.0f), mapping(NULL) {}
+    virtual ~Shape();
+
+    // The arrays the VAO is made from:  the mapping's, or the data arrays.
+    MeshArrays Data() const;
 
     virtual void ComputeSize();
+    bool Bound(glm::vec3& center, float& radius);
     virtual void MakeVAO();
     virtual void DrawVAO();
 };
 
+// Sends the data arrays to the graphics card as a new VAO and returns its id.
+unsigned int VaoFromTris(const std::vector<glm::vec4>& Pnt,
+                         const std::vector<glm::vec3>& Nrm,
+                         const std::vector<glm::vec2>& Tex,
+                         const std::vector<glm::vec3>& Tan,
+                         const std::vector<glm::ivec3>& Tri);
+unsigned int VaoFromArrays(const glm::vec4* Pnt, const size_t nPnt,
+                           const glm::vec3* Nrm, const size_t nNrm,
+                           const glm::vec2* Tex, const size_t nTex,
+                           const glm::vec3* Tan, const size_t nTan,
+                           const glm::ivec3* Tri, const size_t nTri);
+
+// Set (per thread) while the asset loader builds shapes on a worker:
+// MakeVAO and the mesh cache then fill in the data arrays but leave
+// the upload to the loader, which does it on the render thread.
+extern thread_local bool deferVAO;
+
+// Deletes a VAO made by VaoFromArrays, and its buffers.
+void DeleteVao(const unsigned int vaoID);
+
+// Sets every vertex's tangent (orthogonal to its normal) from the
+// texture coordinates of its triangles.  Run once, after loading.
+void ComputeTangents(Shape* shape);
+
 class Box: public Shape
 {
   void face(const glm::mat4x4 tr);
@@ -112,11 +162,13 @@ public:
     float low;
     float high;
     float xoff;
+    bool island;                // False: no falloff to sea level beyond range
 
     ProceduralGround(const float _range, const int n,
                      const float _octaves, const float _persistence, const float _scale,
                      const float _low, const float _high);
     float HeightAt(const float x, const float y);
+    glm::vec3 NormalAt(const float x, const float y, const float z);
 };
 
 class Quad: public Shape
@@ -128,8 +180,11 @@ public:
 class Ply: public Shape
 {
 public:
-    Ply(const char* name, const bool reverse=false);
+    // Duplicate vertices are welded unless weld is false (for meshes
+    // whose vertex order matters to something else).
+    Ply(const char* name, const bool reverse=false, const bool weld=true);
     virtual ~Ply() {printf("destruct Ply\n");};
+    static void ReadRply(const char* name, Shape* shape);
     static int vertex_cb(p_ply_argument argument);
     static int normal_cb(p_ply_argument argument);
     static int texture_cb(p_ply_argument argument);
@@ -0,0 +1,171 @@
+////////////////////////////////////////////////////////////////////////
+// Spherical harmonic irradiance, projected from an equirectangular
+// environment on the CPU.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SH_SSE2
+#endif
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "shirradiance.h"
+#include "texture.h"
+#include "mipchain.h"
+#include "texcompress.h"
+#include "imageformat.h"
+#include "workers.h"
+
+static const float PI = 3.14159265358979f;
+
+// The real SH basis constants (Y = constant times a polynomial in the
+// direction), and the clamped cosine's convolution factor per band.
+static const float basis[9] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f,
+                                1.092548f, 0.315392f, 1.092548f, 0.546274f };
+static const float band[9] = { PI, 2.0f*PI/3.0f, 2.0f*PI/3.0f, 2.0f*PI/3.0f, PI/4.0f,
+                               PI/4.0f, PI/4.0f, PI/4.0f, PI/4.0f };
+
+IrradianceSH::IrradianceSH(const int _maxWidth)
+    : maxWidth(_maxWidth), started(false), projected(false)
+{
+    for (int i=0;  i<9;  i++) coefficients[i] = glm::vec3(0.0f);
+}
+
+void IrradianceSH::Project(const float* rgb, const int width, const int height, glm::vec3* out)
+{
+    // Per column:  cos(phi), sin(phi), cos*sin, and cos^2 - sin^2, the
+    // factors of x, y, xy and x^2-y^2 (over sin(theta) or its square)
+    std::vector<float> column(4*(size_t)width);
+    for (int x=0;  x<width;  x++) {
+        float phi = 2.0f*PI*(0.5f - (x + 0.5f)/width), c = cosf(phi), s = sinf(phi);
+        column[4*x] = c;  column[4*x+1] = s;  column[4*x+2] = c*s;  column[4*x+3] = c*c - s*s; }
+
+    // Each row's nine coefficients, summed in order afterwards (so the
+    // result doesn't depend on how rows were spread over the workers)
+    std::vector<glm::vec3> rows(9*(size_t)height);
+    Workers().ParallelFor(height, [&](int begin, int end) {
+        for (int y=begin;  y<end;  y++) {
+            const float* row = rgb + 3*(size_t)y*width;
+            float sum[5][4];    // Of C, C cos, C sin, C cos sin, C (cos^2 - sin^2)
+#ifdef SH_SSE2
+            __m128 S[5];
+            for (int k=0;  k<5;  k++) S[k] = _mm_setzero_ps();
+            for (int x=0;  x<width;  x++) {
+                // A texel's RGB (and the next's R, which is ignored),
+                // except at the end of the row, which mustn't be overrun
+                __m128 C = x+1 < width ? _mm_loadu_ps(row + 3*x)
+                                       : _mm_setr_ps(row[3*x], row[3*x+1], row[3*x+2], 0.0f);
+                const float* f = &column[4*x];
+                S[0] = _mm_add_ps(S[0], C);
+                S[1] = _mm_add_ps(S[1], _mm_mul_ps(C, _mm_set1_ps(f[0])));
+                S[2] = _mm_add_ps(S[2], _mm_mul_ps(C, _mm_set1_ps(f[1])));
+                S[3] = _mm_add_ps(S[3], _mm_mul_ps(C, _mm_set1_ps(f[2])));
+                S[4] = _mm_add_ps(S[4], _mm_mul_ps(C, _mm_set1_ps(f[3]))); }
+            for (int k=0;  k<5;  k++) _mm_storeu_ps(sum[k], S[k]);
+#else
+            for (int k=0;  k<5;  k++) sum[k][0] = sum[k][1] = sum[k][2] = 0.0f;
+            for (int x=0;  x<width;  x++) {
+                const float* f = &column[4*x];
+                for (int ch=0;  ch<3;  ch++) {
+                    float c = row[3*x + ch];
+                    sum[0][ch] += c;
+                    sum[1][ch] += c*f[0];
+                    sum[2][ch] += c*f[1];
+                    sum[3][ch] += c*f[2];
+                    sum[4][ch] += c*f[3]; } }
+#endif
+            // Row y (from the bottom) spans polar angles theta0 down to
+            // theta1;  each texel covers 1/width of that band's area
+            float theta0 = PI*(1.0f - (float)y/height), theta1 = PI*(1.0f - (y + 1.0f)/height);
+            float theta = 0.5f*(theta0 + theta1), z = cosf(theta), s = sinf(theta);
+            float area = 2.0f*PI/width*(cosf(theta1) - cosf(theta0));
+            glm::vec3 S0(sum[0][0], sum[0][1], sum[0][2]), Sc(sum[1][0], sum[1][1], sum[1][2]),
+                Ss(sum[2][0], sum[2][1], sum[2][2]), Scs(sum[3][0], sum[3][1], sum[3][2]),
+                Sd(sum[4][0], sum[4][1], sum[4][2]);
+            glm::vec3* r = &rows[9*(size_t)y];
+            r[0] = area*S0;                     // 1
+            r[1] = area*s*Ss;                   // y
+            r[2] = area*z*S0;                   // z
+            r[3] = area*s*Sc;                   // x
+            r[4] = area*s*s*Scs;                // xy
+            r[5] = area*s*z*Ss;                 // yz
+            r[6] = area*(3.0f*z*z - 1.0f)*S0;   // 3z^2 - 1
+            r[7] = area*s*z*Sc;                 // xz
+            r[8] = area*s*s*Sd; } }, 8);        // x^2 - y^2
+
+    // Radiance coefficients are basis*sum;  irradiance scales each band,
+    // and the shader's polynomials take the basis constant once more
+    for (int i=0;  i<9;  i++) {
+        glm::vec3 total(0.0f);
+        for (int y=0;  y<height;  y++) total += rows[9*(size_t)y + i];
+        out[i] = band[i]*basis[i]*basis[i]*total; }
+}
+
+// Reads the first level of the environment's cached chain no wider
+// than maxWidth, as RGB floats, and projects it.
+bool IrradianceSH::Read(const std::string& path)
+{
+    std::vector<float> rgb;
+    int width = 0, height = 0;
+    auto pick = [&](const int w, const int h, const int levels) {
+        int l = 0;
+        while (l+1 < levels && (w >> l) > maxWidth) l++;
+        width = std::max(1, w >> l);
+        height = std::max(1, h >> l);
+        rgb.resize(3*(size_t)width*height);
+        return l; };
+    auto bytes = [&](const unsigned char* rgba) {
+        for (size_t i=0;  i<(size_t)width*height;  i++)
+            for (int c=0;  c<3;  c++) rgb[3*i+c] = rgba[4*i+c]/255.0f; };
+
+    if (CompressedTexture* compressed = ReadCompressed(path)) {
+        int l = pick(compressed->width, compressed->height, compressed->levels);
+        if (compressed->format == BC6H)
+            DecompressImage(BC6H, compressed->level[l], width, height, &rgb[0]);
+        else {
+            std::vector<unsigned char> rgba(4*(size_t)width*height);
+            DecompressImage(compressed->format, compressed->level[l], width, height, &rgba[0]);
+            bytes(&rgba[0]); }
+        delete compressed; }
+    else if (MipChain* chain = ReadMipChain(path, mipFilter)) {
+        int l = pick(chain->width, chain->height, chain->levels);
+        if (chain->format == ImageR11G11B10F)
+            DecodeR11G11B10F((const uint32_t*)chain->level[l], &rgb[0], (size_t)width*height);
+        else
+            bytes(chain->level[l]);
+        delete chain; }
+    else {
+        printf("No mip chain for %s;  no diffuse IBL\n", path.c_str());
+        return false; }
+
+    Project(&rgb[0], width, height, coefficients);
+    printf("Irradiance SH for %s (from %dx%d)\n", path.c_str(), width, height);
+    return true;
+}
+
+void IrradianceSH::Update(const std::string& path, Texture* env)
+{
+    if (started || !env || !env->textureId) return;
+    started = true;
+    Workers().Submit([this, path]() {
+        if (Read(path)) projected = true; });
+}
+
+void IrradianceSH::Bind(const int programId)
+{
+    static glm::vec3 zero[9];
+    int loc = glGetUniformLocation(programId, "shIrradiance");
+    glUniform3fv(loc, 9, projected ? &coefficients[0][0] : &zero[0][0]);
+}
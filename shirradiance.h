@@ -0,0 +1,55 @@
+////////////////////////////////////////////////////////////////////////
+// Diffuse image based lighting from spherical harmonics.  The
+// irradiance an environment casts on a surface is its radiance
+// convolved with the clamped cosine, which passes almost nothing above
+// the second SH band, so nine coefficients (per color) describe it to
+// within a few percent.  The lighting pass evaluates them at the normal
+// in a few multiply-adds, in place of fetching a separately authored
+// irradiance map.
+//
+// The coefficients are projected on the CPU from a small level of the
+// environment's mip chain (as the texture's load cached it):  rows are
+// spread over the worker pool, and each row's sums are taken with the
+// texels' RGB in SSE2 registers where available.  An equirectangular
+// row shares one polar angle, so each needs just five running sums,
+// weighted by per-column cos and sin tables, times the row's solid
+// angle.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SHIRRADIANCE_
+#define _SHIRRADIANCE_
+
+#include <string>
+#include <atomic>
+
+class Texture;
+
+class IrradianceSH
+{
+ public:
+    int maxWidth;               // Widest mip level projected
+    glm::vec3 coefficients[9];  // Irradiance, with the basis constants folded in
+
+    IrradianceSH(const int maxWidth=256);
+
+    // Projects the environment at path on a worker, once env (the same
+    // file, loaded as a texture) has saved its mip chain.  Call every
+    // frame until Ready.
+    void Update(const std::string& path, Texture* env);
+
+    bool Ready() const { return projected; }
+
+    // Sets uniform vec3 shIrradiance[9] (all zero until Ready).
+    void Bind(const int programId);
+
+    // Projects an equirectangular image of width by height RGB floats
+    // (rows bottom up, as the lighting pass maps them) into coefficients.
+    static void Project(const float* rgb, const int width, const int height, glm::vec3* out);
+
+ private:
+    bool started;
+    std::atomic<bool> projected;
+    bool Read(const std::string& path);
+};
+
+#endif
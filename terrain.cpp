@@ -0,0 +1,260 @@
+////////////////////////////////////////////////////////////////////////
+// Streams an unbounded ProceduralGround as square tiles around the
+// eye.  Tiles are generated (heights, normals) on the worker threads,
+// uploaded a few per frame, and kept in an LRU cache of CPU and GPU
+// tile memory once they fall out of range.  All tiles share one index
+// buffer since they have identical topology.
+////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "math.h"
+#include "terrain.h"
+#include "workers.h"
+
+#include <glu.h>                // For gluErrorString
+#define CHECKERROR {GLenum err = glGetError(); if (err != GL_NO_ERROR) { fprintf(stderr, "OpenGL error (at line terrain.cpp:%d): %s\n", __LINE__, gluErrorString(err)); exit(-1);} }
+
+TerrainStreamer::TerrainStreamer(ProceduralGround* _ground, const float _tileSize, const int _tileRes,
+                                 const int _radius, const int _cacheTiles, const int _uploadsPerFrame)
+    : ground(_ground), tileSize(_tileSize), tileRes(_tileRes), radius(_radius),
+      cacheTiles(_cacheTiles), uploadsPerFrame(_uploadsPerFrame), inFlight(0), jobs(0)
+{
+    diffuseColor = ground->diffuseColor;
+    specularColor = ground->specularColor;
+    shininess = ground->shininess;
+    maxInFlight = 2*(Workers().Size()+1);
+
+    // One index buffer serves every tile.
+    int n = tileRes;
+    Tri.resize(2*n*n);
+    for (int i=1;  i<=n;  i++)
+        for (int j=1;  j<=n;  j++) {
+            int q = 2*((i-1)*n + (j-1));
+            Tri[q  ] = glm::ivec3((i-1)*(n+1) + (j-1), (i-1)*(n+1) + (j), (i)*(n+1) + (j));
+            Tri[q+1] = glm::ivec3((i-1)*(n+1) + (j-1), (i)*(n+1) + (j), (i)*(n+1) + (j-1)); }
+    count = Tri.size();
+
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int)*3*Tri.size(), &Tri[0][0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    modelTr = glm::mat4();
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+    // Jobs still running write into tiles owned here, so wait them out.
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(doneLock);
+            if (jobs == 0) break;
+        }
+        std::this_thread::yield(); }
+
+    for (std::map<TileKey, TerrainTile*>::iterator t=tiles.begin();  t!=tiles.end();  t++) {
+        if (t->second->vaoID) {
+            glDeleteVertexArrays(1, &t->second->vaoID);
+            glDeleteBuffers(1, &t->second->bufferID); }
+        delete t->second; }
+    for (size_t i=0;  i<freeGPU.size();  i++) {
+        glDeleteVertexArrays(1, &freeGPU[i].first);
+        glDeleteBuffers(1, &freeGPU[i].second); }
+    glDeleteBuffers(1, &indexBuffer);
+}
+
+size_t TerrainStreamer::VertexBytes() const
+{
+    size_t nv = size_t(tileRes+1)*(tileRes+1);
+    return nv*sizeof(float)*(4+3+2+3);
+}
+
+// Runs on a worker thread.  Touches only the tile and the (read-only)
+// ground parameters.
+void TerrainStreamer::Generate(TerrainTile* tile)
+{
+    int n = tileRes;
+    int nv = (n+1)*(n+1);
+    tile->Pnt.resize(nv);
+    tile->Nrm.resize(nv);
+    tile->Tex.resize(nv);
+    tile->Tan.resize(nv);
+
+    float range = ground->range;
+    for (int i=0;  i<=n;  i++) {
+        float x = (tile->tx + i/float(n))*tileSize;
+        for (int j=0;  j<=n;  j++) {
+            float y = (tile->ty + j/float(n))*tileSize;
+            float z = ground->HeightAt(x, y);
+            int v = i*(n+1) + j;
+            tile->Pnt[v] = glm::vec4(x, y, z, 1.0);
+            tile->Nrm[v] = ground->NormalAt(x, y, z);
+            // Same texture mapping as ProceduralGround, continued past the island.
+            tile->Tex[v] = glm::vec2((x+range)/(2*range), (y+range)/(2*range));
+            tile->Tan[v] = glm::vec3(1.0, 0.0, 0.0); } }
+
+    std::unique_lock<std::mutex> guard(doneLock);
+    done.push_back(tile);
+    jobs--;
+}
+
+// Copies a generated tile into GPU memory, reusing the buffers of an
+// evicted tile when one is available.  The four streams are stored
+// one after another in a single buffer.
+void TerrainStreamer::Upload(TerrainTile* tile)
+{
+    size_t nv = tile->Pnt.size();
+    size_t offN = nv*sizeof(glm::vec4);
+    size_t offT = offN + nv*sizeof(glm::vec3);
+    size_t offD = offT + nv*sizeof(glm::vec2);
+
+    if (!freeGPU.empty()) {
+        tile->vaoID = freeGPU.back().first;
+        tile->bufferID = freeGPU.back().second;
+        freeGPU.pop_back();
+        glBindBuffer(GL_ARRAY_BUFFER, tile->bufferID); }
+    else {
+        glGenVertexArrays(1, &tile->vaoID);
+        glBindVertexArray(tile->vaoID);
+        glGenBuffers(1, &tile->bufferID);
+        glBindBuffer(GL_ARRAY_BUFFER, tile->bufferID);
+        glBufferData(GL_ARRAY_BUFFER, VertexBytes(), NULL, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)offN);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (void*)offT);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, (void*)offD);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBindVertexArray(0); }
+
+    glBufferSubData(GL_ARRAY_BUFFER, 0,    offN,      &tile->Pnt[0][0]);
+    glBufferSubData(GL_ARRAY_BUFFER, offN, offT-offN, &tile->Nrm[0][0]);
+    glBufferSubData(GL_ARRAY_BUFFER, offT, offD-offT, &tile->Tex[0][0]);
+    glBufferSubData(GL_ARRAY_BUFFER, offD, VertexBytes()-offD, &tile->Tan[0][0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Drops the least recently used out-of-range tiles beyond the cache
+// size.  Their GPU buffers go on the free list for the next upload.
+void TerrainStreamer::Evict()
+{
+    while ((int)lru.size() > cacheTiles) {
+        TerrainTile* tile = lru.back();
+        if (!tile->generated) break;  // Still being generated; retry next frame
+        lru.pop_back();
+        if (tile->vaoID)
+            freeGPU.push_back(std::make_pair(tile->vaoID, tile->bufferID));
+        tiles.erase(TileKey(tile->tx, tile->ty));
+        delete tile; }
+}
+
+struct TileDistance
+{
+    int cx, cy;
+    TileDistance(int x, int y) : cx(x), cy(y) {}
+    int operator()(const TerrainTile* t) const
+    { return (t->tx-cx)*(t->tx-cx) + (t->ty-cy)*(t->ty-cy); }
+    bool operator()(const TerrainTile* a, const TerrainTile* b) const
+    { return (*this)(a) < (*this)(b); }
+};
+
+// Called once per frame.  Collects finished tiles, queues generation
+// of missing in-range tiles (nearest first), uploads at most
+// uploadsPerFrame tiles, and moves out-of-range tiles into the LRU
+// cache.  Nothing here is proportional to the tile resolution except
+// the bounded uploads.
+void TerrainStreamer::Update(const glm::vec3& eye)
+{
+    int cx = (int)floorf(eye.x/tileSize);
+    int cy = (int)floorf(eye.y/tileSize);
+    TileDistance dist(cx, cy);
+
+    // Collect tiles finished by the workers.
+    {
+        std::unique_lock<std::mutex> guard(doneLock);
+        for (size_t i=0;  i<done.size();  i++) {
+            done[i]->generated = true;
+            inFlight--; }
+        done.clear();
+    }
+
+    // Walk the in-range tiles: queue the missing ones, pull cached
+    // ones back out of the LRU list, and gather what needs uploading.
+    std::vector<TerrainTile*> wanted, uploads;
+    visible.clear();
+    for (int tx=cx-radius;  tx<=cx+radius;  tx++)
+        for (int ty=cy-radius;  ty<=cy+radius;  ty++) {
+            TileKey key(tx, ty);
+            std::map<TileKey, TerrainTile*>::iterator t = tiles.find(key);
+            if (t == tiles.end()) {
+                TerrainTile* tile = new TerrainTile();
+                tile->tx = tx;
+                tile->ty = ty;
+                tile->generated = false;
+                tile->vaoID = tile->bufferID = 0;
+                wanted.push_back(tile);
+                continue; }
+
+            TerrainTile* tile = t->second;
+            if (tile->cached) {
+                inRange.splice(inRange.end(), lru, tile->node);
+                tile->cached = false; }
+            if (tile->vaoID)
+                visible.push_back(tile);
+            else if (tile->generated)
+                uploads.push_back(tile); }
+
+    std::sort(wanted.begin(), wanted.end(), dist);
+    for (size_t i=0;  i<wanted.size();  i++) {
+        TerrainTile* tile = wanted[i];
+        if (inFlight >= maxInFlight) {
+            delete tile;        // Asked for again next frame
+            continue; }
+        tiles[TileKey(tile->tx, tile->ty)] = tile;
+        tile->cached = false;
+        tile->node = inRange.insert(inRange.end(), tile);
+        inFlight++;
+        {
+            std::unique_lock<std::mutex> guard(doneLock);
+            jobs++;
+        }
+        Workers().Submit([this, tile]() { Generate(tile); }); }
+
+    std::sort(uploads.begin(), uploads.end(), dist);
+    for (size_t i=0;  i<uploads.size() && (int)i<uploadsPerFrame;  i++) {
+        Upload(uploads[i]);
+        visible.push_back(uploads[i]); }
+
+    // Tiles that have left the range go to the front of the LRU list.
+    for (std::list<TerrainTile*>::iterator l=inRange.begin();  l!=inRange.end(); ) {
+        TerrainTile* tile = *l++;
+        if (abs(tile->tx-cx) <= radius && abs(tile->ty-cy) <= radius) continue;
+        lru.splice(lru.begin(), inRange, tile->node);
+        tile->cached = true; }
+
+    Evict();
+}
+
+void TerrainStreamer::DrawVAO()
+{
+    CHECKERROR;
+    for (size_t i=0;  i<visible.size();  i++) {
+        glBindVertexArray(visible[i]->vaoID);
+        glDrawElements(GL_TRIANGLES, 3*count, GL_UNSIGNED_INT, 0); }
+    glBindVertexArray(0);
+    CHECKERROR;
+}
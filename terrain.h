@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////
+// Streams an unbounded ProceduralGround as square tiles around the
+// eye.  Tiles are generated (heights, normals) on the worker threads,
+// uploaded a few per frame, and kept in an LRU cache of CPU and GPU
+// tile memory once they fall out of range.  All tiles share one index
+// buffer since they have identical topology.
+//
+// The streamer is a Shape, so it is placed in the scene like any
+// other:  new Object(terrain, groundId, ...).  Call Update(eye) once
+// per frame before drawing.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _TERRAIN_
+#define _TERRAIN_
+
+#include "shapes.h"
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <utility>
+
+struct TerrainTile
+{
+    int tx, ty;                 // Tile coordinates;  tile covers [tx,tx+1)*tileSize in X
+    bool generated;             // CPU arrays filled (by a worker thread)
+    unsigned int vaoID, bufferID; // GPU copy, 0 if not uploaded
+    bool cached;                // Out of range, so in the LRU list (else in the in-range one)
+    std::list<TerrainTile*>::iterator node; // Its place in that list
+    std::vector<glm::vec4> Pnt;
+    std::vector<glm::vec3> Nrm;
+    std::vector<glm::vec2> Tex;
+    std::vector<glm::vec3> Tan;
+};
+
+class TerrainStreamer: public Shape
+{
+ public:
+    typedef std::pair<int,int> TileKey;
+
+    ProceduralGround* ground;
+    float tileSize;             // World units per tile edge
+    int tileRes;                // Quads per tile edge
+    int radius;                 // Tiles kept visible in each direction around the eye
+    int cacheTiles;             // Out-of-range tiles kept (CPU and GPU) for reuse
+    int uploadsPerFrame;        // GPU upload budget
+    int maxInFlight;            // Generation jobs queued at once
+
+    TerrainStreamer(ProceduralGround* _ground, const float _tileSize, const int _tileRes,
+                    const int _radius, const int _cacheTiles, const int _uploadsPerFrame=2);
+    virtual ~TerrainStreamer();
+
+    void Update(const glm::vec3& eye);
+    virtual void DrawVAO();
+
+ private:
+    std::map<TileKey, TerrainTile*> tiles; // Every tile known (pending, cached, or visible)
+    std::list<TerrainTile*> inRange;       // Every other tile, moved between the two by splice
+    std::list<TerrainTile*> lru;           // Out-of-range tiles, most recently used first
+    std::vector<TerrainTile*> visible;     // Resident tiles in range, built by Update
+    std::vector<std::pair<unsigned int,unsigned int> > freeGPU; // Recycled (vao,buffer) pairs
+    unsigned int indexBuffer;
+    int inFlight;
+
+    std::mutex doneLock;                   // Guards done and jobs
+    std::vector<TerrainTile*> done;        // Generated by workers, not yet collected
+    int jobs;                              // Jobs submitted and not yet finished
+
+    void Generate(TerrainTile* tile);
+    void Upload(TerrainTile* tile);
+    void Evict();
+    size_t VertexBytes() const;
+};
+
+#endif
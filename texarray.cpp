@@ -0,0 +1,324 @@
+////////////////////////////////////////////////////////////////////////
+// Texture arrays:  images packed as the layers of GL_TEXTURE_2D_ARRAYs.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "texarray.h"
+#include "texcompress.h"
+#include "assetpack.h"
+#include "workers.h"
+
+#define STBI_FAILURE_USERMSG
+#include "stb_image.h"
+
+TextureArray::~TextureArray()
+{
+    if (textureId) glDeleteTextures(1, &textureId);
+}
+
+void TextureArray::Bind(const int unit, const int programId, const std::string& name)
+{
+    glActiveTexture((gl::GLenum)((int)GL_TEXTURE0 + unit));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+    int loc = glGetUniformLocation(programId, name.c_str());
+    glUniform1i(loc, unit);
+}
+
+TextureArrays::TextureArrays() : fit(ArrayResize), layerSize(1024), building(0)
+{
+    bound[0] = bound[1] = 0;
+}
+
+ArrayLayer* TextureArrays::Add(const std::string& path)
+{
+    Pending p;
+    p.path = path;
+    p.layer = new ArrayLayer();
+    p.kind = MipKindFor(path);
+    p.format = ImageRGBA8;
+    p.width = p.height = 0;
+    p.chain = NULL;
+    queued.push_back(p);
+    layers.push_back(p.layer);
+    return p.layer;
+}
+
+static size_t Align16(const size_t n) { return (n + 15) & ~(size_t)15; }
+
+// The texels of the image at path in the asset pack, if it's there.
+static const unsigned char* PackedImageOf(const std::string& path, PackedImage& header)
+{
+    size_t size;
+    const char* packed = PackedAsset(path, PackImage, size);
+    if (!packed || size < sizeof(header)) return NULL;
+    memcpy(&header, packed, sizeof(header));
+    if ((size - sizeof(header))/4/(header.width ? header.width : 1) < header.height) return NULL;
+    return (const unsigned char*)packed + sizeof(header);
+}
+
+// Decodes the image of p (from whichever of its forms Texture would
+// use), and fits it to its layer.
+void TextureArrays::Prepare(Pending& p) const
+{
+    int width = 0, height = 0;
+    std::vector<unsigned char> decoded;
+    const unsigned char* image = NULL;
+    MipChain* source = NULL;
+    CompressedTexture* compressed = ReadCompressed(p.path);
+    PackedImage header;
+    const unsigned char* packed = NULL;
+    unsigned char* loaded = NULL;
+
+    if (compressed) {
+        width = compressed->width;
+        height = compressed->height;
+        decoded.resize((size_t)width*height*4);
+        if (compressed->format == BC6H) {
+            std::vector<float> rgb((size_t)width*height*3);
+            DecompressImage(BC6H, compressed->level[0], width, height, &rgb[0]);
+            EncodeR11G11B10F(&rgb[0], (uint32_t*)&decoded[0], (size_t)width*height);
+            p.format = ImageR11G11B10F; }
+        else
+            DecompressImage(compressed->format, compressed->level[0], width, height, &decoded[0]);
+        // A BC5 normal map decodes with Z zero;  rebuild it, so layers
+        // of every format read alike.
+        if (compressed->format == BC5)
+            for (size_t i=0;  i<(size_t)width*height;  i++) {
+                float x = decoded[4*i]/127.5f - 1.0f, y = decoded[4*i+1]/127.5f - 1.0f;
+                float z = sqrtf(std::max(0.0f, 1.0f - x*x - y*y));
+                decoded[4*i+2] = (unsigned char)(127.5f*(z + 1.0f) + 0.5f); }
+        image = &decoded[0]; }
+    else if ((source = ReadMipChain(p.path, mipFilter)) != NULL) {
+        width = source->width;
+        height = source->height;
+        p.format = source->format;
+        image = source->level[0]; }
+    else if ((packed = PackedImageOf(p.path, header)) != NULL) {
+        width = header.width;
+        height = header.height;
+        p.format = (ImageFormat)header.format;
+        image = packed; }
+    else {
+        int n;
+        if (stbi_is_hdr(p.path.c_str())) {
+            float* rgb = stbi_loadf(p.path.c_str(), &width, &height, &n, 3);
+            if (rgb) EncodeR11G11B10F(rgb, (uint32_t*)rgb, (size_t)width*height);
+            loaded = (unsigned char*)rgb;
+            p.format = ImageR11G11B10F; }
+        else
+            loaded = stbi_load(p.path.c_str(), &width, &height, &n, 4);
+        image = loaded;
+        if (!image)
+            printf("\nRead error on file %s:\n  %s\n\n", p.path.c_str(), stbi_failure_reason()); }
+
+    if (image) {
+        // The layer's size, and the part of it the image covers
+        int w = width, h = height;
+        p.width = width;
+        p.height = height;
+        if (fit != ArrayExact)
+            p.width = p.height = layerSize;
+        if (fit == ArrayResize)
+            w = h = layerSize;
+        else if (fit == ArrayPad && std::max(width, height) > layerSize) {
+            double f = layerSize/(double)std::max(width, height);
+            w = std::max(1, (int)floor(width*f + 0.5));
+            h = std::max(1, (int)floor(height*f + 0.5)); }
+        p.layer->scale = glm::vec2(w/(float)p.width, h/(float)p.height);
+
+        if (source && w == p.width && h == p.height) {
+            // The cached chain is the layer as it is
+            p.chain = source;
+            source = NULL; }
+        else {
+            std::vector<unsigned char> fitted;
+            const unsigned char* top = image;
+            if (w != width || h != height) {
+                fitted.resize((size_t)w*h*4);
+                ResizeImage(image, p.format, width, height, p.kind, mipFilter, w, h, &fitted[0]);
+                top = &fitted[0]; }
+
+            // Padding repeats the edge texels, so the smaller levels
+            // don't darken toward the edges
+            std::vector<unsigned char> layer;
+            if (w != p.width || h != p.height) {
+                layer.resize((size_t)p.width*p.height*4);
+                for (int y=0;  y<p.height;  y++)
+                    for (int x=0;  x<p.width;  x++)
+                        memcpy(&layer[4*((size_t)y*p.width + x)],
+                               top + 4*((size_t)std::min(y, h-1)*w + std::min(x, w-1)), 4);
+                top = &layer[0]; }
+            p.chain = MakeMipChain(top, p.format, p.width, p.height, p.kind, mipFilter); }
+
+        // Every level, one after another
+        size_t total = 0;
+        for (int l=0;  l<p.chain->levels;  l++) total += Align16(p.chain->size[l]);
+        if (Uploads().Reserve(total, p.span)) {
+            size_t at = 0;
+            for (int l=0;  l<p.chain->levels;  l++) {
+                memcpy(p.span.data + at, p.chain->level[l], p.chain->size[l]);
+                at += Align16(p.chain->size[l]); } } }
+
+    delete source;
+    delete compressed;
+    if (loaded) stbi_image_free(loaded);
+}
+
+void TextureArrays::Build()
+{
+    if (queued.empty()) return;
+    std::vector<Pending> batch;
+    batch.swap(queued);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        building++;
+    }
+    Workers().Submit([this, batch]() mutable {
+            Workers().ParallelFor((int)batch.size(), [&](int begin, int end) {
+                    for (int i=begin;  i<end;  i++) Prepare(batch[i]); });
+            std::lock_guard<std::mutex> guard(lock);
+            prepared.insert(prepared.end(), batch.begin(), batch.end());
+            building--; });
+}
+
+// Uploads a group of layers of one size, format and kind, as few
+// arrays as the driver's limit on layers allows.
+void TextureArrays::Upload(std::vector<Pending>& group)
+{
+    int maxLayers = 256;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+    for (size_t first=0;  first<group.size();  first+=maxLayers) {
+        size_t count = std::min(group.size() - first, (size_t)maxLayers);
+        const MipChain* c = group[first].chain;
+        TextureArray* a = new TextureArray();
+        a->width = c->width;
+        a->height = c->height;
+        a->layers = (int)count;
+        a->levels = c->levels;
+        a->format = c->format;
+        bool hdr = c->format == ImageR11G11B10F;
+
+        glGenTextures(1, &a->textureId);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, a->textureId);
+        std::vector<size_t> at(count, 0);
+        for (int l=0;  l<a->levels;  l++) {
+            int w = std::max(1, a->width >> l), h = std::max(1, a->height >> l);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, l, hdr ? (GLint)GL_R11F_G11F_B10F : (GLint)GL_RGBA,
+                         w, h, a->layers, 0, hdr ? GL_RGB : GL_RGBA,
+                         hdr ? GL_UNSIGNED_INT_10F_11F_11F_REV : GL_UNSIGNED_BYTE, NULL);
+            for (size_t i=0;  i<count;  i++) {
+                // From the layer's staged copy if it has one
+                Pending& p = group[first+i];
+                const void* texels = p.chain->level[l];
+                if (p.span.data) {
+                    Uploads().Bind();
+                    texels = PixelRing::Pixels(p.span, at[i]);
+                    at[i] += Align16(p.chain->size[l]); }
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, (GLint)i, w, h, 1,
+                                hdr ? GL_RGB : GL_RGBA,
+                                hdr ? GL_UNSIGNED_INT_10F_11F_11F_REV : GL_UNSIGNED_BYTE, texels);
+                if (p.span.data) Uploads().Unbind();
+                a->gpuBytes += p.chain->size[l]; } }
+        for (size_t i=0;  i<count;  i++)
+            Uploads().Release(group[first+i].span);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, a->levels-1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR_MIPMAP_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        for (size_t i=0;  i<count;  i++) {
+            group[first+i].layer->array = a;
+            group[first+i].layer->layer = (int)i; }
+        arrays.push_back(a);
+        printf("%d %d %d texture array of %d layers (%lld KB)\n", 4, a->width, a->height,
+               a->layers, (long long)(a->gpuBytes >> 10)); }
+}
+
+void TextureArrays::Update()
+{
+    std::vector<Pending> ready;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (building || prepared.empty()) return;
+        ready.swap(prepared);
+    }
+
+    // Group the layers by what must agree within an array
+    std::vector<Pending> done;
+    for (size_t i=0;  i<ready.size();  i++)
+        if (ready[i].chain) done.push_back(ready[i]);
+    std::stable_sort(done.begin(), done.end(), [](const Pending& a, const Pending& b) {
+            bool an = a.kind == MipNormal, bn = b.kind == MipNormal;
+            if (a.format != b.format) return a.format < b.format;
+            if (an != bn) return bn;
+            if (a.width != b.width) return a.width < b.width;
+            return a.height < b.height; });
+
+    for (size_t first=0;  first<done.size(); ) {
+        size_t end = first + 1;
+        while (end < done.size() && done[end].format == done[first].format
+               && (done[end].kind == MipNormal) == (done[first].kind == MipNormal)
+               && done[end].width == done[first].width && done[end].height == done[first].height)
+            end++;
+        std::vector<Pending> group(done.begin() + first, done.begin() + end);
+        Upload(group);
+        first = end; }
+
+    for (size_t i=0;  i<ready.size();  i++)
+        delete ready[i].chain;
+}
+
+void TextureArrays::Begin(const int programId)
+{
+    int loc = glGetUniformLocation(programId, "texArray");
+    glUniform1i(loc, colorArrayUnit);
+    loc = glGetUniformLocation(programId, "normalArray");
+    glUniform1i(loc, normalArrayUnit);
+    bound[0] = bound[1] = 0;
+}
+
+bool TextureArrays::Use(const ArrayLayer* layer, const int unit, const int programId,
+                        const char* sampler, const char* index, const char* scale)
+{
+    int loc = glGetUniformLocation(programId, index);
+    if (!layer || !layer->array) {
+        glUniform1i(loc, -1);
+        return false; }
+    glUniform1i(loc, layer->layer);
+    loc = glGetUniformLocation(programId, scale);
+    glUniform2fv(loc, 1, &layer->scale[0]);
+
+    unsigned int& b = bound[unit == colorArrayUnit ? 0 : 1];
+    if (b != layer->array->textureId) {
+        layer->array->Bind(unit, programId, sampler);
+        b = layer->array->textureId; }
+    return true;
+}
+
+size_t TextureArrays::GpuBytes() const
+{
+    size_t bytes = 0;
+    for (size_t i=0;  i<arrays.size();  i++)
+        bytes += arrays[i]->gpuBytes;
+    return bytes;
+}
+
+TextureArrays& Arrays()
+{
+    static TextureArrays arrays;
+    return arrays;
+}
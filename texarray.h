@@ -0,0 +1,136 @@
+////////////////////////////////////////////////////////////////////////
+// Texture arrays.  A textured Object binding its own textures makes
+// every draw its own batch.  Instead, images of one size, format and
+// kind (see mipchain.h) are packed as the layers of a
+// GL_TEXTURE_2D_ARRAY, and an object carries just which array and
+// layer its texture is.  Arrays sit on fixed texture units (texArray
+// on unit 3, normalArray on unit 4), bound once for a pass and again
+// only when a draw needs a different array, so objects with different
+// textures no longer differ in any binding, just in two uniforms.
+//
+// How the images are made to agree in size is configured by fit:
+//   ArrayExact   images are grouped by their own size
+//   ArrayResize  every image is resampled to layerSize x layerSize
+//   ArrayPad     every image is placed in a corner of a layerSize
+//                square layer (shrunk first if larger);  the part of
+//                the layer it covers is passed to the shader as its
+//                scale, and texture coordinates are wrapped into it
+//
+// Layers are decoded (or mapped from their cached mip chains), fitted,
+// filtered and staged in the pixel ring (see pixelring.h) on the worker
+// pool;  Update uploads the arrays from the render thread once all are
+// ready.  Until then, an object's layer has
+// no array, and it is drawn with just its own colors.  Arrays hold all
+// their levels, and are not streamed.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _TEXARRAY_
+#define _TEXARRAY_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "imageformat.h"
+#include "mipchain.h"
+#include "pixelring.h"
+
+enum ArrayFit
+{
+    ArrayExact = 0,
+    ArrayResize = 1,
+    ArrayPad = 2
+};
+
+// The units the arrays of each kind are bound to.
+const int colorArrayUnit = 3, normalArrayUnit = 4;
+
+// One GL_TEXTURE_2D_ARRAY.
+class TextureArray
+{
+ public:
+    unsigned int textureId;
+    int width, height, layers, levels;
+    ImageFormat format;
+    size_t gpuBytes;
+
+    TextureArray() : textureId(0), width(0), height(0), layers(0), levels(0),
+                     format(ImageRGBA8), gpuBytes(0) {}
+    ~TextureArray();
+
+    void Bind(const int unit, const int programId, const std::string& name);
+};
+
+// Where an image went.  array is NULL until the arrays are uploaded.
+struct ArrayLayer
+{
+    TextureArray* array;
+    int layer;
+    glm::vec2 scale;            // Of the layer the image covers
+    ArrayLayer() : array(NULL), layer(0), scale(1.0f) {}
+};
+
+class TextureArrays
+{
+ public:
+    TextureArrays();
+
+    ArrayFit fit;
+    int layerSize;              // For ArrayResize and ArrayPad
+
+    // Queues the image at path as a layer, returning where it will be
+    // (owned here).  Call Build once all are added.
+    ArrayLayer* Add(const std::string& path);
+
+    // Starts preparing the layers queued so far on the worker pool.
+    void Build();
+
+    // Uploads the arrays once they are prepared.  Call once per frame,
+    // from the render thread.
+    void Update();
+
+    // Points the array samplers of programId at their units, and
+    // forgets which arrays are bound.  Call at the start of each pass
+    // that draws objects.
+    void Begin(const int programId);
+
+    // Sets the layer uniforms (named index and scale) for layer, and
+    // binds its array to unit if another one is.  Sets index to -1,
+    // and returns false, if there's no layer (yet).
+    bool Use(const ArrayLayer* layer, const int unit, const int programId,
+             const char* sampler, const char* index, const char* scale);
+
+    size_t GpuBytes() const;
+
+ private:
+    // A layer's image, as prepared by a worker.
+    struct Pending
+    {
+        std::string path;
+        ArrayLayer* layer;
+        MipKind kind;
+        ImageFormat format;
+        int width, height;      // Of the layer
+        MipChain* chain;        // Of the fitted image, or NULL if it failed
+        PixelSpan span;         // The chain, copied into the pixel ring (if it had room)
+    };
+
+    void Prepare(Pending& p) const;
+    void Upload(std::vector<Pending>& group);
+
+    std::vector<Pending> queued;
+    std::vector<ArrayLayer*> layers;
+    std::vector<TextureArray*> arrays;
+    unsigned int bound[2];      // The arrays on colorArrayUnit and normalArrayUnit
+
+    std::mutex lock;            // Guards prepared and building
+    std::vector<Pending> prepared;
+    int building;               // Build jobs not yet finished
+};
+
+// The single set of arrays shared by the whole program, created on
+// first use.
+TextureArrays& Arrays();
+
+#endif
@@ -0,0 +1,565 @@
+////////////////////////////////////////////////////////////////////////
+// Block compression encoders and decoders (BC1, BC3, BC4, BC5, and
+// BC6H mode 11), and the compressed texture files.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BC_SSE2
+#endif
+
+#include "texcompress.h"
+#include "imageformat.h"
+#include "assetpack.h"
+#include "filecache.h"
+#include "mapfile.h"
+#include "workers.h"
+
+const char* BCName(const BCFormat format)
+{
+    switch (format) {
+    case BC1:  return "BC1";
+    case BC3:  return "BC3";
+    case BC4:  return "BC4";
+    case BC5:  return "BC5";
+    case BC6H: return "BC6H";
+    default:   return "none"; }
+}
+
+int BCBlockBytes(const BCFormat format)
+{
+    return format == BC1 || format == BC4 ? 8 : 16;
+}
+
+size_t BCLevelBytes(const BCFormat format, const int width, const int height)
+{
+    return (size_t)((width+3)/4)*((height+3)/4)*BCBlockBytes(format);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Shared pieces
+
+// Mean and principal axis (unit length, or zero if the points all
+// coincide) of 16 points, by power iteration on their covariance.
+static void PrincipalAxis(const float* X, const float* Y, const float* Z,
+                          float mean[3], float axis[3])
+{
+    mean[0] = mean[1] = mean[2] = 0.0f;
+    for (int i=0;  i<16;  i++) {
+        mean[0] += X[i];  mean[1] += Y[i];  mean[2] += Z[i]; }
+    for (int c=0;  c<3;  c++) mean[c] /= 16.0f;
+
+    float xx=0, xy=0, xz=0, yy=0, yz=0, zz=0;
+    for (int i=0;  i<16;  i++) {
+        float x = X[i]-mean[0], y = Y[i]-mean[1], z = Z[i]-mean[2];
+        xx += x*x;  xy += x*y;  xz += x*z;  yy += y*y;  yz += y*z;  zz += z*z; }
+
+    // Start from the row of the largest variance
+    float v[3] = { xx, xy, xz };
+    if (yy > xx && yy >= zz) { v[0] = xy;  v[1] = yy;  v[2] = yz; }
+    else if (zz > xx && zz > yy) { v[0] = xz;  v[1] = yz;  v[2] = zz; }
+    for (int iter=0;  iter<8;  iter++) {
+        float w[3] = { xx*v[0] + xy*v[1] + xz*v[2],
+                       xy*v[0] + yy*v[1] + yz*v[2],
+                       xz*v[0] + yz*v[1] + zz*v[2] };
+        float len = sqrtf(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]);
+        if (len < 1e-12f) {
+            axis[0] = axis[1] = axis[2] = 0.0f;
+            return; }
+        for (int c=0;  c<3;  c++) v[c] = w[c]/len; }
+    for (int c=0;  c<3;  c++) axis[c] = v[c];
+}
+
+// The ends of the points' extent along axis through mean.
+static void AxisEndpoints(const float* X, const float* Y, const float* Z, const float mean[3],
+                          const float axis[3], float hi[3], float lo[3])
+{
+    float tmin = 0.0f, tmax = 0.0f;
+    for (int i=0;  i<16;  i++) {
+        float t = (X[i]-mean[0])*axis[0] + (Y[i]-mean[1])*axis[1] + (Z[i]-mean[2])*axis[2];
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t); }
+    for (int c=0;  c<3;  c++) {
+        hi[c] = mean[c] + tmax*axis[c];
+        lo[c] = mean[c] + tmin*axis[c]; }
+}
+
+// For each of 16 colors, the nearest of the 4 in pal, as 2 bit
+// indices (texel 0 in the low bits), and the total squared error.
+static uint32_t NearestColors(const float* R, const float* G, const float* B,
+                              const float pal[4][3], float& error)
+{
+    uint32_t bits = 0;
+#ifdef BC_SSE2
+    __m128 total = _mm_setzero_ps();
+    for (int i=0;  i<16;  i+=4) {
+        __m128 r = _mm_loadu_ps(R+i), g = _mm_loadu_ps(G+i), b = _mm_loadu_ps(B+i);
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128i index = _mm_setzero_si128();
+        for (int k=0;  k<4;  k++) {
+            __m128 dr = _mm_sub_ps(r, _mm_set1_ps(pal[k][0]));
+            __m128 dg = _mm_sub_ps(g, _mm_set1_ps(pal[k][1]));
+            __m128 db = _mm_sub_ps(b, _mm_set1_ps(pal[k][2]));
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+            best = _mm_min_ps(d, best);
+            index = _mm_or_si128(_mm_andnot_si128(closer, index),
+                                 _mm_and_si128(closer, _mm_set1_epi32(k))); }
+        total = _mm_add_ps(total, best);
+        int32_t idx[4];
+        _mm_storeu_si128((__m128i*)idx, index);
+        for (int j=0;  j<4;  j++)
+            bits |= (uint32_t)idx[j] << (2*(i+j)); }
+    float t[4];
+    _mm_storeu_ps(t, total);
+    error = t[0] + t[1] + t[2] + t[3];
+#else
+    error = 0.0f;
+    for (int i=0;  i<16;  i++) {
+        float best = 1e30f;
+        int index = 0;
+        for (int k=0;  k<4;  k++) {
+            float dr = R[i]-pal[k][0], dg = G[i]-pal[k][1], db = B[i]-pal[k][2];
+            float d = dr*dr + dg*dg + db*db;
+            if (d < best) { best = d;  index = k; } }
+        error += best;
+        bits |= (uint32_t)index << (2*i); }
+#endif
+    return bits;
+}
+
+// For each of 16 values, the nearest of the 8 in pal, as 3 bit indices.
+static uint64_t NearestValues(const float* V, const float pal[8], float& error)
+{
+    uint64_t bits = 0;
+#ifdef BC_SSE2
+    __m128 total = _mm_setzero_ps();
+    for (int i=0;  i<16;  i+=4) {
+        __m128 v = _mm_loadu_ps(V+i);
+        __m128 best = _mm_set1_ps(1e30f);
+        __m128i index = _mm_setzero_si128();
+        for (int k=0;  k<8;  k++) {
+            __m128 d = _mm_sub_ps(v, _mm_set1_ps(pal[k]));
+            d = _mm_mul_ps(d, d);
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+            best = _mm_min_ps(d, best);
+            index = _mm_or_si128(_mm_andnot_si128(closer, index),
+                                 _mm_and_si128(closer, _mm_set1_epi32(k))); }
+        total = _mm_add_ps(total, best);
+        int32_t idx[4];
+        _mm_storeu_si128((__m128i*)idx, index);
+        for (int j=0;  j<4;  j++)
+            bits |= (uint64_t)idx[j] << (3*(i+j)); }
+    float t[4];
+    _mm_storeu_ps(t, total);
+    error = t[0] + t[1] + t[2] + t[3];
+#else
+    error = 0.0f;
+    for (int i=0;  i<16;  i++) {
+        float best = 1e30f;
+        int index = 0;
+        for (int k=0;  k<8;  k++) {
+            float d = (V[i]-pal[k])*(V[i]-pal[k]);
+            if (d < best) { best = d;  index = k; } }
+        error += best;
+        bits |= (uint64_t)index << (3*i); }
+#endif
+    return bits;
+}
+
+static void Put16(unsigned char* p, const uint32_t v) { p[0] = v & 255;  p[1] = (v >> 8) & 255; }
+static uint32_t Get16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+
+////////////////////////////////////////////////////////////////////////
+// BC1:  two RGB565 endpoints, and a 2 bit index per texel into them
+// and the two colors a third and two thirds of the way between.
+
+static uint16_t Pack565(const float c[3])
+{
+    int r = std::min(31, std::max(0, (int)(c[0]*31.0f/255.0f + 0.5f)));
+    int g = std::min(63, std::max(0, (int)(c[1]*63.0f/255.0f + 0.5f)));
+    int b = std::min(31, std::max(0, (int)(c[2]*31.0f/255.0f + 0.5f)));
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void Unpack565(const uint32_t v, int c[3])
+{
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+// The four colors of a block (in its 4 color mode when c0 > c1).
+static void BC1Palette(const uint32_t c0, const uint32_t c1, int pal[4][4], const bool alwaysFour)
+{
+    Unpack565(c0, pal[0]);
+    Unpack565(c1, pal[1]);
+    pal[0][3] = pal[1][3] = pal[2][3] = pal[3][3] = 255;
+    for (int c=0;  c<3;  c++)
+        if (c0 > c1 || alwaysFour) {
+            pal[2][c] = (2*pal[0][c] + pal[1][c])/3;
+            pal[3][c] = (pal[0][c] + 2*pal[1][c])/3; }
+        else {
+            pal[2][c] = (pal[0][c] + pal[1][c])/2;
+            pal[3][c] = 0;
+            pal[3][3] = 0; }
+}
+
+// Orders the endpoints for 4 color mode and picks the indices.
+static uint32_t FitBC1(const float* R, const float* G, const float* B,
+                       uint16_t& c0, uint16_t& c1, float& error)
+{
+    if (c0 < c1) std::swap(c0, c1);
+    int pal[4][4];
+    BC1Palette(c0, c1, pal, true);
+    float fpal[4][3];
+    for (int k=0;  k<4;  k++)
+        for (int c=0;  c<3;  c++)
+            fpal[k][c] = (float)pal[k][c];
+    if (c0 == c1) {
+        // A solid block:  every index 0
+        for (int k=1;  k<4;  k++)
+            for (int c=0;  c<3;  c++) fpal[k][c] = 1e15f; }
+    return NearestColors(R, G, B, fpal, error);
+}
+
+// The endpoints that best fit the colors given their indices, by
+// least squares.  Returns false if the indices don't determine them.
+static bool SolveBC1(const float* R, const float* G, const float* B, const uint32_t indices,
+                     float e0[3], float e1[3])
+{
+    static const float weight[4] = { 1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f };
+    float aa = 0, ab = 0, bb = 0, ax[3] = {0,0,0}, bx[3] = {0,0,0};
+    for (int i=0;  i<16;  i++) {
+        float a = weight[(indices >> (2*i)) & 3], b = 1.0f - a;
+        float x[3] = { R[i], G[i], B[i] };
+        aa += a*a;  ab += a*b;  bb += b*b;
+        for (int c=0;  c<3;  c++) {
+            ax[c] += a*x[c];
+            bx[c] += b*x[c]; } }
+    float det = aa*bb - ab*ab;
+    if (fabsf(det) < 1e-4f) return false;
+    for (int c=0;  c<3;  c++) {
+        e0[c] = (bb*ax[c] - ab*bx[c])/det;
+        e1[c] = (aa*bx[c] - ab*ax[c])/det; }
+    return true;
+}
+
+static void EncodeBC1(const unsigned char* rgba, unsigned char* block)
+{
+    float R[16], G[16], B[16];
+    for (int i=0;  i<16;  i++) {
+        R[i] = rgba[4*i];  G[i] = rgba[4*i+1];  B[i] = rgba[4*i+2]; }
+
+    float mean[3], axis[3], hi[3], lo[3];
+    PrincipalAxis(R, G, B, mean, axis);
+    AxisEndpoints(R, G, B, mean, axis, hi, lo);
+    uint16_t c0 = Pack565(hi), c1 = Pack565(lo);
+    float error;
+    uint32_t indices = FitBC1(R, G, B, c0, c1, error);
+
+    // One round of refinement:  refit the endpoints to those indices
+    float e0[3], e1[3];
+    if (error > 0.0f && SolveBC1(R, G, B, indices, e0, e1)) {
+        uint16_t d0 = Pack565(e0), d1 = Pack565(e1);
+        float error2;
+        uint32_t indices2 = FitBC1(R, G, B, d0, d1, error2);
+        if (error2 < error) {
+            c0 = d0;  c1 = d1;  indices = indices2; } }
+
+    Put16(block, c0);
+    Put16(block+2, c1);
+    for (int b=0;  b<4;  b++) block[4+b] = (indices >> (8*b)) & 255;
+}
+
+static void DecodeBC1(const unsigned char* block, unsigned char* rgba, const bool alwaysFour)
+{
+    int pal[4][4];
+    BC1Palette(Get16(block), Get16(block+2), pal, alwaysFour);
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+    for (int i=0;  i<16;  i++) {
+        int k = (indices >> (2*i)) & 3;
+        for (int c=0;  c<4;  c++) rgba[4*i+c] = pal[k][c]; }
+}
+
+////////////////////////////////////////////////////////////////////////
+// BC4:  two 8 bit endpoints, and a 3 bit index per texel into them and
+// six values evenly spaced between.  (BC3's alpha and BC5's two
+// channels are BC4 blocks too.)
+
+static void BC4Palette(const int r0, const int r1, float pal[8])
+{
+    pal[0] = r0;
+    pal[1] = r1;
+    if (r0 > r1)
+        for (int i=2;  i<8;  i++) pal[i] = ((8-i)*r0 + (i-1)*r1)/7;
+    else {
+        for (int i=2;  i<6;  i++) pal[i] = ((6-i)*r0 + (i-1)*r1)/5;
+        pal[6] = 0;
+        pal[7] = 255; }
+}
+
+static void EncodeBC4(const unsigned char* rgba, const int channel, unsigned char* block)
+{
+    float V[16];
+    float lo = 255.0f, hi = 0.0f;
+    for (int i=0;  i<16;  i++) {
+        V[i] = rgba[4*i+channel];
+        lo = std::min(lo, V[i]);
+        hi = std::max(hi, V[i]); }
+
+    int r0 = (int)hi, r1 = (int)lo;
+    float pal[8], error;
+    BC4Palette(r0, r1, pal);
+    if (r0 == r1)
+        for (int k=1;  k<8;  k++) pal[k] = 1e15f;    // Solid:  every index 0
+    uint64_t indices = NearestValues(V, pal, error);
+
+    block[0] = r0;
+    block[1] = r1;
+    for (int b=0;  b<6;  b++) block[2+b] = (indices >> (8*b)) & 255;
+}
+
+static void DecodeBC4(const unsigned char* block, unsigned char* rgba, const int channel)
+{
+    float pal[8];
+    BC4Palette(block[0], block[1], pal);
+    uint64_t indices = 0;
+    for (int b=0;  b<6;  b++) indices |= (uint64_t)block[2+b] << (8*b);
+    for (int i=0;  i<16;  i++)
+        rgba[4*i+channel] = (unsigned char)pal[(indices >> (3*i)) & 7];
+}
+
+////////////////////////////////////////////////////////////////////////
+// BC6H, unsigned, mode 11 only:  one region, two RGB endpoints of 10
+// bits each, and a 4 bit index per texel (3 for texel 0, whose top
+// bit is implicitly 0).  Interpolation happens on the endpoints'
+// expansion to 16 bits, which maps linearly onto half float bit
+// patterns, so the fit is done on those (roughly logarithmic) values.
+
+static const int bc6Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static int Unquantize10(const int q)
+{
+    if (q == 0) return 0;
+    if (q == 1023) return 0xffff;
+    return ((q << 16) + 0x8000) >> 10;
+}
+
+static int Quantize10(const float u)
+{
+    int q = std::min(1023, std::max(0, (int)floorf((u - 32.0f)/64.0f + 0.5f)));
+    int best = q;
+    for (int t=std::max(0, q-1);  t<=std::min(1023, q+1);  t++)
+        if (fabsf(Unquantize10(t) - u) < fabsf(Unquantize10(best) - u)) best = t;
+    return best;
+}
+
+// Interpolated value (as half float bits) of index k between u0 and u1.
+static int BC6Value(const int u0, const int u1, const int k)
+{
+    int x = ((64 - bc6Weights[k])*u0 + bc6Weights[k]*u1 + 32) >> 6;
+    return (x*31) >> 6;
+}
+
+static void PutBits(unsigned char* block, int& pos, const uint32_t value, const int count)
+{
+    for (int b=0;  b<count;  b++, pos++)
+        if (value & (1u << b)) block[pos >> 3] |= 1 << (pos & 7);
+}
+
+static uint32_t GetBits(const unsigned char* block, int& pos, const int count)
+{
+    uint32_t value = 0;
+    for (int b=0;  b<count;  b++, pos++)
+        if (block[pos >> 3] & (1 << (pos & 7))) value |= 1u << b;
+    return value;
+}
+
+static void EncodeBC6H(const float* rgb, unsigned char* block)
+{
+    float H[3][16], U[3][16];
+    for (int i=0;  i<16;  i++)
+        for (int c=0;  c<3;  c++) {
+            H[c][i] = (float)PackUnsignedFloat(rgb[3*i+c], 10);
+            U[c][i] = H[c][i]*64.0f/31.0f; }
+
+    float mean[3], axis[3], hi[3], lo[3];
+    PrincipalAxis(U[0], U[1], U[2], mean, axis);
+    AxisEndpoints(U[0], U[1], U[2], mean, axis, hi, lo);
+    int q0[3], q1[3], u0[3], u1[3];
+    for (int c=0;  c<3;  c++) {
+        q0[c] = Quantize10(std::min(65535.0f, std::max(0.0f, hi[c])));
+        q1[c] = Quantize10(std::min(65535.0f, std::max(0.0f, lo[c])));
+        u0[c] = Unquantize10(q0[c]);
+        u1[c] = Unquantize10(q1[c]); }
+
+    int index[16];
+    for (int i=0;  i<16;  i++) {
+        float best = 1e30f;
+        for (int k=0;  k<16;  k++) {
+            float e = 0.0f;
+            for (int c=0;  c<3;  c++) {
+                float d = BC6Value(u0[c], u1[c], k) - H[c][i];
+                e += d*d; }
+            if (e < best) { best = e;  index[i] = k; } } }
+
+    // Texel 0's index must have its top bit clear
+    if (index[0] & 8) {
+        for (int c=0;  c<3;  c++) std::swap(q0[c], q1[c]);
+        for (int i=0;  i<16;  i++) index[i] = 15 - index[i]; }
+
+    memset(block, 0, 16);
+    int pos = 0;
+    PutBits(block, pos, 3, 5);  // Mode 11
+    for (int c=0;  c<3;  c++) PutBits(block, pos, q0[c], 10);
+    for (int c=0;  c<3;  c++) PutBits(block, pos, q1[c], 10);
+    for (int i=0;  i<16;  i++) PutBits(block, pos, index[i], i == 0 ? 3 : 4);
+}
+
+static void DecodeBC6H(const unsigned char* block, float* rgb)
+{
+    int pos = 0;
+    if (GetBits(block, pos, 5) != 3) {
+        memset(rgb, 0, 16*3*sizeof(float));
+        return; }
+    int u0[3], u1[3];
+    for (int c=0;  c<3;  c++) u0[c] = Unquantize10(GetBits(block, pos, 10));
+    for (int c=0;  c<3;  c++) u1[c] = Unquantize10(GetBits(block, pos, 10));
+    for (int i=0;  i<16;  i++) {
+        int k = GetBits(block, pos, i == 0 ? 3 : 4);
+        for (int c=0;  c<3;  c++)
+            rgb[3*i+c] = UnpackUnsignedFloat(BC6Value(u0[c], u1[c], k), 10); }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Whole images
+
+std::vector<unsigned char> CompressImage(const BCFormat format, const void* texels,
+                                         const int width, const int height)
+{
+    int bw = (width+3)/4, bh = (height+3)/4, bytes = BCBlockBytes(format);
+    std::vector<unsigned char> out((size_t)bw*bh*bytes);
+    const unsigned char* rgba = (const unsigned char*)texels;
+    const float* rgbf = (const float*)texels;
+
+    Workers().ParallelFor(bh, [&](int begin, int end) {
+            unsigned char tile[64];
+            float tilef[48];
+            for (int by=begin;  by<end;  by++)
+                for (int bx=0;  bx<bw;  bx++) {
+                    // Gather the block, repeating the last row and column past the edges
+                    for (int i=0;  i<16;  i++) {
+                        int x = std::min(4*bx + (i&3), width-1), y = std::min(4*by + (i>>2), height-1);
+                        size_t t = (size_t)y*width + x;
+                        if (format == BC6H) memcpy(tilef + 3*i, rgbf + 3*t, 3*sizeof(float));
+                        else memcpy(tile + 4*i, rgba + 4*t, 4); }
+
+                    unsigned char* block = &out[((size_t)by*bw + bx)*bytes];
+                    switch (format) {
+                    case BC1:  EncodeBC1(tile, block);  break;
+                    case BC3:  EncodeBC4(tile, 3, block);  EncodeBC1(tile, block+8);  break;
+                    case BC4:  EncodeBC4(tile, 0, block);  break;
+                    case BC5:  EncodeBC4(tile, 0, block);  EncodeBC4(tile, 1, block+8);  break;
+                    case BC6H: EncodeBC6H(tilef, block);  break;
+                    default:   break; } } }, 4);
+    return out;
+}
+
+void DecompressImage(const BCFormat format, const unsigned char* blocks,
+                     const int width, const int height, void* texels)
+{
+    int bw = (width+3)/4, bh = (height+3)/4, bytes = BCBlockBytes(format);
+    unsigned char* rgba = (unsigned char*)texels;
+    float* rgbf = (float*)texels;
+
+    Workers().ParallelFor(bh, [&](int begin, int end) {
+            unsigned char tile[64];
+            float tilef[48];
+            for (int by=begin;  by<end;  by++)
+                for (int bx=0;  bx<bw;  bx++) {
+                    const unsigned char* block = blocks + ((size_t)by*bw + bx)*bytes;
+                    memset(tile, 255, sizeof(tile));
+                    switch (format) {
+                    case BC1:  DecodeBC1(block, tile, false);  break;
+                    case BC3:  DecodeBC1(block+8, tile, true);  DecodeBC4(block, tile, 3);  break;
+                    case BC4:  // Gray, as the texture is sampled
+                        DecodeBC4(block, tile, 0);
+                        for (int i=0;  i<16;  i++) tile[4*i+1] = tile[4*i+2] = tile[4*i];
+                        break;
+                    case BC5:
+                        DecodeBC4(block, tile, 0);  DecodeBC4(block+8, tile, 1);
+                        for (int i=0;  i<16;  i++) tile[4*i+2] = 0;
+                        break;
+                    case BC6H: DecodeBC6H(block, tilef);  break;
+                    default:   break; }
+
+                    for (int i=0;  i<16;  i++) {
+                        int x = 4*bx + (i&3), y = 4*by + (i>>2);
+                        if (x >= width || y >= height) continue;
+                        size_t t = (size_t)y*width + x;
+                        if (format == BC6H) memcpy(rgbf + 3*t, tilef + 3*i, 3*sizeof(float));
+                        else memcpy(rgba + 4*t, tile + 4*i, 4); } } }, 4);
+}
+
+////////////////////////////////////////////////////////////////////////
+// Compressed texture files
+
+std::string CompressedPath(const std::string& path)
+{
+    return CachePath("tex" + HashName(Hash64(PackName(path), Hash64("bc texture"))) + ".bin");
+}
+
+CompressedTexture::~CompressedTexture()
+{
+    delete file;
+}
+
+CompressedTexture* ReadCompressed(const std::string& path)
+{
+    // From the asset pack if it's there, else mapped from the cache
+    std::string name = CompressedPath(path);
+    size_t size, length;
+    const char* data = PackedAsset(name, PackRaw, size);
+    MappedFile* file = NULL;
+    if (!data) {
+        file = new MappedFile(name);
+        data = file->data;
+        size = file->size; }
+
+    const char* payload = MappedCache(data, size, "BCTX", bcVersion, length);
+    BCHeader h;
+    bool ok = payload && length >= sizeof(h);
+    if (ok) {
+        memcpy(&h, payload, sizeof(h));
+        uint64_t stamp = HashFileStamp(PackName(path));
+        BCFormat f = (BCFormat)h.format;
+        ok = (stamp == 0 || stamp == h.stamp) && h.levels >= 1 && h.levels <= 16
+            && (f == BC1 || f == BC3 || f == BC4 || f == BC5 || f == BC6H);
+        int w = h.width, ht = h.height;
+        for (uint32_t l=0;  ok && l<h.levels;  l++) {
+            ok = h.offset[l] <= length && h.size[l] <= length - h.offset[l]
+                && h.size[l] == BCLevelBytes(f, w, ht);
+            w = std::max(1, w/2);
+            ht = std::max(1, ht/2); } }
+    if (!ok) {
+        delete file;
+        return NULL; }
+
+    CompressedTexture* c = new CompressedTexture();
+    c->format = (BCFormat)h.format;
+    c->width = h.width;
+    c->height = h.height;
+    c->levels = h.levels;
+    for (int l=0;  l<c->levels;  l++) {
+        c->level[l] = (const unsigned char*)payload + h.offset[l];
+        c->size[l] = h.size[l]; }
+    c->file = file;
+    return c;
+}
@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////
+// Block-compressed textures.  Each 4x4 block of texels is stored in 8
+// or 16 bytes, and the graphics card samples the blocks directly, so
+// a texture takes a quarter to an eighth of its RGBA8 memory.
+//
+//   BC1   RGB, 8 bytes a block           colors
+//   BC3   RGBA, 16 bytes                 colors with alpha
+//   BC4   one channel, 8 bytes           gray images (sampled as RRR1)
+//   BC5   two channels, 16 bytes         normal maps (X and Y;  the
+//                                        shader rebuilds Z)
+//   BC6H  HDR RGB, 16 bytes              .hdr images
+//
+// Encoding is done offline by bctool ("make compress"), which writes
+// the full mip chain to cache/tex<name hash>.bin.  Texture looks there
+// (and in the asset pack) before decoding an image file itself, and
+// the encoded file is ignored once the source image changes.  If the
+// driver lacks a format's extension (S3TC for BC1 and BC3, BPTC for
+// BC6H), the blocks are decoded on the CPU and uploaded uncompressed.
+//
+// The encoders fit each block's endpoints along the principal axis of
+// its colors, with a least squares refinement for BC1, and choose
+// indices with SSE2 where available.  BC6H uses its single region
+// mode with 10 bit endpoints (mode 11), and the decoders cover just
+// what the encoders produce.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _TEXCOMPRESS_
+#define _TEXCOMPRESS_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class MappedFile;
+
+enum BCFormat
+{
+    BCNone = 0,
+    BC1 = 1,
+    BC3 = 3,
+    BC4 = 4,
+    BC5 = 5,
+    BC6H = 6
+};
+
+const char* BCName(const BCFormat format);
+int BCBlockBytes(const BCFormat format);
+size_t BCLevelBytes(const BCFormat format, const int width, const int height);
+
+// Compresses one image (one mip level), spreading block rows over the
+// worker pool.  texels are RGBA8, or RGB floats for BC6H, bottom row
+// first as Texture stores them.  Returns the blocks, in rows.
+std::vector<unsigned char> CompressImage(const BCFormat format, const void* texels,
+                                         const int width, const int height);
+
+// The reverse:  fills texels (RGBA8, or RGB floats for BC6H).
+void DecompressImage(const BCFormat format, const unsigned char* blocks,
+                     const int width, const int height, void* texels);
+
+// A compressed mip chain, as stored in cache/tex<hash>.bin (a filecache
+// file with magic "BCTX").
+struct BCHeader
+{
+    uint32_t format;            // A BCFormat
+    uint32_t width, height;
+    uint32_t levels;
+    uint64_t stamp;             // HashFileStamp of the source image
+    uint64_t offset[16];        // Of each level, from the start of the payload
+    uint64_t size[16];
+};
+
+const uint32_t bcVersion = 1;
+
+// Where the compressed version of the image at path is kept.
+std::string CompressedPath(const std::string& path);
+
+// A compressed texture read (in place) from its file or the asset pack.
+struct CompressedTexture
+{
+    BCFormat format;
+    int width, height, levels;
+    const unsigned char* level[16];
+    size_t size[16];
+    MappedFile* file;           // Holds the mapping (NULL if in the pack)
+
+    CompressedTexture() : file(NULL) {}
+    ~CompressedTexture();
+};
+
+// Returns the compressed version of the image at path, or NULL if
+// there is none or it's older than the image.
+CompressedTexture* ReadCompressed(const std::string& path);
+
+#endif
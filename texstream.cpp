@@ -0,0 +1,248 @@
+////////////////////////////////////////////////////////////////////////
+// Mip level streaming under a GPU memory budget.
+////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <thread>
+
+#include <glbinding/gl/gl.h>
+#include <glbinding/Binding.h>
+using namespace gl;
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "texstream.h"
+#include "shapes.h"
+#include "texture.h"
+#include "workers.h"
+
+// Levels finer than the estimate that are asked for, as a texture may
+// repeat several times across a surface.
+static const int lodBias = 1;
+
+static double Now()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TextureStreamer::TextureStreamer()
+    : budget((size_t)256 << 20), residentSize(128), evictFrames(120), maxLoading(4),
+      resident(0), frame(0), pixelScale(0.0f)
+{
+}
+
+int TextureStreamer::FloorLevel(const int width, const int height, const int levels) const
+{
+    int level = 0;
+    while (level < levels-1 && std::max(width >> level, height >> level) > residentSize)
+        level++;
+    return level;
+}
+
+void TextureStreamer::Add(Texture* texture, const int floor)
+{
+    Streamed s = { floor, floor, frame-1, frame, false, PixelSpan() };
+    textures[texture] = s;
+}
+
+void TextureStreamer::Remove(Texture* texture)
+{
+    std::map<Texture*, Streamed>::iterator i = textures.find(texture);
+    if (i == textures.end()) return;
+
+    // Wait out a level being read, whose job still uses the texture
+    while (i->second.loading) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            std::deque<Texture*>::iterator r = std::find(read.begin(), read.end(), texture);
+            if (r != read.end()) {
+                read.erase(r);
+                i->second.loading = false; }
+        }
+        if (i->second.loading) std::this_thread::yield(); }
+    Uploads().Release(i->second.stage);
+
+    for (int l=texture->base;  l<i->second.floor;  l++) {
+        size_t size;
+        texture->LevelTexels(l, size);
+        resident -= size; }
+    textures.erase(i);
+}
+
+void TextureStreamer::SetView(const glm::mat4& proj, const glm::mat4& _view, const int viewportHeight)
+{
+    view = _view;
+
+    // Frustum planes (Gribb/Hartmann) from the rows of Proj*View,
+    // normalized so the plane distance is in world units.
+    glm::mat4 M = proj*view;
+    glm::vec4 row[4];
+    for (int r=0;  r<4;  r++)
+        row[r] = glm::vec4(M[0][r], M[1][r], M[2][r], M[3][r]);
+    planes[0] = row[3]+row[0];  planes[1] = row[3]-row[0];
+    planes[2] = row[3]+row[1];  planes[3] = row[3]-row[1];
+    planes[4] = row[3]+row[2];  planes[5] = row[3]-row[2];
+    for (int p=0;  p<6;  p++)
+        planes[p] /= glm::length(planes[p].xyz());
+
+    pixelScale = 0.5f*proj[1][1]*viewportHeight;
+}
+
+void TextureStreamer::Request(Texture* texture, Shape* shape, const glm::mat4& modelTr)
+{
+    if (!texture || textures.find(texture) == textures.end()) return;
+    glm::vec3 c;
+    float r;
+    if (!shape || !shape->Bound(c, r)) {
+        Request(texture, 0);
+        return; }
+
+    // The bounding sphere in world coordinates
+    glm::vec4 center = modelTr*glm::vec4(c, 1.0f);
+    float scale = std::max(glm::length(modelTr[0].xyz()),
+                           std::max(glm::length(modelTr[1].xyz()), glm::length(modelTr[2].xyz())));
+    float radius = r*scale;
+    for (int p=0;  p<6;  p++)
+        if (glm::dot(planes[p], center) < -radius) return; // Out of view
+
+    // The texture spans (at most) the sphere's width on screen
+    float z = -(view*center).z;
+    if (z <= radius) {
+        Request(texture, 0);
+        return; }
+    float pixels = std::max(1.0f, 2.0f*radius*pixelScale/z);
+    float lod = log2f(std::max(texture->width, texture->height)/pixels) - lodBias;
+    Request(texture, std::max(0, (int)floorf(lod)));
+}
+
+void TextureStreamer::Request(Texture* texture, const int level)
+{
+    std::map<Texture*, Streamed>::iterator i = textures.find(texture);
+    if (i == textures.end()) return;
+    Streamed& s = i->second;
+    s.wanted = s.requested == frame ? std::min(s.wanted, level) : level;
+    s.requested = frame;
+}
+
+// The finest level the texture needs now.
+int TextureStreamer::Need(const Streamed& s) const
+{
+    return s.requested == frame ? std::min(s.wanted, s.floor) : s.floor;
+}
+
+// Drops the finest resident level of texture.
+void TextureStreamer::Drop(Texture* texture)
+{
+    size_t size;
+    texture->LevelTexels(texture->base, size);
+    glBindTexture(GL_TEXTURE_2D, texture->textureId);
+    texture->DropLevel(texture->base);
+    texture->base++;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture->base);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    resident -= size;
+}
+
+// Drops levels that are no longer needed, least recently needed first,
+// until bytes more fit in the budget.  Returns false if they can't.
+bool TextureStreamer::Evict(const size_t bytes)
+{
+    while (resident + bytes > budget) {
+        Texture* victim = NULL;
+        unsigned int oldest = 0;
+        for (std::map<Texture*, Streamed>::iterator i=textures.begin();  i!=textures.end();  i++) {
+            Texture* t = i->first;
+            const Streamed& s = i->second;
+            if (t->base < Need(s) && !s.loading && (!victim || frame - s.needed > oldest)) {
+                victim = t;
+                oldest = frame - s.needed; } }
+        if (!victim) return false;
+        Drop(victim); }
+    return true;
+}
+
+void TextureStreamer::Update(const double timeBudget)
+{
+    double begin = Now();
+
+    // Upload the levels read so far, if they're still wanted
+    while ((Now() - begin)*1000.0 < timeBudget) {
+        Texture* t;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (read.empty()) break;
+            t = read.front();
+            read.pop_front();
+        }
+        Streamed& s = textures[t];
+        s.loading = false;
+        int level = t->base - 1;
+        size_t size;
+        t->LevelTexels(level, size);
+        if (Need(s) <= level && Evict(size)) {
+            glBindTexture(GL_TEXTURE_2D, t->textureId);
+            if (s.stage.data) Uploads().Bind();
+            t->UploadLevel(level, s.stage.data ? &s.stage : NULL);
+            if (s.stage.data) Uploads().Unbind();
+            t->base = level;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, t->base);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            resident += size; }
+        Uploads().Release(s.stage); }
+
+    // Drop levels unneeded for a while, and list the textures wanting more
+    int loading = 0;
+    std::vector<std::pair<int, Texture*> > wants;
+    for (std::map<Texture*, Streamed>::iterator i=textures.begin();  i!=textures.end();  i++) {
+        Texture* t = i->first;
+        Streamed& s = i->second;
+        int need = Need(s);
+        if (s.loading) loading++;
+        if (need <= t->base) s.needed = frame;
+        else if (!s.loading && frame - s.needed > (unsigned int)evictFrames) Drop(t);
+        if (need < t->base && !s.loading)
+            wants.push_back(std::make_pair(t->base - need, t)); }
+
+    // Start reading the next level of those furthest from what they
+    // need:  a worker copies it into the pixel ring, or else touches
+    // its pages, so the upload won't wait on the disk.
+    std::sort(wants.rbegin(), wants.rend());
+    for (size_t w=0;  w<wants.size() && loading<maxLoading;  w++) {
+        Texture* t = wants[w].second;
+        int level = t->base - 1;
+        size_t size;
+        t->LevelTexels(level, size);
+        if (!Evict(size)) break;
+        Streamed& s = textures[t];
+        s.loading = true;
+        loading++;
+        Uploads().Reserve(size, s.stage);
+        unsigned char* stage = s.stage.data;
+        Workers().Submit([this, t, level, stage]() {
+                size_t size;
+                const volatile unsigned char* texels = t->LevelTexels(level, size);
+                if (stage)
+                    memcpy(stage, (const unsigned char*)texels, size);
+                else {
+                    unsigned char sum = 0;
+                    for (size_t i=0;  i<size;  i+=4096) sum += texels[i];
+                    (void)sum; }
+                std::lock_guard<std::mutex> guard(lock);
+                read.push_back(t); }); }
+
+    frame++;
+}
+
+TextureStreamer& Streamer()
+{
+    static TextureStreamer streamer;
+    return streamer;
+}
@@ -0,0 +1,99 @@
+////////////////////////////////////////////////////////////////////////
+// Mip level streaming.  A texture with a mip chain starts out with
+// only its small levels (residentSize texels across and below) on the
+// graphics card;  GL_TEXTURE_BASE_LEVEL keeps the sampler off the
+// missing ones.  Each frame, Object::Draw asks for the level each of
+// its textures needs, estimated from how many pixels the object's
+// bounding sphere covers on screen (nothing for an object out of
+// view).  Update then brings in the finer levels asked for, one level
+// per texture at a time:  a worker job copies the level's (mapped)
+// texels into the pixel ring (see pixelring.h), or just pages them in
+// from disk if it's full, and the render thread uploads it within a
+// time budget.
+//
+// The streamed levels of all textures share one GPU memory budget.
+// To make room, the finest level of the least recently needed texture
+// that has more than it now needs is dropped;  levels no longer needed
+// are dropped after evictFrames frames anyway, so what stays resident
+// tracks what is on screen.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _TEXSTREAM_
+#define _TEXSTREAM_
+
+#include <stddef.h>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include "pixelring.h"
+
+class Texture;
+class Shape;
+
+class TextureStreamer
+{
+ public:
+    TextureStreamer();
+
+    size_t budget;              // Bytes for all streamed levels
+    int residentSize;           // Levels this size and under are always resident
+    int evictFrames;            // Frames an unneeded level is kept
+    int maxLoading;             // Levels being read at once
+
+    // The camera, for the estimates below;  call once per frame,
+    // before drawing.
+    void SetView(const glm::mat4& proj, const glm::mat4& view, const int viewportHeight);
+
+    // Asks for the level of texture needed to draw shape, transformed
+    // by modelTr, or for a given level (0 for all of it).
+    void Request(Texture* texture, Shape* shape, const glm::mat4& modelTr);
+    void Request(Texture* texture, const int level);
+
+    // Uploads levels that have been read, within timeBudget
+    // (milliseconds), then starts reading the next ones and drops those
+    // no longer needed.  Call once per frame, from the render thread.
+    void Update(const double timeBudget);
+
+    size_t Resident() const { return resident; }
+
+ private:
+    friend class Texture;
+
+    struct Streamed
+    {
+        int floor;              // Levels from here on down are always resident
+        int wanted;             // The finest level asked for this frame
+        unsigned int requested; // The frame that was
+        unsigned int needed;    // The last frame the finest resident level was needed
+        bool loading;           // A level is being read
+        PixelSpan stage;        // into here, if the pixel ring had room
+    };
+
+    // The first level that is always resident.
+    int FloorLevel(const int width, const int height, const int levels) const;
+
+    // Called by Texture as it uploads and is deleted.
+    void Add(Texture* texture, const int floor);
+    void Remove(Texture* texture);
+
+    int Need(const Streamed& s) const;
+    bool Evict(const size_t bytes);
+    void Drop(Texture* texture);
+
+    std::map<Texture*, Streamed> textures;
+    size_t resident;            // Bytes of streamed levels on the graphics card
+    unsigned int frame;
+
+    glm::mat4 view;
+    glm::vec4 planes[6];        // Of the view frustum, pointing in
+    float pixelScale;           // Pixels across per unit of radius at distance 1
+
+    std::mutex lock;            // Guards read;  everything else is render thread only
+    std::deque<Texture*> read;  // Textures whose next level has been read
+};
+
+// The single streamer shared by the whole program, created on first use.
+TextureStreamer& Streamer();
+
+#endif
@@ -7,6 +7,10 @@
 #include "math.h"
 #include <fstream>
 #include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
 
 #include <glbinding/gl/gl.h>
 #include <glbinding/Binding.h>
@@ -17,6 +21,13 @@ using namespace gl;
 #include <glm/glm.hpp>
 
 #include "texture.h"
+#include "assetpack.h"
+#include "imageformat.h"
+#include "texcompress.h"
+#include "mipchain.h"
+#include "filecache.h"
+#include "texstream.h"
+#include "pixelring.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STBI_FAILURE_USERMSG
@@ -25,28 +36,349 @@ using namespace gl;
 #include <glu.h>                // For gluErrorString
 #define CHECKERROR {GLenum err = glGetError(); if (err != GL_NO_ERROR) { fprintf(stderr, "OpenGL error (at line texture.cpp:%d): %s\n", __LINE__, gluErrorString(err)); exit(-1);} }
 
-Texture::Texture(const std::string &path) : textureId(0)
+Texture::Texture(const std::string &path) : textureId(0), image(NULL), hdr(false), normalXY(false),
+                                            gpuBytes(0), cpu(NULL),
+                                            mapped(false), compressed(NULL), mips(NULL),
+                                            levels(0), base(0), staged(NULL), retain(false)
 {
-    stbi_set_flip_vertically_on_load(true);
-    image = stbi_load(path.c_str(), &width, &height, &depth, 4);
+    if (!Decode(path))
+        exit(-1);
+    Upload();
+}
+
+// An empty texture (textureId 0, no image) to be filled in later, as
+// the asset loader does.
+Texture::Texture() : textureId(0), width(0), height(0), depth(4), image(NULL), hdr(false),
+                     normalXY(false), gpuBytes(0), cpu(NULL), mapped(false), compressed(NULL), mips(NULL), levels(0), base(0),
+                     staged(NULL), retain(false)
+{
+}
+
+// Frees the texture on the graphics card, and any image not yet sent.
+Texture::~Texture()
+{
+    if (textureId && (mips || compressed)) Streamer().Remove(this);  // Still streaming
+    Unstage();
+    delete cpu;
+    if (image && !mapped) stbi_image_free(image);
+    delete compressed;
+    delete mips;
+    if (textureId) glDeleteTextures(1, &textureId);
+}
+
+// Reads the image at path into image, width, and height, without
+// touching OpenGL, so it may run on any thread.
+bool Texture::Decode(const std::string& path)
+{
+    // A block-compressed version (made by bctool) is used as it is.
+    compressed = ReadCompressed(path);
+    if (compressed) {
+        width = compressed->width;
+        height = compressed->height;
+        depth = 4;
+        hdr = compressed->format == BC6H;
+        normalXY = compressed->format == BC5;
+        printf("%d %d %d %s (%s)\n", depth, width, height, path.c_str(), BCName(compressed->format));
+        return true; }
+
+    // So is a mipmap chain built on an earlier run.
+    mips = ReadMipChain(path, mipFilter);
+    if (mips) {
+        width = mips->width;
+        height = mips->height;
+        depth = 4;
+        hdr = mips->format == ImageR11G11B10F;
+        printf("%d %d %d %s (mipmapped)\n", depth, width, height, path.c_str());
+        return true; }
+
+    // An image in the asset pack is already decoded (and flipped).
+    size_t size;
+    const char* packed = PackedAsset(path, PackImage, size);
+    PackedImage p;
+    if (packed && size >= sizeof(p)) {
+        memcpy(&p, packed, sizeof(p));
+        if ((size - sizeof(p))/4/(p.width ? p.width : 1) >= p.height) {
+            width = p.width;
+            height = p.height;
+            depth = 4;
+            image = (unsigned char*)(packed + sizeof(p));
+            hdr = p.format == ImageR11G11B10F;
+            mapped = true;
+            printf("%d %d %d %s (packed)\n", depth, width, height, path.c_str());
+            return MakeMips(path); } }
+
+    // HDR files keep their range:  decoded to floats, then packed to
+    // R11F_G11F_B10F in place.
+    hdr = stbi_is_hdr(path.c_str()) != 0;
+    if (hdr) {
+        float* rgb = stbi_loadf(path.c_str(), &width, &height, &depth, 3);
+        if (rgb) EncodeR11G11B10F(rgb, (uint32_t*)rgb, (size_t)width*height);
+        image = (unsigned char*)rgb; }
+    else
+        image = stbi_load(path.c_str(), &width, &height, &depth, 4);
     depth = 4;
-    printf("%d %d %d %s\n", depth, width, height, path.c_str());
+    printf("%d %d %d %s%s\n", depth, width, height, path.c_str(), hdr ? " (HDR)" : "");
     if (!image) {
         printf("\nRead error on file %s:\n  %s\n\n", path.c_str(), stbi_failure_reason());
+        return false; }
+    return MakeMips(path);
+}
+
+// Builds (and saves, for next time) the mipmap chain of the decoded
+// image, which it then releases.
+bool Texture::MakeMips(const std::string& path)
+{
+    mips = MakeMipChain(image, hdr ? ImageR11G11B10F : ImageRGBA8, width, height,
+                        MipKindFor(path), mipFilter, HashFileStamp(PackName(path)));
+    if (WriteMipChain(path, mipFilter, mips)) {
+        // Keep the chain as a mapping of the file just written, which
+        // costs no memory while it waits to be streamed
+        MipChain* saved = ReadMipChain(path, mipFilter);
+        if (saved) {
+            delete mips;
+            mips = saved; } }
+    if (!mapped) stbi_image_free(image);
+    image = NULL;
+    mapped = false;
+    return true;
+}
+
+static size_t Align16(const size_t n) { return (n + 15) & ~(size_t)15; }
+
+// Where level of the chain lies in a span staged from level base on,
+// and (returned) the whole span's size.
+static size_t StagedOffsets(const int base, const int levels,
+                            const std::function<size_t(int)>& size, size_t* offset)
+{
+    size_t at = 0;
+    for (int l=base;  l<levels;  l++) {
+        offset[l] = at;
+        at += Align16(size(l)); }
+    return at;
+}
+
+// Copies the levels Upload will send into the pixel ring, so the
+// render thread needn't touch them.  Called on the worker that
+// decoded the texture;  it does nothing if the ring is full.
+void Texture::Stage()
+{
+    if (!compressed && !mips) return;
+    int n = compressed ? compressed->levels : mips->levels;
+    int floor = Streamer().FloorLevel(width, height, n);
+    size_t offset[16];
+    auto size = [this](int l) { size_t s;  LevelTexels(l, s);  return s; };
+    PixelSpan span;
+    if (!Uploads().Reserve(StagedOffsets(floor, n, size, offset), span)) return;
+    for (int l=floor;  l<n;  l++) {
+        size_t s;
+        const unsigned char* texels = LevelTexels(l, s);
+        memcpy(span.data + offset[l], texels, s); }
+    staged = new PixelSpan(span);
+}
+
+// Gives back the staged levels unused.
+void Texture::Unstage()
+{
+    if (!staged) return;
+    Uploads().Release(*staged);
+    delete staged;
+    staged = NULL;
+}
+
+// Reverses the order of an image's rows.
+static void FlipRows(unsigned char* image, const int height, const size_t rowBytes)
+{
+    std::vector<unsigned char> row(rowBytes);
+    for (int y=0;  y<height/2;  y++) {
+        unsigned char* a = image + y*rowBytes;
+        unsigned char* b = image + (height-1-y)*rowBytes;
+        memcpy(&row[0], a, rowBytes);
+        memcpy(a, b, rowBytes);
+        memcpy(b, &row[0], rowBytes); }
+}
+
+// Decodes an image file already in memory (such as one embedded in a
+// glTF binary).  glTF places texture coordinate (0,0) at the top left
+// of the image, so its images are not flipped:  stb_image flips every
+// image it loads (see main), so they are flipped back here.
+Texture::Texture(const unsigned char* data, const int length, const std::string& name,
+                 const bool flip) : textureId(0), hdr(false), normalXY(false), gpuBytes(0), cpu(NULL), mapped(false),
+                                    compressed(NULL), mips(NULL), levels(0), base(0),
+                                    staged(NULL), retain(false)
+{
+    image = stbi_load_from_memory(data, length, &width, &height, &depth, 4);
+    depth = 4;
+    if (image && !flip) FlipRows(image, height, 4*(size_t)width);
+    printf("%d %d %d %s\n", depth, width, height, name.c_str());
+    if (!image) {
+        printf("\nRead error on image %s:\n  %s\n\n", name.c_str(), stbi_failure_reason());
         exit(-1); }
+    mips = MakeMipChain(image, ImageRGBA8, width, height, MipKindFor(name), mipFilter);
+    stbi_image_free(image);
+    image = NULL;
+    Upload();
+}
+
+// Takes over the decoded image (or mipmap chain, or compressed levels)
+// of other, which is left empty.
+void Texture::Take(Texture* other)
+{
+    width = other->width;
+    height = other->height;
+    depth = other->depth;
+    image = other->image;
+    hdr = other->hdr;
+    normalXY = other->normalXY;
+    mapped = other->mapped;
+    compressed = other->compressed;
+    mips = other->mips;
+    staged = other->staged;
+    other->image = NULL;
+    other->compressed = NULL;
+    other->mips = NULL;
+    other->staged = NULL;
+}
+
+// Whether the driver can sample format directly.  RGTC (BC4 and BC5)
+// is core in OpenGL 3.0;  the others need an extension (or 4.2 for
+// BPTC).
+static bool CompressedSupported(const BCFormat format)
+{
+    static int s3tc = -1, bptc = -1;
+    if (s3tc < 0) {
+        int count = 0, major = 0, minor = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        s3tc = 0;
+        bptc = major > 4 || (major == 4 && minor >= 2);
+        for (int i=0;  i<count;  i++) {
+            const char* e = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (!e) continue;
+            if (!strcmp(e, "GL_EXT_texture_compression_s3tc")) s3tc = 1;
+            if (!strcmp(e, "GL_ARB_texture_compression_bptc")) bptc = 1; } }
+    switch (format) {
+    case BC1: case BC3: return s3tc != 0;
+    case BC6H:          return bptc != 0;
+    default:            return true; }
+}
+
+// The graphics card's format for the levels of compressed or mips.
+static GLenum InternalFormat(const CompressedTexture* compressed, const MipChain* mips)
+{
+    if (!compressed)
+        return mips->format == ImageR11G11B10F ? GL_R11F_G11F_B10F : GL_RGBA;
+    switch (compressed->format) {
+    case BC1:  return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BC3:  return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BC4:  return GL_COMPRESSED_RED_RGTC1;
+    case BC5:  return GL_COMPRESSED_RG_RGTC2;
+    default:   return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT; }
+}
+
+// Replaces compressed levels the driver can't sample with a chain
+// built from the decoded top level.
+void Texture::DecodeCompressed()
+{
+    const CompressedTexture* c = compressed;
+    printf("No driver support for %s textures;  decoding\n", BCName(c->format));
+    std::vector<unsigned char> texels((size_t)width*height*4);
+    if (c->format == BC6H) {
+        std::vector<float> rgb((size_t)width*height*3);
+        DecompressImage(c->format, c->level[0], width, height, &rgb[0]);
+        EncodeR11G11B10F(&rgb[0], (uint32_t*)&texels[0], (size_t)width*height); }
+    else
+        DecompressImage(c->format, c->level[0], width, height, &texels[0]);
+    bool color = c->format == BC1 || c->format == BC3;
+    mips = MakeMipChain(&texels[0], hdr ? ImageR11G11B10F : ImageRGBA8, width, height,
+                        color ? MipColor : MipLinear, mipFilter);
+    delete compressed;
+    compressed = NULL;
+}
+
+// Sends the mipmap chain (or compressed levels) to the graphics card:
+// all of it, or, for a texture large enough to stream, just the small
+// levels (see texstream.h), keeping the chain to stream the rest from.
+// Levels staged in the pixel ring are read from there.
+void Texture::Upload()
+{
+    if (compressed && !CompressedSupported(compressed->format)) {
+        DecodeCompressed();
+        Unstage(); }
+    levels = compressed ? compressed->levels : mips->levels;
+    base = Streamer().FloorLevel(width, height, levels);
+
+    // The staged levels must be the ones about to be sent
+    size_t offset[16];
+    auto size = [this](int l) { size_t s;  LevelTexels(l, s);  return s; };
+    if (staged && staged->size != StagedOffsets(base, levels, size, offset))
+        Unstage();
 
     // Here we create MIPMAP and set some useful modes for the texture
     glGenTextures(1, &textureId);   // Get an integer id for this texture from OpenGL
     glBindTexture(GL_TEXTURE_2D, textureId);
-    glTexImage2D(GL_TEXTURE_2D, 0, (GLint)GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 10);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    gpuBytes = 0;
+    if (staged) Uploads().Bind();
+    for (int l=levels-1;  l>=base;  l--)
+        UploadLevel(l, staged, staged ? offset[l] : 0);
+    if (staged) {
+        Uploads().Unbind();
+        Unstage(); }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels-1);
+
+    // A one channel texture reads as gray, as its uncompressed image would.
+    if (compressed && compressed->format == BC4) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, (int)GL_RED);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, (int)GL_RED); }
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (int)GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (int)GL_LINEAR_MIPMAP_LINEAR);  
     glBindTexture(GL_TEXTURE_2D, 0);
-    stbi_image_free(image);
+    if (retain) MakeCpuImage();
+    if (image && !mapped) stbi_image_free(image);
+    image = NULL;
+    if (base > 0)
+        Streamer().Add(this, base);
+    else {
+        delete compressed;
+        compressed = NULL;
+        delete mips;
+        mips = NULL; }
+}
+
+const unsigned char* Texture::LevelTexels(const int level, size_t& size) const
+{
+    size = compressed ? compressed->size[level] : mips->size[level];
+    return compressed ? compressed->level[level] : mips->level[level];
+}
+
+// Uploads one level of the chain to the bound texture, from client
+// memory, or from where it was copied in a span of the (bound) pixel
+// ring.
+void Texture::UploadLevel(const int level, const PixelSpan* from, const size_t at)
+{
+    int w = std::max(1, width >> level), h = std::max(1, height >> level);
+    size_t size;
+    const void* texels = LevelTexels(level, size);
+    if (from) texels = PixelRing::Pixels(*from, at);
+    if (compressed)
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, InternalFormat(compressed, mips), w, h, 0, (GLsizei)size, texels);
+    else if (mips->format == ImageR11G11B10F)
+        glTexImage2D(GL_TEXTURE_2D, level, (GLint)GL_R11F_G11F_B10F, w, h, 0,
+                     GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, texels);
+    else
+        glTexImage2D(GL_TEXTURE_2D, level, (GLint)GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+    gpuBytes += size;
+}
 
+// Frees one level of the bound texture on the graphics card.
+void Texture::DropLevel(const int level)
+{
+    size_t size;
+    LevelTexels(level, size);
+    glTexImage2D(GL_TEXTURE_2D, level, (GLint)InternalFormat(compressed, mips), 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    gpuBytes -= size;
 }
 
 // Make a texture availabe to a shader program.  The unit parameter is
@@ -67,8 +399,27 @@ void Texture::Unbind()
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+// Copies the levels asked for by Retain, before Upload lets them go.
+void Texture::MakeCpuImage()
+{
+    delete cpu;
+    cpu = compressed ? new CpuImage(compressed, retainFormat, retainMips)
+        : new CpuImage(mips, retainFormat, retainMips);
+}
+
+bool Texture::Retain(const CpuFormat format, const bool withMips)
+{
+    retain = true;
+    retainFormat = format;
+    retainMips = withMips;
+    if (!textureId) return true;   // Not uploaded yet
+    if (cpu && (cpu->levels > 1 || !withMips) && (cpu->format == format || hdr)) return true;
+    if (!mips && !compressed) return false;
+    MakeCpuImage();
+    return true;
+}
+
 glm::vec3 Texture::GetTexel(float u, float v)
 {
-    int i = int(v*height)*width*depth + int(u*width)*depth;
-    return glm::vec3(image[i]/127.0, image[i+1]/127.0, image[i+2]/127.0);
+    return cpu ? glm::vec3(cpu->Texel(glm::vec2(u, v))) : glm::vec3(0.0f);
 }
@@ -7,6 +7,13 @@
 #ifndef _TEXTURE_
 #define _TEXTURE_
 
+#include <stddef.h>
+
+#include "cpuimage.h"
+
+struct CompressedTexture;
+struct MipChain;
+struct PixelSpan;
 
 // This class reads an image from a file, stores it on the graphics
 // card as a texture, and stores the (small integer) texture id which
@@ -19,11 +26,59 @@ class Texture
     unsigned int textureId;
     int width, height, depth;
     unsigned char* image;
+    bool hdr;                   // image is R11F_G11F_B10F words (from an HDR file), not RGBA bytes
+    bool normalXY;              // A BC5 normal map:  only X and Y are stored, Z is rebuilt
+    size_t gpuBytes;            // On the graphics card, with the mipmap chain (once uploaded)
+    CpuImage* cpu;              // A copy kept for sampling on the CPU (see Retain), or NULL
     Texture(const std::string &filename);
+    Texture();
+    ~Texture();
+    Texture(const unsigned char* data, const int length, const std::string& name,
+            const bool flip=true);
+
+    // A texture owns its name on the graphics card, so it isn't copied.
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
 
     void Bind(const int unit, const int programId, const std::string& name);
     void Unbind();
+
+    // Asks for a copy of the image to be kept in cpu (see cpuimage.h)
+    // as it's uploaded, with its mip levels too if withMips.  Returns false
+    // if it's too late:  the texture was uploaded without one, and the
+    // levels are gone.
+    bool Retain(const CpuFormat format, const bool withMips=false);
+
+    // True once every level is on the graphics card (a streamed
+    // texture may hold back its finest ones).
+    bool Complete() const { return textureId != 0 && base == 0; }
+
+    // The bilinearly filtered texel at (u,v), from cpu (black without one).
     glm::vec3 GetTexel(float u, float v);
+
+ private:
+    friend class AssetLoader;
+    friend class TextureStreamer;
+    bool mapped;                // image points into the asset pack
+    CompressedTexture* compressed; // Block-compressed levels to upload, or
+    MipChain* mips;             // the mipmap chain built from image
+    int levels;                 // In the chain
+    int base;                   // The finest level on the graphics card
+    PixelSpan* staged;          // The levels Upload sends, copied to the pixel ring (or NULL)
+    bool retain;                // Make cpu as the texture is uploaded
+    CpuFormat retainFormat;
+    bool retainMips;
+    bool Decode(const std::string& path);
+    bool MakeMips(const std::string& path);
+    void Stage();
+    void Unstage();
+    void Take(Texture* other);
+    void MakeCpuImage();
+    void DecodeCompressed();
+    void Upload();
+    const unsigned char* LevelTexels(const int level, size_t& size) const;
+    void UploadLevel(const int level, const PixelSpan* from=NULL, const size_t at=0);
+    void DropLevel(const int level);
 };
 
 #endif
@@ -0,0 +1,174 @@
+////////////////////////////////////////////////////////////////////////
+// Vertex welding, by hashing.  Every vertex gets a key (a hash of its
+// compared attributes, or with an epsilon, of the grid cell holding
+// its position) and the vertices are bucketed by key.  Then, in
+// parallel, each vertex looks through its bucket (and with an
+// epsilon, the buckets of the 26 neighboring cells) for the lowest
+// numbered vertex it matches.  Only the lowest numbered vertex of
+// each group survives, so the result doesn't depend on the number of
+// threads.
+////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_SWIZZLE
+#include <glm/glm.hpp>
+
+#include "shapes.h"
+#include "weld.h"
+#include "workers.h"
+#include "filecache.h"
+
+namespace {
+
+struct Welder
+{
+    Shape* shape;
+    float epsilon;
+    bool hasNrm, hasTex;
+    std::vector<uint64_t> keys;         // Per vertex
+    std::vector<int> bucketStart;       // Into order;  one extra at the end
+    std::vector<int> order;             // Vertices sorted by bucket, then index
+    uint64_t mask;
+
+    uint64_t CellKey(const glm::vec3& P, const int dx, const int dy, const int dz) const {
+        int64_t cell[3] = { (int64_t)floor(P.x/epsilon) + dx,
+                            (int64_t)floor(P.y/epsilon) + dy,
+                            (int64_t)floor(P.z/epsilon) + dz };
+        return Hash64(cell, sizeof(cell)); }
+
+    uint64_t Key(const int i) const {
+        if (epsilon > 0.0f)
+            return CellKey(glm::vec3(shape->Pnt[i]), 0, 0, 0);
+        uint64_t hash = Hash64(&shape->Pnt[i], sizeof(glm::vec4));
+        if (hasNrm) hash = Hash64(&shape->Nrm[i], sizeof(glm::vec3), hash);
+        if (hasTex) hash = Hash64(&shape->Tex[i], sizeof(glm::vec2), hash);
+        return hash; }
+
+    template <class V>
+    bool Near(const V& a, const V& b) const {
+        for (int c=0;  c<(int)a.length();  c++)
+            if (fabs(a[c] - b[c]) > epsilon) return false;
+        return true; }
+
+    bool Same(const int i, const int j) const {
+        if (epsilon > 0.0f)
+            return Near(shape->Pnt[i], shape->Pnt[j])
+                && (!hasNrm || Near(shape->Nrm[i], shape->Nrm[j]))
+                && (!hasTex || Near(shape->Tex[i], shape->Tex[j]));
+        return keys[i] == keys[j]
+            && memcmp(&shape->Pnt[i], &shape->Pnt[j], sizeof(glm::vec4)) == 0
+            && (!hasNrm || memcmp(&shape->Nrm[i], &shape->Nrm[j], sizeof(glm::vec3)) == 0)
+            && (!hasTex || memcmp(&shape->Tex[i], &shape->Tex[j], sizeof(glm::vec2)) == 0); }
+
+    // The lowest numbered vertex below i in bucket key that matches i.
+    int Search(const int i, const uint64_t key, int best) const {
+        int b = (int)(key & mask);
+        for (int k=bucketStart[b];  k<bucketStart[b+1];  k++) {
+            int j = order[k];
+            if (j >= best) break;       // Buckets are in index order
+            if (Same(i, j)) return j; }
+        return best; }
+
+    int Match(const int i) const {
+        if (epsilon == 0.0f)
+            return Search(i, keys[i], i);
+        int best = i;
+        glm::vec3 P(shape->Pnt[i]);
+        for (int dx=-1;  dx<=1;  dx++)
+            for (int dy=-1;  dy<=1;  dy++)
+                for (int dz=-1;  dz<=1;  dz++)
+                    best = Search(i, CellKey(P, dx, dy, dz), best);
+        return best; }
+};
+
+}
+
+int WeldVertices(Shape* shape, const float epsilon)
+{
+    int n = (int)shape->Pnt.size();
+    if (n == 0) return 0;
+
+    Welder w;
+    w.shape = shape;
+    w.epsilon = epsilon;
+    w.hasNrm = (int)shape->Nrm.size() == n;
+    w.hasTex = (int)shape->Tex.size() == n;
+    bool hasTan = (int)shape->Tan.size() == n;
+    const int grain = 4096;
+
+    // Key every vertex, then bucket them (a counting sort, which keeps
+    // each bucket in vertex order).
+    w.keys.resize(n);
+    Workers().ParallelFor(n, [&](int begin, int end) {
+            for (int i=begin;  i<end;  i++) w.keys[i] = w.Key(i); }, grain);
+
+    int buckets = 1;
+    while (buckets < n) buckets *= 2;
+    w.mask = buckets - 1;
+    w.bucketStart.assign(buckets+1, 0);
+    for (int i=0;  i<n;  i++) w.bucketStart[(w.keys[i] & w.mask) + 1]++;
+    for (int b=0;  b<buckets;  b++) w.bucketStart[b+1] += w.bucketStart[b];
+    std::vector<int> fill(w.bucketStart.begin(), w.bucketStart.end()-1);
+    w.order.resize(n);
+    for (int i=0;  i<n;  i++) w.order[fill[w.keys[i] & w.mask]++] = i;
+
+    // Each vertex finds its match.  With an epsilon, matching isn't
+    // transitive, so chains are then collapsed onto their first vertex.
+    std::vector<int> rep(n);
+    Workers().ParallelFor(n, [&](int begin, int end) {
+            for (int i=begin;  i<end;  i++) rep[i] = w.Match(i); }, grain);
+
+    std::vector<int> index(n);
+    int kept = 0;
+    for (int i=0;  i<n;  i++) {
+        rep[i] = rep[rep[i]];
+        index[i] = rep[i] == i ? kept++ : index[rep[i]]; }
+    if (kept == n) return 0;
+
+    // Compact the data arrays.  Survivors only move down, so this can
+    // be done in place, in order.  Merged tangents are averaged.
+    std::vector<glm::vec3> tangents;
+    if (hasTan) {
+        tangents.assign(kept, glm::vec3(0.0f));
+        for (int i=0;  i<n;  i++) tangents[index[i]] += shape->Tan[i]; }
+    for (int i=0;  i<n;  i++) {
+        if (rep[i] != i) continue;
+        int k = index[i];
+        shape->Pnt[k] = shape->Pnt[i];
+        if (w.hasNrm) shape->Nrm[k] = shape->Nrm[i];
+        if (w.hasTex) shape->Tex[k] = shape->Tex[i];
+        if (hasTan) shape->Tan[k] = shape->Tan[i]; }
+    shape->Pnt.resize(kept);
+    if (w.hasNrm) shape->Nrm.resize(kept);
+    if (w.hasTex) shape->Tex.resize(kept);
+    if (hasTan) {
+        // Tangents that cancel out keep the survivor's own.
+        for (int k=0;  k<kept;  k++) {
+            float len = glm::length(tangents[k]);
+            if (len > 0.0f) shape->Tan[k] = tangents[k]/len; }
+        shape->Tan.resize(kept); }
+
+    // Renumber the triangles, dropping those that collapsed.
+    int tris = (int)shape->Tri.size();
+    Workers().ParallelFor(tris, [&](int begin, int end) {
+            for (int t=begin;  t<end;  t++)
+                for (int c=0;  c<3;  c++)
+                    shape->Tri[t][c] = index[shape->Tri[t][c]]; }, grain);
+    int keptTris = 0;
+    for (int t=0;  t<tris;  t++) {
+        glm::ivec3 T = shape->Tri[t];
+        if (T[0] != T[1] && T[1] != T[2] && T[2] != T[0])
+            shape->Tri[keptTris++] = T; }
+    shape->Tri.resize(keptTris);
+
+    printf("WeldVertices: removed %d of %d vertices", n - kept, n);
+    if (keptTris < tris) printf(" and %d degenerate triangles", tris - keptTris);
+    printf("\n");
+    return n - kept;
+}
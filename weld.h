@@ -0,0 +1,24 @@
+////////////////////////////////////////////////////////////////////////
+// Vertex welding.  Meshes from exporters that unweld everything (and
+// some generators) repeat vertices, which costs vertex shader work
+// and defeats the post-transform cache.  WeldVertices merges vertices
+// whose position, normal, and texture coordinate all agree, and
+// rewrites the triangles to use the survivors.  It is meant to run
+// just before MakeVAO.
+//
+// With epsilon 0, the compared attributes must be bitwise equal;
+// otherwise every component must agree to within epsilon.  Tangents
+// are not compared (they are derived per triangle, so unwelded copies
+// rarely agree):  those of merged vertices are averaged.
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _WELD_
+#define _WELD_
+
+class Shape;
+
+// Welds shape's data arrays in place, dropping any triangles that
+// become degenerate.  Returns the number of vertices removed.
+int WeldVertices(Shape* shape, const float epsilon=0.0f);
+
+#endif
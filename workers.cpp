@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////
+// The worker thread pool (see workers.h).
+////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#include "workers.h"
+
+WorkerPool::WorkerPool(const int count) : quit(false)
+{
+    int n = count;
+    if (n <= 0)
+        n = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    for (int i=0;  i<n;  i++)
+        threads.push_back(std::thread(&WorkerPool::Loop, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (size_t i=0;  i<threads.size();  i++)
+        threads[i].join();
+}
+
+// Each worker sleeps until a job is queued, runs it, and repeats.
+void WorkerPool::Loop()
+{
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (!quit && jobs.empty())
+                wake.wait(guard);
+            if (quit && jobs.empty())
+                return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void WorkerPool::Submit(const std::function<void()>& job)
+{
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        jobs.push_back(job);
+    }
+    wake.notify_one();
+}
+
+// The bands are claimed through a shared counter by the calling
+// thread and by helper jobs placed at the front of the queue (ahead
+// of any long-running background work).  A helper that starts after
+// every band has been claimed simply returns.  The band boundaries
+// depend only on n and the pool size, never on timing, so each item
+// is always processed by exactly one call to body.
+void WorkerPool::ParallelFor(const int n, const std::function<void(int,int)>& body,
+                             const int grain)
+{
+    if (n <= 0) return;
+    int bands = std::min(4*(Size()+1), std::max(1, n/std::max(1, grain)));
+    if (bands == 1) {
+        body(0, n);
+        return; }
+
+    struct Shared {
+        std::atomic<int> next, done;
+        std::mutex lock;
+        std::condition_variable finished;
+    };
+    std::shared_ptr<Shared> shared(new Shared());
+    shared->next = 0;
+    shared->done = 0;
+
+    const std::function<void(int,int)>* pbody = &body;
+    std::function<void()> work = [shared, pbody, n, bands]() {
+        int b;
+        while ((b = shared->next++) < bands) {
+            (*pbody)((long long)b*n/bands, (long long)(b+1)*n/bands);
+            if (++shared->done == bands) {
+                std::unique_lock<std::mutex> guard(shared->lock);
+                shared->finished.notify_all(); } }
+    };
+
+    int helpers = std::min(Size(), bands-1);
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        for (int i=0;  i<helpers;  i++)
+            jobs.push_front(work);
+    }
+    wake.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> guard(shared->lock);
+    while (shared->done < bands)
+        shared->finished.wait(guard);
+}
+
+WorkerPool& Workers()
+{
+    static WorkerPool pool;
+    return pool;
+}
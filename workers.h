@@ -0,0 +1,50 @@
+///////////////////////////////////////////////////////////////////////
+// A small pool of worker threads shared by everything that wants to
+// spread CPU work across the available cores.  Work is handed to the
+// pool either as a loop to be split into bands (ParallelFor, which
+// returns when every band is done), or as a single job to be run in
+// the background (Submit, which returns immediately).
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _WORKERS_
+#define _WORKERS_
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class WorkerPool
+{
+ public:
+    WorkerPool(const int count=0);   // 0 means one per hardware thread (less the caller)
+    ~WorkerPool();
+
+    int Size() const { return (int)threads.size(); }
+
+    // Run body(begin,end) over disjoint bands covering [0,n).  The
+    // calling thread works on bands too, so this may safely be
+    // called from inside another job.  Bands are no smaller than
+    // grain items.
+    void ParallelFor(const int n, const std::function<void(int,int)>& body,
+                     const int grain=1);
+
+    // Queue a job to be run on some worker thread at some later time.
+    void Submit(const std::function<void()>& job);
+
+ private:
+    void Loop();
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()> > jobs;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool quit;
+};
+
+// The single pool shared by the whole program, created on first use.
+WorkerPool& Workers();
+
+#endif